@@ -14,4 +14,5 @@ glslang -V shaders/test.fsh -o shaders/spv/test_frag.spv -S frag
 glslang -V shaders/test2.vsh -o shaders/spv/test_vert_2.spv -S vert
 glslang -V shaders/test2.fsh -o shaders/spv/test_frag_2.spv -S frag
 glslang -V shaders/empty.vsh -o shaders/spv/empty_vsh.spv -S vert
-glslang -V shaders/empty.fsh -o shaders/spv/empty_fsh.spv -S frag
\ No newline at end of file
+glslang -V shaders/empty.fsh -o shaders/spv/empty_fsh.spv -S frag
+glslang -V shaders/post.fsh -o shaders/spv/post_frag.spv -S frag
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+#include <renderer.h>
+#include <typedefs.h>
+
+#include <string>
+
+#pragma region [ OBJ Models ]
+struct MdModel
+{
+    MdGPUBuffer         vertex_buffer,
+                        index_buffer;
+    MdGPUTexture        texture;
+    MdGPUTextureBuilder texture_builder;
+    usize               geometry_size;
+};
+
+// Loads every face of every shape as an unindexed triangle list of VERTEX_SIZE floats per vertex
+// (position, normal, texcoord), normals are estimated per face where the file has none
+MdResult mdLoadOBJ(const char *p_filepath, float **pp_vertices, usize *p_size);
+MdResult mdLoadTextureFromPath(MdRenderer &renderer, const std::string& path, MdGPUTexture &texture, MdGPUTextureBuilder &tex_builder);
+MdResult mdLoadOBJFromPath(MdRenderer &renderer, const std::string& path, MdGPUBuffer &vertex_buffer, MdGPUBuffer &index_buffer, usize *geometry_size);
+MdResult mdLoadOBJModelFromPath(MdRenderer &renderer, const std::string& obj_path, MdModel &model, const std::string& tex_path = "");
+void mdDestroyModel(MdRenderer &renderer, MdModel &model);
+#pragma endregion
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <typedefs.h>
+
+#include <string>
+#include <vector>
+
+struct MdFileWatchDescriptor;
+
+// Watches a single directory (not recursively) for files that were written or moved into it
+struct MdFileWatch
+{
+    MdFileWatchDescriptor *p_descriptor;
+    std::string directory;      // Canonical path, changed files are reported relative to this
+};
+
+MdResult mdCreateFileWatch(const char *p_directory, MdFileWatch &watch);
+// Blocks for up to timeout_ms until something changes, then appends the full path of every
+// changed file (without duplicates) to changed
+MdResult mdWaitFileWatch(   MdFileWatch &watch, 
+                            u32 timeout_ms, 
+                            std::vector<std::string> &changed);
+void mdDestroyFileWatch(MdFileWatch &watch);
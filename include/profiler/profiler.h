@@ -0,0 +1,82 @@
+#pragma once
+
+#include <typedefs.h>
+
+// Scoped CPU profiler. Every thread records into its own ring of completed scopes, single writer, 
+// so recording never locks. Builds without -DMD_PROFILER (meson option 'profiler') compile every 
+// scope out and the export functions do nothing
+#ifdef MD_PROFILER
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MD_PROFILER_RDTSC
+#else
+#include <chrono>
+#endif
+
+#define MD_PROFILER_RING_SIZE 65536
+
+struct MdProfileEvent
+{
+    const char *p_name;         // Has to outlive the profiler, string literals only
+    u64 start;
+    u64 end;
+};
+
+struct MdProfilerThread
+{
+    u32 id;
+    std::atomic<u64> head;      // Total events written, the ring holds the last MD_PROFILER_RING_SIZE
+    MdProfileEvent events[MD_PROFILER_RING_SIZE];
+};
+
+// Registers the calling thread the first time it records
+MdProfilerThread *mdProfilerRegisterThread();
+extern thread_local MdProfilerThread *p_profiler_thread;
+
+// Ticks are rdtsc cycles on x86 and steady_clock nanoseconds elsewhere, converted at export
+inline u64 mdProfilerTicks()
+{
+#ifdef MD_PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+struct MdProfileScope
+{
+    const char *p_name;
+    u64 start;
+
+    MdProfileScope(const char *p_scope_name) : p_name(p_scope_name), start(mdProfilerTicks()) {}
+    ~MdProfileScope()
+    {
+        u64 end = mdProfilerTicks();
+        MdProfilerThread *p_thread = p_profiler_thread;
+        if (p_thread == NULL)
+            p_thread = mdProfilerRegisterThread();
+        
+        u64 head = p_thread->head.load(std::memory_order_relaxed);
+        p_thread->events[head & (MD_PROFILER_RING_SIZE - 1)] = {p_name, start, end};
+        p_thread->head.store(head + 1, std::memory_order_release);
+    }
+};
+
+#define MD_PROFILE_CONCAT_(a, b) a##b
+#define MD_PROFILE_CONCAT(a, b) MD_PROFILE_CONCAT_(a, b)
+#define MD_PROFILE_SCOPE(name) MdProfileScope MD_PROFILE_CONCAT(md_profile_scope_, __LINE__)(name)
+
+// Writes every thread's recorded scopes as Chrome trace event JSON, which about:tracing and 
+// Perfetto both open. Safe while other threads keep recording, scopes that get overwritten 
+// while exporting are left out
+MdResult mdProfilerExportChromeTrace(const char *p_path);
+
+#else
+
+#define MD_PROFILE_SCOPE(name) ((void)0)
+inline MdResult mdProfilerExportChromeTrace(const char *) { return MD_SUCCESS; }
+
+#endif
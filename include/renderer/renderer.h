@@ -28,20 +28,62 @@ MdResult mdCreateRenderer(          u16 w,
                                     u16 h, 
                                     const char *p_title, 
                                     MdRenderer &renderer);
+// No window or surface, rendering goes to image_count offscreen images standing in for the 
+// swapchain's. Meant for benchmarks and software implementations like lavapipe, there is nothing 
+// to present so the swapchain functions can't be used with it.
+MdResult mdCreateHeadlessRenderer(  u16 w, 
+                                    u16 h, 
+                                    u32 image_count,
+                                    MdRenderer &renderer);
 void mdDestroyRenderer(             MdRenderer &renderer);
 
+// Recreates the swapchain with the old one as oldSwapchain and resizes the render graph, 
+// the old swapchain and its image views are retired. Call after waiting on the last 
+// submitted frame's timeline value, resized attachments reuse their memory.
+MdResult mdRebuildSwapchain(        MdRenderer &renderer, 
+                                    u16 w, 
+                                    u16 h);
+// FIFO queues frames behind the vblank, MAILBOX replaces the queued frame and IMMEDIATE tears. 
+// Unsupported modes fall back to FIFO, an image count of 0 lets the surface decide. Rebuilds 
+// the swapchain, so the same rules as mdRebuildSwapchain apply
+MdResult mdSetPresentMode(          MdRenderer &renderer, 
+                                    VkPresentModeKHR mode, 
+                                    u32 image_count = 0);
+
 #pragma region [ Render Graph ]
 enum MdRenderPassAttachmentType
 {
     MD_ATTACHMENT_TYPE_COLOR,
-    MD_ATTACHMENT_TYPE_DEPTH
+    MD_ATTACHMENT_TYPE_DEPTH,
+    MD_ATTACHMENT_TYPE_STORAGE
+};
+
+// Compute passes record outside of a render pass and write storage attachments. Async 
+// compute passes are submitted to the compute queue when the device has a separate one, 
+// with semaphores and queue ownership transfers derived from the graph's edges.
+enum MdRenderPassQueue
+{
+    MD_RENDER_PASS_QUEUE_GRAPHICS,
+    MD_RENDER_PASS_QUEUE_COMPUTE,
+    MD_RENDER_PASS_QUEUE_ASYNC_COMPUTE
+};
+
+// Relative attachments are sized as a fraction of the graph's output extent 
+// (the swapchain), absolute attachments use width and height as-is
+enum MdRenderPassAttachmentSizeMode
+{
+    MD_ATTACHMENT_SIZE_SWAPCHAIN_RELATIVE,
+    MD_ATTACHMENT_SIZE_ABSOLUTE
 };
 
 struct MdRenderPassAttachmentInfo
 {
     bool                        is_swapchain = false;
+    MdRenderPassAttachmentSizeMode size_mode = MD_ATTACHMENT_SIZE_SWAPCHAIN_RELATIVE;
     u16                         width = 0, 
                                 height = 0;
+    f32                         scale_x = 1.0f,
+                                scale_y = 1.0f;
     VkFormat                    format = VK_FORMAT_UNDEFINED;
     MdRenderPassAttachmentType  type = MD_ATTACHMENT_TYPE_COLOR;
     VkSamplerAddressMode        address[3] = {  VK_SAMPLER_ADDRESS_MODE_REPEAT, 
@@ -50,19 +92,32 @@ struct MdRenderPassAttachmentInfo
     VkBorderColor               border_color =  VK_BORDER_COLOR_INT_OPAQUE_WHITE;
 
     MdRenderPassAttachmentInfo(u16 w, u16 h, MdRenderPassAttachmentType type, VkFormat format) : 
-        width(w), height(h), type(type), format(format)
+        size_mode(MD_ATTACHMENT_SIZE_ABSOLUTE), width(w), height(h), format(format), type(type)
     {}
 
     MdRenderPassAttachmentInfo(){}
 };
 
+// Render pass backend builds a VkRenderPass and VkFramebuffers per pass, dynamic 
+// rendering records passes with vkCmdBeginRendering and needs neither. With 
+// dynamic rendering, pass functions receive VK_NULL_HANDLE as their framebuffer.
+enum MdRenderGraphBackend
+{
+    MD_RENDER_GRAPH_BACKEND_RENDER_PASS,
+    MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING
+};
+
 void mdGetAttachmentTexture(const std::string &name, MdGPUTexture **pp_texture);
 
 void mdRenderGraphInit(MdRenderContext *p_context);
 void mdRenderGraphDestroy();
 void mdRenderGraphClear();
+VkResult mdRenderGraphSetBackend(MdRenderGraphBackend backend);
+MdRenderGraphBackend mdRenderGraphGetBackend();
 u32 mdFindRenderPass(const std::string& id);
 void mdAddRenderPass(const std::string& id, bool is_swapchain = false);
+void mdRemoveRenderPass(const std::string& id);
+void mdSetRenderPassQueue(const std::string& id, MdRenderPassQueue queue);
 VkResult mdAddRenderPassInput(  const std::string& id, 
                                 const std::string& input, 
                                 MdRenderPassAttachmentInfo &info);
@@ -73,6 +128,17 @@ VkResult mdAddRenderPassInput(  const std::string& id,
                                 const std::string& input);
 VkResult mdAddRenderPassOutput( const std::string& id, 
                                 const std::string& output);
+
+// Declares an input that the pass only reads at the pixel it is shading (e.g. G-buffer -> lighting).
+// If the producer runs right before this pass at the same extent, both are merged into one
+// render pass and the input is bound as an input attachment rather than a sampled image.
+VkResult mdAddRenderPassLocalInput(const std::string& id, 
+                                const std::string& input);
+bool mdRenderGraphIsPassMerged(const std::string &id);
+// Clear values for a pass's outputs, in output order. A merged pass is begun by its parent's 
+// execute call, so this is how its own outputs get their clear values
+void mdRenderGraphSetClearValues(const std::string &id, 
+                                const std::vector<VkClearValue> &values);
 #include <functional>
 void mdAddRenderPassFunction(   const std::string& id, 
                                 const std::function<void(VkCommandBuffer, VkFramebuffer)> &func);
@@ -80,13 +146,48 @@ void mdAddRenderPassFunction(   const std::string& id,
 void mdRenderGraphClearFramebuffers();
 VkResult mdRenderGraphGenerateFramebuffers(const std::vector<VkImageView> &swapchain_images);
 void mdBuildRenderGraph();
+// Recreates swapchain-relative attachments whose extent changed and regenerates the affected framebuffers
+VkResult mdRenderGraphResize(VkExtent2D extent);
 VkRenderPass mdRenderGraphGetPass(const std::string &pass);
+VkExtent2D mdRenderGraphGetPassExtent(const std::string &pass);
 VkResult mdPrimeRenderGraph();
 usize mdGetCommandBufferCount();
 VkResult mdRenderGraphResetBuffers();
 void mdExecuteRenderPass(const std::vector<VkClearValue> &values, const std::string &pass, u32 fb_index = 0);
 void mdExecuteRenderPass(const std::vector<VkClearValue> &values, u32 pass_index, u32 fb_index = 0);
 void mdRenderGraphSubmit(std::vector<VkCommandBuffer> &buffers, bool refill);
+// GPU time of every pass, from timestamps written at the start and end of its command buffer and 
+// read back once the frame that wrote them has completed. Merged passes are timed with their parent
+#define MD_GPU_TIMING_HISTORY 64
+void mdRenderGraphEnableTimestamps(bool enable);
+// Copies the pass's durations in milliseconds, oldest first, into p_durations_ms (which holds 
+// MD_GPU_TIMING_HISTORY values) and returns how many there were
+u32 mdRenderGraphGetPassTimings(const std::string &pass, f32 *p_durations_ms);
+void mdRenderGraphPrintPassTimings();
+
+// Pipeline statistics of every graphics pass, queried around its command buffer like the timestamps. 
+// Needs the pipelineStatisticsQuery feature, passes on a compute-only queue aren't counted
+struct MdPipelineStatistics
+{
+    u64 ia_vertices;
+    u64 ia_primitives;
+    u64 vs_invocations;
+    u64 clipping_invocations;   // Primitives that reached the clipping stage
+    u64 clipping_primitives;    // Primitives that came out of it
+    u64 fs_invocations;
+};
+void mdRenderGraphEnablePipelineStatistics(bool enable);
+// Fills the counts of the most recently completed frame and the average over every frame that 
+// was read back, either pointer can be NULL. Returns the number of frames averaged
+u32 mdRenderGraphGetPassStatistics(const std::string &pass, MdPipelineStatistics *p_last, MdPipelineStatistics *p_average);
+void mdRenderGraphPrintPassStatistics();
+
+// Every batch signals the timeline of its queue. The returned value is on the graphics timeline, 
+// the last batch holds the final pass and waits on every batch before it, so it completes the frame
+VkResult mdRenderGraphSubmitFrame(  VkSemaphore wait_semaphore, 
+                                    VkPipelineStageFlags wait_stage, 
+                                    VkSemaphore signal_semaphore, 
+                                    u64 *p_frame_value);
 #pragma endregion
 
 #pragma region [ Material System ]
@@ -96,22 +197,82 @@ struct MdPipeline
     VkPipelineLayout layout;
 
     std::array<VkDescriptorSetLayout, 4> set_layouts;
+    u32 set_layout_count = 0;
+
+    std::vector<VkPushConstantRange> push_constants;
+
+    // Key in the variant cache, 0 for pipelines created directly
+    u64 variant = 0;
 };
 
+#define MD_MATERIAL_MAX_TEXTURES 8
+
 struct MdMaterial
 {
     VkPipeline pipeline;
     VkDescriptorSet set;
+
+    // Indices into the bindless texture and sampler tables, UINT32_MAX if unused
+    std::array<u32, MD_MATERIAL_MAX_TEXTURES> textures;
+    std::array<u32, MD_MATERIAL_MAX_TEXTURES> samplers;
+
+    MdMaterial() : pipeline(VK_NULL_HANDLE), set(VK_NULL_HANDLE) { textures.fill(UINT32_MAX); samplers.fill(UINT32_MAX); }
 };
 
 VkResult mdCreateDescriptorAllocator(MdRenderer &renderer);
 void mdDestroyDescriptorAllocator();
 
+// Transient sets are valid until the same frame index begins again, call 
+// mdBeginDescriptorFrame after waiting on that frame's timeline value
+VkResult mdBeginDescriptorFrame(    u32 frame_index);
+VkResult mdAllocateTransientSet(    VkDescriptorSetLayout layout, VkDescriptorSet *p_set);
+
+// Layout cache, every get has to be matched with a release
+VkResult mdGetDescriptorSetLayout(  MdRenderer &renderer, 
+                                    const std::vector<VkDescriptorSetLayoutBinding> &bindings, 
+                                    VkDescriptorSetLayout *p_layout);
+void mdReleaseDescriptorSetLayout(  MdRenderer &renderer, VkDescriptorSetLayout layout);
+VkResult mdGetPipelineLayout(       MdRenderer &renderer, 
+                                    const VkDescriptorSetLayout *p_set_layouts, 
+                                    u32 set_layout_count, 
+                                    const std::vector<VkPushConstantRange> &push_constants, 
+                                    VkPipelineLayout *p_layout);
+void mdReleasePipelineLayout(       MdRenderer &renderer, VkPipelineLayout layout);
+void mdDestroyLayoutCache(          MdRenderer &renderer);
+
+// Bindless tables, resources are referenced from shaders by the returned index (UINT32_MAX on failure)
+VkResult mdCreateBindlessTable(     MdRenderer &renderer);
+void mdDestroyBindlessTable(        MdRenderer &renderer);
+VkDescriptorSetLayout mdBindlessGetLayout();
+VkDescriptorSet mdBindlessGetSet();
+// Adding a view that's already in the table returns its index, each add needs its own remove
+u32 mdBindlessAddTexture(           MdRenderer &renderer, 
+                                    MdGPUTexture &texture, 
+                                    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+// Samplers are created and owned by the table, adds with the same settings share an index
+u32 mdBindlessAddSampler(           MdRenderer &renderer, const VkSamplerCreateInfo &sampler_info);
+u32 mdBindlessAddBuffer(            MdRenderer &renderer, 
+                                    MdGPUBuffer &buffer, 
+                                    usize offset, 
+                                    usize range);
+// Removed indices are reused once the frames submitted so far have completed
+void mdBindlessRemoveTexture(       u32 index);
+void mdBindlessRemoveSampler(       u32 index);
+void mdBindlessRemoveBuffer(        u32 index);
+void mdCmdBindBindlessSet(          VkCommandBuffer cmd, 
+                                    MdPipeline &pipeline, 
+                                    VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS);
+
 void mdDescriptorSetWriteImage(     MdRenderer &renderer, 
                                     VkDescriptorSet dst, 
                                     u32 binding_index, 
                                     MdGPUTexture &texture, 
                                     VkImageLayout layout);
+void mdDescriptorSetWriteInputAttachment(
+                                    MdRenderer &renderer, 
+                                    VkDescriptorSet dst, 
+                                    u32 binding_index, 
+                                    MdGPUTexture &texture);
 void mdDescriptorSetWriteUBO(       MdRenderer &renderer, 
                                     VkDescriptorSet dst, 
                                     u32 binding_index, 
@@ -119,6 +280,57 @@ void mdDescriptorSetWriteUBO(       MdRenderer &renderer,
                                     usize range, 
                                     MdGPUBuffer &buffer);
 
+// Batched descriptor writes, accumulated for one set and flushed with a single call. Sets whose 
+// layout came from the layout cache and had every descriptor written use an update template.
+union MdDescriptorData
+{
+    VkDescriptorImageInfo image;
+    VkDescriptorBufferInfo buffer;
+    VkBufferView texel_buffer;
+};
+
+struct MdDescriptorWrite
+{
+    u32 binding;
+    u32 array_element;
+    VkDescriptorType type;
+};
+
+struct MdDescriptorWriter
+{
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    std::vector<MdDescriptorWrite> writes;
+    std::vector<MdDescriptorData> data;
+
+    // Scratch space kept between flushes
+    std::vector<MdDescriptorData> blob;
+    std::vector<u8> filled;
+    std::vector<VkWriteDescriptorSet> vk_writes;
+};
+
+void mdBeginDescriptorWrites(       MdDescriptorWriter &writer, 
+                                    VkDescriptorSet set, 
+                                    VkDescriptorSetLayout layout);
+void mdDescriptorWriterImage(       MdDescriptorWriter &writer, 
+                                    u32 binding, 
+                                    MdGPUTexture &texture, 
+                                    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
+                                    u32 array_element = 0);
+void mdDescriptorWriterInputAttachment(
+                                    MdDescriptorWriter &writer, 
+                                    u32 binding, 
+                                    MdGPUTexture &texture);
+void mdDescriptorWriterBuffer(      MdDescriptorWriter &writer, 
+                                    u32 binding, 
+                                    VkDescriptorType type, 
+                                    usize offset, 
+                                    usize range, 
+                                    MdGPUBuffer &buffer, 
+                                    u32 array_element = 0);
+void mdFlushDescriptorWrites(       MdRenderer &renderer, 
+                                    MdDescriptorWriter &writer);
+
 VkResult mdCreateGraphicsPipeline(  MdRenderer &renderer, 
                                     MdShaderSource &shaders, 
                                     MdPipelineGeometryInputState *p_geometry_state, 
@@ -129,6 +341,31 @@ VkResult mdCreateGraphicsPipeline(  MdRenderer &renderer,
 void mdDestroyPipeline(             MdRenderer &renderer, 
                                     MdPipeline &pipeline);
 
+// Pipeline variants are shared between every request with the same shader modules, specialization 
+// constants, fixed function state and pass. Every get has to be matched with a release
+VkResult mdGetPipelineVariant(      MdRenderer &renderer, 
+                                    MdShaderSource &shaders, 
+                                    MdPipelineGeometryInputState *p_geometry_state, 
+                                    MdPipelineRasterizationState *p_raster_state, 
+                                    MdPipelineColorBlendState *p_color_blend_state, 
+                                    const std::string &pass,
+                                    MdPipeline **pp_pipeline);
+void mdReleasePipelineVariant(      MdRenderer &renderer, 
+                                    MdPipeline *p_pipeline);
+void mdDestroyPipelineVariants(     MdRenderer &renderer);
+
+// Pushes [offset, offset + size) using the stages of every range declared by the pipeline that overlaps it
+void mdCmdPushConstants(            VkCommandBuffer cmd, 
+                                    MdPipeline &pipeline, 
+                                    u32 offset, 
+                                    u32 size, 
+                                    const void *p_data);
+template <typename T>
+inline void mdCmdPushConstants(VkCommandBuffer cmd, MdPipeline &pipeline, const T &data, u32 offset = 0)
+{
+    mdCmdPushConstants(cmd, pipeline, offset, sizeof(T), &data);
+}
+
 VkResult mdCreateMaterial(          MdRenderer &renderer, 
                                     MdPipeline &pipeline, 
                                     MdMaterial &material);
@@ -143,12 +380,117 @@ void mdMaterialSetUBO(              MdRenderer &renderer,
                                     usize offset, 
                                     usize range, 
                                     MdGPUBuffer &buffer);
+VkResult mdMaterialSetBindlessTexture(
+                                    MdRenderer &renderer, 
+                                    MdMaterial& material, 
+                                    u32 slot, 
+                                    MdGPUTexture &texture, 
+                                    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+#pragma endregion
+
+#pragma region [ Shader Hot Reload ]
+VkResult mdLoadShaderSPIRVFromFile( MdRenderContext &context, 
+                                    const char *p_filepath,
+                                    VkShaderStageFlagBits stage,
+                                    MdShaderSource &source);
+
+struct MdShaderFile
+{
+    std::string glsl_path;      // Recompiled into spv_path whenever it changes
+    std::string spv_path;
+    VkShaderStageFlagBits stage;
+};
+
+typedef u32 MdShaderProgramHandle;
+
+// Called with the program's freshly loaded modules on creation and on every reload. The pipeline has
+// to come from mdGetPipelineVariant, it's released through the variant cache once it's replaced
+typedef std::function<VkResult(MdShaderSource&, MdPipeline**)> MdShaderProgramBuildFunc;
+
+VkResult mdCreateShaderProgram(     MdRenderer &renderer, 
+                                    const std::vector<MdShaderFile> &files, 
+                                    const MdShaderProgramBuildFunc &build, 
+                                    MdShaderProgramHandle *p_handle);
+// Reloading replaces the pipeline, so look it up again whenever commands are recorded
+MdPipeline *mdGetShaderProgramPipeline(
+                                    MdShaderProgramHandle handle);
+// Releases the pipeline right away, so the program can't be in use by any frame in flight
+void mdDestroyShaderProgram(        MdRenderer &renderer, 
+                                    MdShaderProgramHandle handle);
+
+// Recompiles changed GLSL files in the directory on a background thread with glslang. Programs using
+// them are rebuilt in mdUpdateShaderHotReload, which has to be called once per frame after waiting on
+// the previous frame's timeline value. Pipelines that were replaced are retired
+MdResult mdEnableShaderHotReload(   MdRenderer &renderer, 
+                                    const char *p_shader_directory);
+void mdUpdateShaderHotReload(       MdRenderer &renderer);
+void mdDisableShaderHotReload(      MdRenderer &renderer);
+#pragma endregion
+
+#define MD_FRAMES_IN_FLIGHT 2
+
+#pragma region [ Deferred Deletion ]
+// Objects destroyed while frames are in flight are retired instead, and freed once the queue timeline 
+// values submitted before they were collected have completed. Retiring is lock-free and safe from any 
+// thread, deleters are a function pointer plus a small inline payload so nothing gets heap allocated
+#define MD_DELETER_PAYLOAD_SIZE 48
+
+typedef void (*MdDeleterFunc)(void *p_payload);
+struct MdDeleter
+{
+    MdDeleterFunc p_func;
+    alignas(8) u8 payload[MD_DELETER_PAYLOAD_SIZE];
+};
+
+void mdRetire(                      MdDeleterFunc p_func, 
+                                    const void *p_payload, 
+                                    usize size);
+void mdRetireBuffer(                MdGPUBuffer &buffer);
+void mdRetireTexture(               MdGPUTexture &texture, 
+                                    bool attachment = false);
+void mdRetireImageView(             VkImageView view);
+void mdRetireFramebuffer(           VkFramebuffer framebuffer);
+void mdRetireSwapchain(             VkSwapchainKHR swapchain);
+void mdRetirePipelineVariant(       MdRenderer &renderer, 
+                                    MdPipeline *p_pipeline);
+
+// Tags everything retired since the last call with the next graphics value to be submitted, then
+// runs the deleters whose values completed. Call once per frame, before recording
+void mdCollectRetired();
+// Runs every pending deleter, only once the device is idle
+void mdFlushRetired();
+#pragma endregion
+
+#pragma region [ Frame Pacing ]
+// Delays the start of a frame so input is sampled as late as possible while the frame still 
+// finishes just before the vblank it's presented at. Present times come from VK_GOOGLE_display_timing 
+// when the device has it. Otherwise vblanks are taken from FIFO acquires that had to wait for a flip,
+// and present times are predicted from them. Sleeping only happens with FIFO present modes, latency
+// is measured for every mode
+struct MdFramePacingStats
+{
+    f64 refresh_ms;             // Refresh period, from the display or measured
+    f64 work_ms;                // Predicted time from input sampling to the GPU finishing the frame
+    f64 sleep_ms;               // Time slept before the last frame
+    f64 latency_ms;             // Average input to present latency
+    bool display_timing;        // Whether present times are real or predicted
+};
+
+void mdSetFramePacing(              bool enable, 
+                                    f64 margin_ms = 1.0);
+// Call after waiting on the previous frame's timeline value, right before input is sampled
+void mdFramePacerWait(              MdRenderer &renderer);
+// Call right after vkAcquireNextImageKHR returns
+void mdFramePacerAcquired(          MdRenderer &renderer);
+// Call right before vkQueuePresentKHR, tags the present so its timing can be matched to its input
+void mdFramePacerPresent(           MdRenderer &renderer, 
+                                    VkPresentInfoKHR &present_info);
+void mdGetFramePacingStats(         MdFramePacingStats &stats);
 #pragma endregion
 
 struct MdFrameData
 {
     VkSemaphore image_available, render_finished;
-    VkFence in_flight;
 
     VkCommandPool pool;
     VkCommandBuffer buffer;
@@ -191,6 +533,11 @@ struct MdRenderState
     // Allocator
     MdGPUAllocator allocator;
     MdRenderQueue graphics_queue;
+    MdRenderQueue compute_queue;
+
+    // The compute queue uses the graphics timeline when it is the same VkQueue
+    MdTimeline graphics_timeline;
+    MdTimeline compute_timeline;
 
     // Frame data (for queue submission and syncing)
     MdFrameData frame_data;
@@ -4,6 +4,11 @@
 #include <VkBootstrap.h>
 #include <typedefs.h>
 #include <vma/vma_usage.h>
+#include <renderer_vk/renderer_vk_reflect.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
 
 #pragma region [ Render Context ]
 struct MdGPUTexture
@@ -14,6 +19,7 @@ struct MdGPUTexture
     VkImage image;
     VkImageView image_view;
     VkSampler sampler;
+    VkSamplerCreateInfo sampler_info;
     VkImageSubresourceRange subresource;
     u16 w, h;
     u16 channels;
@@ -29,24 +35,102 @@ struct MdRenderContext
     VkPhysicalDevice physical_device = VK_NULL_HANDLE;
     vkb::Swapchain swapchain;
 
+    // Requested swapchain configuration, the mode actually used is in swapchain.present_mode. 
+    // An image count of 0 lets vk-bootstrap pick one more than the surface's minimum
+    VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    u32 image_count = 0;
+
+    // VK_GOOGLE_display_timing, used for present time feedback in frame pacing
+    bool display_timing = false;
+
+    // VK_EXT_memory_budget, without it heap budgets are estimated from the heap sizes
+    bool memory_budget = false;
+
+    // Optional core features, only the ones that were enabled on the device are set
+    VkPhysicalDeviceFeatures features = {};
+    VkPhysicalDeviceVulkan12Features features_12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceVulkan13Features features_13 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+
     std::vector<VkImageView> sw_image_views;
     std::vector<VkImage> sw_images;
+
+    // Headless contexts own their images in place of a swapchain's, with one allocation each
+    std::vector<VkDeviceMemory> offscreen_memory;
 };
 
+struct MdTimeline;
 struct MdRenderQueue
 {
     VkQueue queue_handle;
     i32 queue_index;
 
-    MdRenderQueue() : queue_handle(VK_NULL_HANDLE), queue_index(-1) {}
-    MdRenderQueue(VkQueue handle, i32 index) : queue_handle(handle), queue_index(index) {}
+    // Set once the queue has a timeline, queues that share a VkQueue share the timeline
+    MdTimeline *p_timeline;
+
+    MdRenderQueue() : queue_handle(VK_NULL_HANDLE), queue_index(-1), p_timeline(NULL) {}
+    MdRenderQueue(VkQueue handle, i32 index) : queue_handle(handle), queue_index(index), p_timeline(NULL) {}
 };
 
-MdResult mdInitContext(MdRenderContext &context, const std::vector<const char*> &instance_extensions);
+// A headless instance has no surface, the device is then picked without needing to present
+MdResult mdInitContext(MdRenderContext &context, const std::vector<const char*> &instance_extensions, bool headless = false);
 void mdDestroyContext(MdRenderContext &context);
 MdResult mdCreateDevice(MdRenderContext &context);
 MdResult mdGetQueue(VkQueueFlagBits queue_type, MdRenderContext &context, MdRenderQueue &queue);
-MdResult mdGetSwapchain(MdRenderContext &context, bool rebuild = false);
+// Rebuilding passes the current swapchain as oldSwapchain and leaves destroying it and its 
+// image views to the caller. A zero extent uses the surface's current extent
+MdResult mdGetSwapchain(MdRenderContext &context, bool rebuild = false, u32 w = 0, u32 h = 0);
+// Stands in for the swapchain on headless contexts, the images are used like swapchain images 
+// and destroyed with the context
+MdResult mdCreateOffscreenTargets(MdRenderContext &context, u32 w, u32 h, u32 image_count);
+#pragma endregion
+
+#pragma region [ Timelines ]
+// One timeline semaphore per queue. Every submission signals the next value, so a value names a 
+// point in the queue's work and completing it means everything submitted before it completed too
+struct MdTimeline
+{
+    VkDevice device = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+
+    // Held while submitting, values have to reach the queue in the order they're handed out
+    std::mutex lock;
+    std::atomic<u64> submitted{0};
+    std::atomic<u64> completed{0};
+
+    // Last value whose transfers and layout transitions later submissions have to see
+    std::atomic<u64> upload_value{0};
+};
+
+struct MdTimelineWait
+{
+    MdTimeline *p_timeline;
+    u64 value;
+    VkPipelineStageFlags stage;
+};
+
+#define MD_TIMELINE_MAX_WAITS 16
+
+VkResult mdCreateTimeline(          MdRenderContext &context, 
+                                    MdRenderQueue &queue, 
+                                    MdTimeline &timeline);
+void mdDestroyTimeline(             MdTimeline &timeline);
+// Signals the timeline's next value, returned through p_value. Binary semaphores are only 
+// there for the swapchain, everything else waits on timeline values
+VkResult mdTimelineSubmit(          MdTimeline &timeline, 
+                                    u32 buffer_count, 
+                                    const VkCommandBuffer *p_buffers, 
+                                    u32 wait_count = 0, 
+                                    const MdTimelineWait *p_waits = NULL, 
+                                    VkSemaphore binary_wait = VK_NULL_HANDLE, 
+                                    VkPipelineStageFlags binary_wait_stage = 0, 
+                                    VkSemaphore binary_signal = VK_NULL_HANDLE, 
+                                    u64 *p_value = NULL);
+bool mdTimelineIsComplete(          MdTimeline &timeline, 
+                                    u64 value);
+VkResult mdTimelineWait(            MdTimeline &timeline, 
+                                    u64 value, 
+                                    u64 timeout = UINT64_MAX);
 #pragma endregion
 
 #pragma region [ Command Encoder ]
@@ -64,6 +148,32 @@ void mdDestroyCommandEncoder(MdRenderContext &context, MdCommandEncoder &encoder
 
 #pragma region [ Memory ]
 
+// What an allocation is used for, set when it is allocated and carried as its VMA user data
+enum MdMemoryCategory
+{
+    MD_MEMORY_CATEGORY_MESH,
+    MD_MEMORY_CATEGORY_TEXTURE,
+    MD_MEMORY_CATEGORY_ATTACHMENT,
+    MD_MEMORY_CATEGORY_STAGING,
+    MD_MEMORY_CATEGORY_UNIFORM,
+    MD_MEMORY_CATEGORY_COUNT
+};
+
+struct MdMemoryCategoryUsage
+{
+    VkDeviceSize bytes;
+    u32 allocation_count;
+};
+
+struct MdMemoryHeapBudget
+{
+    VkDeviceSize usage;             // Used by the whole process on this heap, not just this allocator
+    VkDeviceSize budget;            // How much the process can use before allocations fail or get evicted
+    VkDeviceSize block_bytes;       // Device memory blocks this allocator holds
+    VkDeviceSize allocation_bytes;  // Part of those blocks handed out to allocations
+    bool device_local;
+};
+
 struct MdGPUBuffer
 {
     VmaAllocation allocation;
@@ -73,19 +183,56 @@ struct MdGPUBuffer
     bool free = true;
 };
 
+// Command pools and staging memory of an upload, released once its timeline value completes
+struct MdPendingUpload
+{
+    u64 value;
+    VkCommandPool pool;
+    VkBuffer buffer;
+    VmaAllocation allocation;
+};
+
 struct MdGPUAllocator
 {
     VkDevice device;
     VmaAllocator allocator;
     MdGPUBuffer staging_buffer;
     MdRenderQueue queue;
+
+    // Uploads submit on the queue's timeline instead of idling it, the shared staging 
+    // buffer is only written again once the last upload reading it has completed
+    u64 staging_value = 0;
+    std::vector<MdPendingUpload> pending_uploads;
+
+    // Live allocations per category, and the fraction of a heap's budget past which it is 
+    // reported. A heap is reported once each time it goes over, its bit is cleared when it drops back
+    std::array<MdMemoryCategoryUsage, MD_MEMORY_CATEGORY_COUNT> categories = {};
+    f32 budget_threshold = 0.9f;
+    u32 heaps_over_threshold = 0;
 };
 
 VkResult mdCreateGPUAllocator(MdRenderContext &context, MdGPUAllocator &allocator, MdRenderQueue queue, VkDeviceSize staging_buffer_size = 1024*1024);
-VkResult mdAllocateGPUBuffer(VkBufferUsageFlags usage, u32 size, MdGPUAllocator &allocator, MdGPUBuffer &buffer);
+// Every allocation made outside of the allocator functions has to be tracked and untracked by hand, 
+// right after it is created and right before it is freed
+void mdTrackAllocation(MdGPUAllocator &allocator, VmaAllocation allocation, MdMemoryCategory category);
+void mdUntrackAllocation(MdGPUAllocator &allocator, VmaAllocation allocation);
+// Fills one budget per memory heap (up to VK_MAX_MEMORY_HEAPS) and returns the heap count
+u32 mdGetMemoryBudgets(MdGPUAllocator &allocator, MdMemoryHeapBudget *p_budgets);
+void mdGetMemoryCategoryUsage(MdGPUAllocator &allocator, MdMemoryCategoryUsage *p_usage);
+const char *mdGetMemoryCategoryName(MdMemoryCategory category);
+void mdSetMemoryBudgetThreshold(MdGPUAllocator &allocator, f32 threshold);
+// Lets VMA refresh its budgets once a frame and warns about heaps past the threshold, 
+// returns false while any heap is over it
+bool mdBeginMemoryFrame(MdGPUAllocator &allocator, u32 frame_index);
+// VMA's JSON statistics, the detailed map lists every allocation under its category's name
+MdResult mdWriteMemoryStats(MdGPUAllocator &allocator, const char *p_path, bool detailed_map = true);
+void mdPrintMemoryUsage(MdGPUAllocator &allocator);
+VkResult mdAllocateGPUBuffer(VkBufferUsageFlags usage, u32 size, MdGPUAllocator &allocator, MdGPUBuffer &buffer, MdMemoryCategory category = MD_MEMORY_CATEGORY_MESH);
 VkResult mdAllocateGPUUniformBuffer(u32 size, MdGPUAllocator &allocator, MdGPUBuffer &buffer);
 void mdFreeGPUBuffer(MdGPUAllocator &allocator, MdGPUBuffer &buffer);
 void mdFreeUniformBuffer(MdGPUAllocator &allocator, MdGPUBuffer &buffer);
+// Frees the pools and staging buffers of completed uploads, or of every upload after waiting for them
+void mdReleaseUploads(MdGPUAllocator &allocator, bool wait = false);
 VkResult mdUploadToGPUBuffer(   MdRenderContext &context, 
                                 MdGPUAllocator &allocator, 
                                 u32 offset, 
@@ -211,11 +358,24 @@ void mdDestroyRenderTarget(MdRenderContext &context, MdRenderTarget &target);
 #pragma endregion
 
 #pragma region [ Shader Modules and Descriptors ]
+// Descriptor set slots used by every pipeline, the bindless set (if any) comes after the material set
+#define MD_GLOBAL_SET_INDEX 0
+#define MD_CAMERA_SET_INDEX 1
+#define MD_MATERIAL_SET_INDEX 2
 
 struct MdShaderSource
 {
     std::vector<VkPipelineShaderStageCreateInfo> modules;
-    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    std::vector<u64> code_hashes;                           // One per module, handles get reused once destroyed
+    std::vector<VkDescriptorSetLayoutBinding> bindings;     // Material set only
+    std::vector<VkPushConstantRange> push_constants;
+
+    // Specialization constants, shared by every stage. Stages ignore ids they don't declare
+    std::vector<VkSpecializationMapEntry> spec_entries;
+    std::vector<u8> spec_data;
+
+    // Everything the loaded modules declare, across all sets and stages
+    MdShaderReflection reflection;
 };
 
 VkResult mdLoadShaderSPIRV( MdRenderContext &context, 
@@ -229,6 +389,32 @@ void mdShaderAddBinding(    MdShaderSource &source,
                             u32 count, 
                             VkShaderStageFlags stage_flags, 
                             const VkSampler* p_immutable_samplers = NULL);
+void mdShaderAddPushConstants(
+                            MdShaderSource &source, 
+                            VkShaderStageFlags stage_flags, 
+                            u32 offset, 
+                            u32 size);
+void mdShaderSetSpecConstant(
+                            MdShaderSource &source, 
+                            u32 constant_id, 
+                            const void *p_data, 
+                            u32 size);
+template <typename T>
+inline void mdShaderSetSpecConstant(MdShaderSource &source, u32 constant_id, T value)
+{
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "specialization constants are 32 or 64-bit scalars");
+    mdShaderSetSpecConstant(source, constant_id, &value, sizeof(T));
+}
+inline void mdShaderSetSpecConstant(MdShaderSource &source, u32 constant_id, bool value)
+{
+    VkBool32 b = value ? VK_TRUE : VK_FALSE;
+    mdShaderSetSpecConstant(source, constant_id, &b, sizeof(VkBool32));
+}
+// Points into the source, so it's only valid until the next mdShaderSetSpecConstant call.
+// Fails if a constant's size doesn't match what the loaded modules declare
+VkResult mdShaderGetSpecializationInfo(
+                            const MdShaderSource &source, 
+                            VkSpecializationInfo &info);
 void mdDestroyShaderSource( MdRenderContext &context, MdShaderSource &source);
 
 struct MdDescriptorSetAllocator
@@ -299,6 +485,23 @@ void MdGeometryInputStageSetTopology(   MdPipelineGeometryInputState &stage,
                                         VkPrimitiveTopology topology, 
                                         VkBool32 primitive_restart = VK_FALSE);
 void mdBuildGeometryInputState(MdPipelineGeometryInputState &stage);
+
+// Where each location sits in a mesh's vertices
+struct MdVertexLayout
+{
+    u32 stride;
+    std::vector<u32> offsets;   // Indexed by location
+};
+
+// Position, normal and uv at locations 0, 1 and 2, the 8 float vertices models are loaded with
+MdVertexLayout mdDefaultVertexLayout();
+
+// Adds a single per-vertex binding for the reflected vertex inputs. Offsets and stride come from the 
+// layout, without one the inputs are packed in location order, which only matches meshes holding 
+// exactly what the shader reads
+void mdGeometryInputFromReflection( MdPipelineGeometryInputState &stage, 
+                                    const MdShaderSource &source, 
+                                    const MdVertexLayout *p_layout = NULL);
 void mdBuildDefaultGeometryInputState(MdPipelineGeometryInputState &stage);
 #pragma endregion
 
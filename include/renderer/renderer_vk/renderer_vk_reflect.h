@@ -0,0 +1,49 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <typedefs.h>
+
+#include <vector>
+
+#pragma region [ SPIR-V Reflection ]
+struct MdReflectedBinding
+{
+    u32 set;
+    u32 binding;
+    VkDescriptorType type;
+    u32 count;                  // 0 for runtime arrays
+    VkShaderStageFlags stages;
+};
+
+struct MdReflectedVertexInput
+{
+    u32 location;
+    VkFormat format;
+    u32 size;
+};
+
+struct MdReflectedSpecConstant
+{
+    u32 id;
+    u32 size;                   // Booleans are 4 bytes, like VkBool32
+    VkShaderStageFlags stages;
+};
+
+struct MdShaderReflection
+{
+    std::vector<MdReflectedBinding> bindings;
+    std::vector<MdReflectedVertexInput> vertex_inputs;   // Sorted by location, vertex shaders only
+    std::vector<VkPushConstantRange> push_constants;
+    std::vector<MdReflectedSpecConstant> spec_constants;
+};
+
+// Reads descriptor bindings, vertex inputs, push constant ranges and specialization constants straight from the module's
+// decorations and types. Results are merged into the reflection, so calling this once per stage
+// combines the stage masks of bindings and push constants shared between stages.
+VkResult mdReflectSPIRV(    u32 code_size,
+                            const u32 *p_code,
+                            VkShaderStageFlagBits stage,
+                            MdShaderReflection &reflection);
+// Combines another reflection's bindings, push constants and specialization constants into this one
+// like a further stage would. Vertex inputs are left alone
+void mdMergeShaderReflection(MdShaderReflection &reflection, const MdShaderReflection &other);
+#pragma endregion
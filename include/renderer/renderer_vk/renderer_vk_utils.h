@@ -3,7 +3,32 @@
 #include <vulkan/vulkan_core.h>
 
 #include <vector>
+#include <string>
 #define MD_NULL_HANDLE -1
+
+// FNV-1a, used to key caches by the contents of create infos and declarations
+#define MD_HASH_SEED 0xcbf29ce484222325ull
+inline u64 mdHashBytes(const void *p_data, usize size, u64 hash = MD_HASH_SEED)
+{
+    const u8 *p_bytes = (const u8*)p_data;
+    for (usize i=0; i<size; i++)
+    {
+        hash ^= p_bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline u64 mdHashString(const std::string &str, u64 hash = MD_HASH_SEED)
+{
+    usize size = str.size();
+    hash = mdHashBytes(&size, sizeof(size), hash);
+    return mdHashBytes(str.data(), size, hash);
+}
+
+template<typename T>
+inline u64 mdHashValue(const T &value, u64 hash = MD_HASH_SEED) { return mdHashBytes(&value, sizeof(T), hash); }
+
 template<typename EntryType>
 struct MdHandleList
 {
@@ -0,0 +1,56 @@
+#pragma once
+#include <renderer.h>
+#include <model/model.h>
+#include <simd_math.h>
+#include <typedefs.h>
+
+#include <vector>
+
+#pragma region [ Demo Scene ]
+struct MdDemoSceneUBO
+{
+    Matrix4x4 u_model;
+    Matrix4x4 u_view_projection;
+    Matrix4x4 u_light_view_projection;
+    f32 u_resolution[2];
+    f32 u_time;
+};
+
+// The teapot drawn into a shadow map and a color attachment, then blitted to the swapchain by the final pass.
+// With the post pass, a tonemap reads the color attachment as a local input and gets merged into the 
+// geometry pass as its second subpass
+struct MdDemoScene
+{
+    bool post_subpass;
+    bool shadows;                       // Specializes test.fsh, the shadow pass runs either way
+    u32 pass_count;
+
+    MdModel teapot;
+    MdGPUBuffer uniform_buffer;
+    MdDemoSceneUBO ubo;
+    Matrix4x4 model, view, view_ls;
+
+    MdMaterial geometry_mat, final_mat, post_mat;
+    MdShaderProgramHandle geometry_program, post_program;
+    MdDescriptorWriter writer;
+
+    MdGPUTexture *p_color_attachment;
+    MdGPUTexture *p_final_input;        // The color attachment, or the post pass's output
+    MdGPUTexture *p_shadow_texture;
+
+    VkViewport viewport, shadow_viewport;
+    VkRect2D scissor, shadow_scissor;
+    std::vector<VkClearValue> clear_values;
+};
+
+// Adds the shadow, geometry and final passes, builds the graph and creates their pipelines. The pass
+// functions point into the scene, so it can't move until it is destroyed. The post subpass needs the
+// render pass backend, so the graph uses it instead of dynamic rendering
+MdResult mdCreateDemoScene(MdRenderer &renderer, MdDemoScene &scene, bool hot_reload = true, bool post_subpass = false, bool shadows = true);
+// Call once the swapchain was rebuilt, the color attachment gets recreated along with it
+void mdDemoSceneResize(MdRenderer &renderer, MdDemoScene &scene, VkExtent2D extent);
+// Writes this frame's global set. A view replaces the scene's camera, its projection follows the viewport
+void mdDemoSceneUpdate(MdRenderer &renderer, MdDemoScene &scene, u32 frame_index, f32 time, const Matrix4x4 *p_view = NULL);
+void mdDemoSceneRecord(MdDemoScene &scene, u32 image_index);
+void mdDestroyDemoScene(MdRenderer &renderer, MdDemoScene &scene);
+#pragma endregion
@@ -127,4 +127,34 @@ struct Matrix4x4
     static Matrix4x4 Perspective(float fov, float ar, float near, float far);
     static Matrix4x4 Orthographic(float l, float r, float b, float t, float n, float f);
     static Matrix4x4 LookAt(Vector4 camera, Vector4 eye, Vector4 up);
-};
\ No newline at end of file
+};
+
+// Batch kernels over many vectors or matrices at once. They run 16 wide with AVX-512, 8 wide 
+// with AVX2 and FMA or 4 wide with SSE, picked through cpuid the first time one is called
+enum MdSimdLevel
+{
+    MD_SIMD_SSE,
+    MD_SIMD_AVX2,
+    MD_SIMD_AVX512
+};
+
+// Structure of arrays, vector n is (x[n], y[n], z[n], w[n]). Inputs are only read and can be 
+// the same arrays as the outputs
+struct MdVector4SoA
+{
+    f32 *x, *y, *z, *w;
+};
+
+MdSimdLevel mdGetSimdLevel();
+// Levels the CPU doesn't support fall back to the best one it does, returns the level now used.
+// Safe to call while other threads run kernels, calls already running finish on the old level
+MdSimdLevel mdSetSimdLevel(MdSimdLevel level);
+const char *mdGetSimdLevelName(MdSimdLevel level);
+
+// out = m * in for count points. A NULL in.w treats every point as w = 1 and a NULL out.w 
+// skips writing w
+void mdTransformPoints(const Matrix4x4 &m, const MdVector4SoA &in, const MdVector4SoA &out, usize count);
+// p_out[n] = p_a[n] * p_b[n], p_out can alias either input
+void mdMultiplyMatrices(const Matrix4x4 *p_a, const Matrix4x4 *p_b, Matrix4x4 *p_out, usize count);
+// Normalizes xyz, w is neither read nor written. Zero length vectors come out as 0
+void mdNormalizeVectors(const MdVector4SoA &in, const MdVector4SoA &out, usize count);
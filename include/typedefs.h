@@ -19,6 +19,7 @@ typedef ssize_t ssize;
 #define MD_ARRAY_SIZE(arr, t) (sizeof(arr) / sizeof(t))
 
 #define LOG_ERROR(err, ...) fprintf(stderr, "error: " err "\n", ##__VA_ARGS__)
+#define LOG_WARNING(warn, ...) fprintf(stderr, "warning: " warn "\n", ##__VA_ARGS__)
 #define MIN_VAL(a,b) (((a)<(b))?(a):(b))
 #define MAX_VAL(a,b) (((a)>(b))?(a):(b))
 
@@ -32,6 +33,7 @@ typedef enum
     MD_ERROR_FILE_INVALID_ACCESS_ARGS,
     MD_ERROR_FILE_READ_FAILURE,
     MD_ERROR_FILE_WRITE_FAILURE,
+    MD_ERROR_FILE_WATCH_FAILURE,
     MD_ERROR_PLUGIN_LOAD_FAILURE,
     MD_ERROR_PLUGIN_BIND_FAILURE,
     MD_ERROR_PLUGIN_CLOSE_FAILURE,
@@ -0,0 +1,334 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <typedefs.h>
+
+#define ARCH_AMD64_SSE
+#include <simd_math/simd_math.h>
+
+#define MD_USE_VULKAN
+#include <renderer.h>
+#include <profiler/profiler.h>
+#include <scene/demo_scene.h>
+
+// Renders the demo scene offscreen for a fixed number of frames, with a fixed timestep and camera
+// path so runs are comparable across machines and commits. Works on lavapipe, nothing is presented.
+//
+//  midori_bench [--frames N] [--warmup N] [--width W] [--height H] [--out path] [--merged] [--no-shadows]
+//
+// --merged adds the demo's post pass, which the render pass backend merges into the geometry pass.
+// --no-shadows specializes the geometry shader without its shadow map lookup
+
+struct MdBenchOptions
+{
+    u32 frames = 500;
+    u32 warmup = 30;
+    u32 width  = 1920;
+    u32 height = 1080;
+    const char *p_out = "midori_bench.json";
+    bool merged = false;
+    bool shadows = true;
+};
+
+struct MdBenchSummary
+{
+    f64 mean, p50, p90, p99, max;
+};
+
+static const char *bench_passes[] = {"shadow", "geometry", "final"};
+#define BENCH_PASS_COUNT (sizeof(bench_passes) / sizeof(bench_passes[0]))
+
+// Frames advance time by the same step whatever they took, so every run sees the same camera
+#define BENCH_TIMESTEP (1.0f / 60.0f)
+
+static bool mdBenchParseArgs(int argc, char **argv, MdBenchOptions &options)
+{
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], "--merged") == 0)
+        {
+            options.merged = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--no-shadows") == 0)
+        {
+            options.shadows = false;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            LOG_ERROR("missing value for \"%s\"", argv[i]);
+            return false;
+        }
+
+        const char *p_value = argv[++i];
+        if (strcmp(argv[i - 1], "--frames") == 0)
+            options.frames = (u32)strtoul(p_value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--warmup") == 0)
+            options.warmup = (u32)strtoul(p_value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--width") == 0)
+            options.width = (u32)strtoul(p_value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--height") == 0)
+            options.height = (u32)strtoul(p_value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--out") == 0)
+            options.p_out = p_value;
+        else
+        {
+            LOG_ERROR("unknown option \"%s\"", argv[i - 1]);
+            return false;
+        }
+    }
+
+    if (options.frames == 0 || options.width == 0 || options.height == 0)
+    {
+        LOG_ERROR("frames, width and height have to be non-zero");
+        return false;
+    }
+    return true;
+}
+
+// Nearest rank percentiles, sorts the samples
+static MdBenchSummary mdBenchSummarize(std::vector<f64> &samples)
+{
+    MdBenchSummary summary = {};
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    f64 sum = 0.0;
+    for (f64 s : samples)
+        sum += s;
+
+    auto percentile = [&](f64 p) {
+        usize rank = (usize)(p * (f64)(samples.size() - 1) + 0.5);
+        return samples[MIN_VAL(rank, samples.size() - 1)];
+    };
+
+    summary.mean = sum / (f64)samples.size();
+    summary.p50  = percentile(0.50);
+    summary.p90  = percentile(0.90);
+    summary.p99  = percentile(0.99);
+    summary.max  = samples.back();
+    return summary;
+}
+
+static void mdBenchWriteSummary(FILE *p_file, const char *p_name, const MdBenchSummary &summary, bool last)
+{
+    fprintf(
+        p_file,
+        "  \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+        p_name,
+        summary.mean,
+        summary.p50,
+        summary.p90,
+        summary.p99,
+        summary.max,
+        last ? "" : ","
+    );
+}
+
+int main(int argc, char **argv)
+{
+    MdBenchOptions options;
+    if (!mdBenchParseArgs(argc, argv, options))
+        return -1;
+
+    // Two images like the windowed build, frames alternate between them
+    MdRenderer renderer;
+    MdResult result = mdCreateHeadlessRenderer(options.width, options.height, 2, renderer);
+    if (result != MD_SUCCESS)
+    {
+        LOG_ERROR("failed to create headless renderer");
+        return -1;
+    }
+
+    MdRenderState *p_renderer_state;
+    mdGetRenderState(&p_renderer_state);
+
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(renderer.context->physical_device, &device_properties);
+
+    mdRenderGraphEnableTimestamps(true);
+    mdRenderGraphEnablePipelineStatistics(true);
+
+    MdDemoScene scene;
+    result = mdCreateDemoScene(renderer, scene, false, options.merged, options.shadows);
+    if (result != MD_SUCCESS)
+    {
+        LOG_ERROR("failed to create scene");
+        mdDestroyRenderer(renderer);
+        return -1;
+    }
+
+    // Frame time is from one frame's start to the next, work time leaves out waiting on the GPU
+    std::vector<f64> cpu_frame_ms, cpu_work_ms;
+    std::vector<f64> gpu_pass_ms[BENCH_PASS_COUNT];
+    cpu_frame_ms.reserve(options.frames);
+    cpu_work_ms.reserve(options.frames);
+
+    f32 durations[MD_GPU_TIMING_HISTORY];
+    u64 frame_value = 0;
+    u32 total_frames = options.warmup + options.frames;
+    u32 image_count = renderer.context->swapchain.image_count;
+    u32 submitted_frames = 0;
+    auto frame_start = std::chrono::steady_clock::now();
+
+    // A frame's samples are taken once it completed and its timestamps were read back, so every 
+    // measured frame gets one of each
+    auto sample_frame = [&](u32 frame, std::chrono::steady_clock::time_point now) {
+        if (frame < options.warmup)
+            return;
+        
+        cpu_frame_ms.push_back(std::chrono::duration<f64, std::milli>(now - frame_start).count());
+        for (u32 p=0; p<BENCH_PASS_COUNT; p++)
+        {
+            u32 count = mdRenderGraphGetPassTimings(bench_passes[p], durations);
+            if (count > 0)
+                gpu_pass_ms[p].push_back(durations[count - 1]);
+        }
+    };
+
+    for (u32 frame=0; frame<total_frames; frame++)
+    {
+        MD_PROFILE_SCOPE("bench frame");
+        mdTimelineWait(p_renderer_state->graphics_timeline, frame_value);
+        auto now = std::chrono::steady_clock::now();
+
+        // The previous frame completed before priming, so this reads back exactly its timestamps
+        mdPrimeRenderGraph();
+        if (frame > 0)
+            sample_frame(frame - 1, now);
+        frame_start = now;
+
+        mdCollectRetired();
+        mdBeginMemoryFrame(p_renderer_state->allocator, frame);
+
+        // Orbits the teapot from the windowed build's camera position
+        f32 t = (f32)frame * BENCH_TIMESTEP;
+        Matrix4x4 view = Matrix4x4::LookAt(
+            Vector4(1.5f * sinf(t), 0.5f * sinf(0.5f * t), -1, 0),
+            Vector4(0,0,1,0),
+            Vector4(0,1,0,0)
+        );
+
+        auto work_start = std::chrono::steady_clock::now();
+        mdDemoSceneUpdate(renderer, scene, frame, t, &view);
+        mdDemoSceneRecord(scene, frame % image_count);
+
+        VkResult vk_result = mdRenderGraphSubmitFrame(VK_NULL_HANDLE, 0, VK_NULL_HANDLE, &frame_value);
+        if (vk_result != VK_SUCCESS)
+        {
+            LOG_ERROR("failed to submit frame %u", frame);
+            break;
+        }
+        submitted_frames++;
+
+        if (frame >= options.warmup)
+            cpu_work_ms.push_back(std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - work_start).count());
+    }
+
+    // A truncated run still writes its report, but isn't reported as a success
+    int exit_code = (submitted_frames == total_frames) ? 0 : -1;
+
+    // The last frame is sampled like the others, priming once more reads back its timestamps
+    vkDeviceWaitIdle(renderer.context->device);
+    if (submitted_frames == total_frames)
+    {
+        auto now = std::chrono::steady_clock::now();
+        mdPrimeRenderGraph();
+        sample_frame(total_frames - 1, now);
+    }
+
+    MdBenchSummary frame_summary = mdBenchSummarize(cpu_frame_ms);
+    MdBenchSummary work_summary = mdBenchSummarize(cpu_work_ms);
+
+    MdMemoryCategoryUsage usage[MD_MEMORY_CATEGORY_COUNT];
+    mdGetMemoryCategoryUsage(p_renderer_state->allocator, usage);
+    MdMemoryHeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+    u32 heap_count = mdGetMemoryBudgets(p_renderer_state->allocator, budgets);
+
+    FILE *p_file = fopen(options.p_out, "w");
+    if (p_file == NULL)
+    {
+        LOG_ERROR("failed to open \"%s\" for writing", options.p_out);
+        exit_code = -1;
+    }
+    else
+    {
+        fprintf(p_file, "{\n");
+        fprintf(p_file, "  \"device\": \"%s\",\n", device_properties.deviceName);
+        fprintf(p_file, "  \"frames\": %u,\n  \"warmup\": %u,\n", options.frames, options.warmup);
+        fprintf(p_file, "  \"width\": %u,\n  \"height\": %u,\n", options.width, options.height);
+        fprintf(p_file, "  \"merged\": %s,\n", options.merged ? "true" : "false");
+        fprintf(p_file, "  \"shadows\": %s,\n", options.shadows ? "true" : "false");
+        mdBenchWriteSummary(p_file, "cpu_frame_ms", frame_summary, false);
+        mdBenchWriteSummary(p_file, "cpu_work_ms", work_summary, false);
+
+        fprintf(p_file, "  \"gpu_passes\": {\n");
+        for (u32 p=0; p<BENCH_PASS_COUNT; p++)
+        {
+            MdBenchSummary pass_summary = mdBenchSummarize(gpu_pass_ms[p]);
+            fprintf(
+                p_file,
+                "    \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"samples\": %zu}%s\n",
+                bench_passes[p],
+                pass_summary.mean,
+                pass_summary.p50,
+                pass_summary.p99,
+                pass_summary.max,
+                gpu_pass_ms[p].size(),
+                (p + 1 < BENCH_PASS_COUNT) ? "," : ""
+            );
+        }
+        fprintf(p_file, "  },\n");
+
+        fprintf(p_file, "  \"memory\": {\n    \"categories\": {\n");
+        for (u32 c=0; c<MD_MEMORY_CATEGORY_COUNT; c++)
+        {
+            fprintf(
+                p_file,
+                "      \"%s\": {\"bytes\": %llu, \"allocations\": %u}%s\n",
+                mdGetMemoryCategoryName((MdMemoryCategory)c),
+                (unsigned long long)usage[c].bytes,
+                usage[c].allocation_count,
+                (c + 1 < MD_MEMORY_CATEGORY_COUNT) ? "," : ""
+            );
+        }
+        fprintf(p_file, "    },\n    \"heaps\": [\n");
+        for (u32 h=0; h<heap_count; h++)
+        {
+            fprintf(
+                p_file,
+                "      {\"usage\": %llu, \"budget\": %llu, \"device_local\": %s}%s\n",
+                (unsigned long long)budgets[h].usage,
+                (unsigned long long)budgets[h].budget,
+                budgets[h].device_local ? "true" : "false",
+                (h + 1 < heap_count) ? "," : ""
+            );
+        }
+        fprintf(p_file, "    ]\n  }\n}\n");
+        fclose(p_file);
+    }
+
+    printf("%s, %ux%u, %u frames after %u warmup\n", device_properties.deviceName, options.width, options.height, options.frames, options.warmup);
+    printf(
+        "CPU frame: mean %.3fms, p50 %.3fms, p90 %.3fms, p99 %.3fms, max %.3fms\n",
+        frame_summary.mean, frame_summary.p50, frame_summary.p90, frame_summary.p99, frame_summary.max
+    );
+    printf("CPU work:  mean %.3fms, p99 %.3fms\n", work_summary.mean, work_summary.p99);
+    mdRenderGraphPrintPassTimings();
+    mdRenderGraphPrintPassStatistics();
+    mdPrintMemoryUsage(p_renderer_state->allocator);
+    mdProfilerExportChromeTrace("midori_bench_trace.json");
+
+    mdDestroyDemoScene(renderer, scene);
+    mdDestroyRenderer(renderer);
+    return exit_code;
+}
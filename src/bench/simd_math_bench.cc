@@ -0,0 +1,522 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include <typedefs.h>
+
+#define ARCH_AMD64_SSE
+#include <simd_math/simd_math.h>
+
+// Times the SSE kernels in simd_math against plain scalar versions of the same math and measures
+// how many ULPs their results are from a double precision reference, rounded to float. Build with
+// buildtype=release, the debug default times unoptimized code.
+//
+//  simd_math_bench [--count N] [--runs N]
+//
+// Every kernel has a tolerance and the bench exits with 1 if any result falls outside of it. A result
+// passes when it's within the kernel's ULPs of the reference, or when its absolute error is within a
+// bound relative to the sum of the absolute values of the terms that made it. Products summed by
+// mat4 * mat4, transforms, dot and cross cancel, so a result close to 0 can be many ULPs from the 
+// reference (millions for mat4 * mat4) while the error is still the few roundings float can promise
+// at the scale of its terms. Transpose is exact and normalize doesn't cancel, they only get ULPs.
+
+struct MdMathBenchOptions
+{
+    u32 count = 1 << 16;    // Elements per run
+    u32 runs  = 20;         // The fastest run is reported
+};
+
+struct MdBenchTolerance
+{
+    u64 ulp;
+    f64 relative;           // Of the sum of absolute terms, 0 leaves only the ULP bound
+};
+
+struct MdUlpStats
+{
+    MdBenchTolerance tolerance;
+    u64 max;
+    f64 mean;
+    u64 samples;
+    u64 failures;
+};
+
+// Roughly one rounding per term summed, with a couple to spare
+static const MdBenchTolerance tolerance_exact     = {0, 0.0};
+static const MdBenchTolerance tolerance_normalize = {4, 0.0};
+static const MdBenchTolerance tolerance_cross     = {4, 4.0 * FLT_EPSILON};
+static const MdBenchTolerance tolerance_sum4      = {4, 8.0 * FLT_EPSILON};
+
+// Deterministic inputs so runs compare across machines and commits
+static u32 rng_state = 0x2545F491u;
+static f32 mdBenchRandom()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (f32)((rng_state >> 8) * (1.0 / 16777216.0)) * 2.0f - 1.0f;
+}
+
+// Distance in representable floats, with the sign folded so -0 and +0 are the same value
+static u64 mdUlpDistance(f32 a, f32 b)
+{
+    if (isnan(a) || isnan(b))
+        return (isnan(a) && isnan(b)) ? 0 : UINT32_MAX;
+
+    i32 ia, ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    i64 la = (ia < 0) ? (i64)INT32_MIN - ia : ia;
+    i64 lb = (ib < 0) ? (i64)INT32_MIN - ib : ib;
+    return (u64)((la > lb) ? la - lb : lb - la);
+}
+
+// The magnitude is the reference computed over the absolute values of the terms
+static void mdUlpAccumulate(MdUlpStats &stats, f32 result, f64 reference, f64 magnitude = 0.0)
+{
+    u64 ulp = mdUlpDistance(result, (f32)reference);
+    stats.max = MAX_VAL(stats.max, ulp);
+    stats.mean += (f64)ulp;
+    stats.samples++;
+
+    if (ulp > stats.tolerance.ulp && !(fabs((f64)result - reference) <= stats.tolerance.relative * magnitude))
+        stats.failures++;
+}
+
+static void mdBenchAbs(const f32 *p_in, f32 *p_out, u32 n)
+{
+    for (u32 i=0; i<n; i++)
+        p_out[i] = fabsf(p_in[i]);
+}
+
+// Keeps the timed loops from being optimized out
+static volatile f32 bench_sink;
+
+template <typename F>
+static f64 mdBenchTime(u32 runs, u32 count, F kernel)
+{
+    f64 best = 1e30;
+    for (u32 r=0; r<runs; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        kernel();
+        f64 ns = std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = MIN_VAL(best, ns);
+    }
+    return best / (f64)count;
+}
+
+// Returns false if any result was outside the kernel's tolerance
+static bool mdBenchReport(const char *p_name, f64 simd_ns, f64 scalar_ns, MdUlpStats &ulp)
+{
+    printf(
+        "%-16s %10.3f %10.3f %8.2fx %10llu %10.3f %8llu%s\n",
+        p_name,
+        simd_ns,
+        scalar_ns,
+        scalar_ns / simd_ns,
+        (unsigned long long)ulp.max,
+        (ulp.samples > 0) ? ulp.mean / (f64)ulp.samples : 0.0,
+        (unsigned long long)ulp.failures,
+        (ulp.failures > 0) ? "  FAIL" : ""
+    );
+    return ulp.failures == 0;
+}
+
+#pragma region [ Scalar Reference ]
+// Column major like Matrix4x4, element (row, col) is at m[4*col + row]
+template <typename T>
+static void mdScalarMatMul(const f32 *p_a, const f32 *p_b, T *p_out)
+{
+    for (u32 c=0; c<4; c++)
+    {
+        for (u32 r=0; r<4; r++)
+        {
+            T sum = 0;
+            for (u32 k=0; k<4; k++)
+                sum += (T)p_a[4*k + r] * (T)p_b[4*c + k];
+            p_out[4*c + r] = sum;
+        }
+    }
+}
+
+template <typename T>
+static void mdScalarTransform(const f32 *p_m, const f32 *p_v, T *p_out)
+{
+    for (u32 r=0; r<4; r++)
+        p_out[r] = (T)p_m[r]*p_v[0] + (T)p_m[4 + r]*p_v[1] + (T)p_m[8 + r]*p_v[2] + (T)p_m[12 + r]*p_v[3];
+}
+
+template <typename T>
+static void mdScalarTranspose(const f32 *p_m, T *p_out)
+{
+    for (u32 c=0; c<4; c++)
+        for (u32 r=0; r<4; r++)
+            p_out[4*r + c] = p_m[4*c + r];
+}
+
+template <typename T>
+static T mdScalarDot(const f32 *p_a, const f32 *p_b)
+{
+    return (T)p_a[0]*p_b[0] + (T)p_a[1]*p_b[1] + (T)p_a[2]*p_b[2] + (T)p_a[3]*p_b[3];
+}
+
+template <typename T>
+static void mdScalarCross(const f32 *p_a, const f32 *p_b, T *p_out)
+{
+    p_out[0] = (T)p_a[1]*p_b[2] - (T)p_a[2]*p_b[1];
+    p_out[1] = (T)p_a[2]*p_b[0] - (T)p_a[0]*p_b[2];
+    p_out[2] = (T)p_a[0]*p_b[1] - (T)p_a[1]*p_b[0];
+    p_out[3] = 0;
+}
+
+template <typename T>
+static void mdScalarNormalize(const f32 *p_v, T *p_out)
+{
+    T inv_length = (T)1 / sqrt(mdScalarDot<T>(p_v, p_v));
+    for (u32 i=0; i<4; i++)
+        p_out[i] = p_v[i] * inv_length;
+}
+#pragma endregion
+
+static bool mdBenchParseArgs(int argc, char **argv, MdMathBenchOptions &options)
+{
+    for (int i=1; i + 1<argc; i+=2)
+    {
+        if (strcmp(argv[i], "--count") == 0)
+            options.count = (u32)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--runs") == 0)
+            options.runs = (u32)strtoul(argv[i + 1], NULL, 10);
+        else
+        {
+            LOG_ERROR("unknown option \"%s\"", argv[i]);
+            return false;
+        }
+    }
+
+    if ((argc - 1) % 2 != 0 || options.count == 0 || options.runs == 0)
+    {
+        LOG_ERROR("usage: simd_math_bench [--count N] [--runs N]");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    MdMathBenchOptions options;
+    if (!mdBenchParseArgs(argc, argv, options))
+        return -1;
+
+    u32 count = options.count;
+    std::vector<Matrix4x4> matrices_a(count), matrices_b(count), matrices_out(count);
+    std::vector<Vector4> vectors_a(count), vectors_b(count), vectors_out(count);
+    std::vector<f32> scalars_out(count);
+    std::vector<f32> scalar_out(16 * (usize)count);
+
+    for (u32 i=0; i<count; i++)
+    {
+        for (u32 j=0; j<16; j++)
+        {
+            matrices_a[i].ij[j] = mdBenchRandom();
+            matrices_b[i].ij[j] = mdBenchRandom();
+        }
+        // Through the member, Vector4's own copy assignment calls itself
+        vectors_a[i].xyzw_m128 = _mm_set_ps(mdBenchRandom(), mdBenchRandom(), mdBenchRandom(), mdBenchRandom());
+        vectors_b[i].xyzw_m128 = _mm_set_ps(mdBenchRandom(), mdBenchRandom(), mdBenchRandom(), mdBenchRandom());
+    }
+
+    printf("%u elements, fastest of %u runs\n\n", count, options.runs);
+    printf("%-16s %10s %10s %9s %10s %10s %8s\n", "kernel", "simd ns", "scalar ns", "speedup", "max ulp", "mean ulp", "failed");
+    bool passed = true;
+
+    // Matrix multiply
+    {
+        f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                matrices_out[i] = matrices_a[i] * matrices_b[i];
+            bench_sink = matrices_out[count - 1].ij[0];
+        });
+        f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                mdScalarMatMul<f32>(matrices_a[i].ij, matrices_b[i].ij, &scalar_out[16 * (usize)i]);
+            bench_sink = scalar_out[0];
+        });
+
+        MdUlpStats ulp = {};
+        ulp.tolerance = tolerance_sum4;
+        f64 reference[16], magnitude[16];
+        f32 abs_a[16], abs_b[16];
+        for (u32 i=0; i<count; i++)
+        {
+            mdScalarMatMul<f64>(matrices_a[i].ij, matrices_b[i].ij, reference);
+            mdBenchAbs(matrices_a[i].ij, abs_a, 16);
+            mdBenchAbs(matrices_b[i].ij, abs_b, 16);
+            mdScalarMatMul<f64>(abs_a, abs_b, magnitude);
+            for (u32 j=0; j<16; j++)
+                mdUlpAccumulate(ulp, matrices_out[i].ij[j], reference[j], magnitude[j]);
+        }
+        passed &= mdBenchReport("mat4 * mat4", simd_ns, scalar_ns, ulp);
+    }
+
+    // Transforming an array of points by one matrix
+    {
+        Matrix4x4 m = matrices_a[0];
+        f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                vectors_out[i].xyzw_m128 = (m * vectors_a[i].xyzw_m128).xyzw_m128;
+            bench_sink = vectors_out[count - 1].xyzw[0];
+        });
+        f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                mdScalarTransform<f32>(m.ij, vectors_a[i].xyzw, &scalar_out[4 * (usize)i]);
+            bench_sink = scalar_out[0];
+        });
+
+        MdUlpStats ulp = {};
+        ulp.tolerance = tolerance_sum4;
+        f64 reference[4], magnitude[4];
+        f32 abs_m[16], abs_v[4];
+        mdBenchAbs(m.ij, abs_m, 16);
+        for (u32 i=0; i<count; i++)
+        {
+            mdScalarTransform<f64>(m.ij, vectors_a[i].xyzw, reference);
+            mdBenchAbs(vectors_a[i].xyzw, abs_v, 4);
+            mdScalarTransform<f64>(abs_m, abs_v, magnitude);
+            for (u32 j=0; j<4; j++)
+                mdUlpAccumulate(ulp, vectors_out[i].xyzw[j], reference[j], magnitude[j]);
+        }
+        passed &= mdBenchReport("mat4 * points", simd_ns, scalar_ns, ulp);
+    }
+
+    // Transpose
+    {
+        f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                matrices_out[i] = Matrix4x4::Transpose(matrices_a[i]);
+            bench_sink = matrices_out[count - 1].ij[1];
+        });
+        f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                mdScalarTranspose<f32>(matrices_a[i].ij, &scalar_out[16 * (usize)i]);
+            bench_sink = scalar_out[1];
+        });
+
+        MdUlpStats ulp = {};
+        ulp.tolerance = tolerance_exact;
+        f64 reference[16];
+        for (u32 i=0; i<count; i++)
+        {
+            mdScalarTranspose<f64>(matrices_a[i].ij, reference);
+            for (u32 j=0; j<16; j++)
+                mdUlpAccumulate(ulp, matrices_out[i].ij[j], reference[j]);
+        }
+        passed &= mdBenchReport("transpose", simd_ns, scalar_ns, ulp);
+    }
+
+    // Normalize
+    {
+        f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                vectors_out[i] = Vector4::Normalize(vectors_a[i].xyzw_m128);
+            bench_sink = vectors_out[count - 1].xyzw[0];
+        });
+        f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                mdScalarNormalize<f32>(vectors_a[i].xyzw, &scalar_out[4 * (usize)i]);
+            bench_sink = scalar_out[0];
+        });
+
+        MdUlpStats ulp = {};
+        ulp.tolerance = tolerance_normalize;
+        f64 reference[4];
+        for (u32 i=0; i<count; i++)
+        {
+            mdScalarNormalize<f64>(vectors_a[i].xyzw, reference);
+            for (u32 j=0; j<4; j++)
+                mdUlpAccumulate(ulp, vectors_out[i].xyzw[j], reference[j]);
+        }
+        passed &= mdBenchReport("normalize", simd_ns, scalar_ns, ulp);
+    }
+
+    // Cross, only xyz is compared, w is 0 in both
+    {
+        f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                vectors_out[i] = Vector4::Cross(vectors_a[i].xyzw_m128, vectors_b[i].xyzw_m128);
+            bench_sink = vectors_out[count - 1].xyzw[0];
+        });
+        f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                mdScalarCross<f32>(vectors_a[i].xyzw, vectors_b[i].xyzw, &scalar_out[4 * (usize)i]);
+            bench_sink = scalar_out[0];
+        });
+
+        MdUlpStats ulp = {};
+        ulp.tolerance = tolerance_cross;
+        f64 reference[4];
+        for (u32 i=0; i<count; i++)
+        {
+            const f32 *a = vectors_a[i].xyzw, *b = vectors_b[i].xyzw;
+            mdScalarCross<f64>(a, b, reference);
+            for (u32 j=0; j<3; j++)
+            {
+                u32 j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+                f64 magnitude = fabs((f64)a[j1]*b[j2]) + fabs((f64)a[j2]*b[j1]);
+                mdUlpAccumulate(ulp, vectors_out[i].xyzw[j], reference[j], magnitude);
+            }
+        }
+        passed &= mdBenchReport("cross", simd_ns, scalar_ns, ulp);
+    }
+
+    // Dot
+    {
+        f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                scalars_out[i] = Vector4::Dot(vectors_a[i].xyzw_m128, vectors_b[i].xyzw_m128);
+            bench_sink = scalars_out[count - 1];
+        });
+        f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+            for (u32 i=0; i<count; i++)
+                scalar_out[i] = mdScalarDot<f32>(vectors_a[i].xyzw, vectors_b[i].xyzw);
+            bench_sink = scalar_out[0];
+        });
+
+        MdUlpStats ulp = {};
+        ulp.tolerance = tolerance_sum4;
+        f32 abs_a[4], abs_b[4];
+        for (u32 i=0; i<count; i++)
+        {
+            mdBenchAbs(vectors_a[i].xyzw, abs_a, 4);
+            mdBenchAbs(vectors_b[i].xyzw, abs_b, 4);
+            mdUlpAccumulate(
+                ulp, 
+                scalars_out[i], 
+                mdScalarDot<f64>(vectors_a[i].xyzw, vectors_b[i].xyzw), 
+                mdScalarDot<f64>(abs_a, abs_b)
+            );
+        }
+        passed &= mdBenchReport("dot", simd_ns, scalar_ns, ulp);
+    }
+
+    // Batch kernels on every level this CPU supports, the scalar column is the same reference as 
+    // above and the speedup is against it
+    std::vector<f32> soa_in(4 * (usize)count), soa_out(4 * (usize)count);
+    MdVector4SoA in  = {&soa_in[0],  &soa_in[count],  &soa_in[2 * (usize)count],  &soa_in[3 * (usize)count]};
+    MdVector4SoA out = {&soa_out[0], &soa_out[count], &soa_out[2 * (usize)count], &soa_out[3 * (usize)count]};
+    for (u32 i=0; i<count; i++)
+    {
+        in.x[i] = vectors_a[i].xyzw[0];
+        in.y[i] = vectors_a[i].xyzw[1];
+        in.z[i] = vectors_a[i].xyzw[2];
+        in.w[i] = vectors_a[i].xyzw[3];
+    }
+
+    MdSimdLevel best_level = mdGetSimdLevel();
+    for (u32 l=MD_SIMD_SSE; l<=(u32)best_level; l++)
+    {
+        MdSimdLevel level = mdSetSimdLevel((MdSimdLevel)l);
+        char name[32];
+        printf("\n");
+
+        // Transform
+        {
+            Matrix4x4 m = matrices_a[0];
+            f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+                mdTransformPoints(m, in, out, count);
+                bench_sink = out.x[count - 1];
+            });
+            f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+                for (u32 i=0; i<count; i++)
+                    mdScalarTransform<f32>(m.ij, vectors_a[i].xyzw, &scalar_out[4 * (usize)i]);
+                bench_sink = scalar_out[0];
+            });
+
+            MdUlpStats ulp = {};
+            ulp.tolerance = tolerance_sum4;
+            f64 reference[4], magnitude[4];
+            f32 abs_m[16], abs_v[4];
+            mdBenchAbs(m.ij, abs_m, 16);
+            for (u32 i=0; i<count; i++)
+            {
+                mdScalarTransform<f64>(m.ij, vectors_a[i].xyzw, reference);
+                mdBenchAbs(vectors_a[i].xyzw, abs_v, 4);
+                mdScalarTransform<f64>(abs_m, abs_v, magnitude);
+                mdUlpAccumulate(ulp, out.x[i], reference[0], magnitude[0]);
+                mdUlpAccumulate(ulp, out.y[i], reference[1], magnitude[1]);
+                mdUlpAccumulate(ulp, out.z[i], reference[2], magnitude[2]);
+                mdUlpAccumulate(ulp, out.w[i], reference[3], magnitude[3]);
+            }
+            snprintf(name, sizeof(name), "transform %s", mdGetSimdLevelName(level));
+            passed &= mdBenchReport(name, simd_ns, scalar_ns, ulp);
+        }
+
+        // Matrix multiply
+        {
+            f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+                mdMultiplyMatrices(matrices_a.data(), matrices_b.data(), matrices_out.data(), count);
+                bench_sink = matrices_out[count - 1].ij[0];
+            });
+            f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+                for (u32 i=0; i<count; i++)
+                    mdScalarMatMul<f32>(matrices_a[i].ij, matrices_b[i].ij, &scalar_out[16 * (usize)i]);
+                bench_sink = scalar_out[0];
+            });
+
+            MdUlpStats ulp = {};
+            ulp.tolerance = tolerance_sum4;
+            f64 reference[16], magnitude[16];
+            f32 abs_a[16], abs_b[16];
+            for (u32 i=0; i<count; i++)
+            {
+                mdScalarMatMul<f64>(matrices_a[i].ij, matrices_b[i].ij, reference);
+                mdBenchAbs(matrices_a[i].ij, abs_a, 16);
+                mdBenchAbs(matrices_b[i].ij, abs_b, 16);
+                mdScalarMatMul<f64>(abs_a, abs_b, magnitude);
+                for (u32 j=0; j<16; j++)
+                    mdUlpAccumulate(ulp, matrices_out[i].ij[j], reference[j], magnitude[j]);
+            }
+            snprintf(name, sizeof(name), "mat4 mul %s", mdGetSimdLevelName(level));
+            passed &= mdBenchReport(name, simd_ns, scalar_ns, ulp);
+        }
+
+        // Normalize, xyz only so the reference has w = 0
+        {
+            f64 simd_ns = mdBenchTime(options.runs, count, [&]() {
+                mdNormalizeVectors(in, out, count);
+                bench_sink = out.x[count - 1];
+            });
+            f64 scalar_ns = mdBenchTime(options.runs, count, [&]() {
+                for (u32 i=0; i<count; i++)
+                    mdScalarNormalize<f32>(vectors_a[i].xyzw, &scalar_out[4 * (usize)i]);
+                bench_sink = scalar_out[0];
+            });
+
+            MdUlpStats ulp = {};
+            ulp.tolerance = tolerance_normalize;
+            f64 reference[4];
+            for (u32 i=0; i<count; i++)
+            {
+                f32 v[4] = {in.x[i], in.y[i], in.z[i], 0.0f};
+                mdScalarNormalize<f64>(v, reference);
+                mdUlpAccumulate(ulp, out.x[i], reference[0]);
+                mdUlpAccumulate(ulp, out.y[i], reference[1]);
+                mdUlpAccumulate(ulp, out.z[i], reference[2]);
+            }
+            snprintf(name, sizeof(name), "normalize %s", mdGetSimdLevelName(level));
+            passed &= mdBenchReport(name, simd_ns, scalar_ns, ulp);
+        }
+    }
+
+    if (!passed)
+    {
+        LOG_ERROR("results outside of the kernel tolerances");
+        return 1;
+    }
+    return 0;
+}
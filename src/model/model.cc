@@ -0,0 +1,240 @@
+#define MD_USE_VULKAN
+#include <model/model.h>
+#include <profiler/profiler.h>
+#include <simd_math/simd_math.h>
+#include <stb_image_usage.h>
+
+#include <stdlib.h>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#pragma region [ OBJ Models ]
+MdResult mdLoadOBJ(const char *p_filepath, float **pp_vertices, usize *p_size)
+{
+    MD_PROFILE_SCOPE("mdLoadOBJ");
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+
+    std::string warning, error;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, p_filepath))
+    {
+        LOG_ERROR("failed to load obj file: %s %s\n", warning.c_str(), error.c_str());
+        return MD_ERROR_OBJ_LOADING_FAILURE;
+    }
+
+    // Get vertex count (index count)
+    u64 vtx_count = 0;
+    for (usize si=0; si<shapes.size(); si++)
+        for (usize i=0; i<shapes[si].mesh.num_face_vertices.size(); i++)
+            vtx_count += shapes[si].mesh.num_face_vertices[i];
+    
+    printf("Vertex count: %zu\n", vtx_count);
+
+    float *verts = (float*)malloc(vtx_count*VERTEX_SIZE*sizeof(float));
+    if (verts == NULL)
+    {
+        LOG_ERROR("failed to allocate memory for vertices");
+        return MD_ERROR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    // Loop over all materials
+    for (usize mi=0; mi<materials.size(); mi++)
+        printf("Texture for material[%zu]: %s\n", mi, materials[mi].diffuse_texname.c_str());
+
+    // Loop over all vertices of all faces of all shapes in the mesh
+    u64 vertex_index = 0;
+    for (usize si=0; si<shapes.size(); si++)
+    {
+        // Index offset is incremented by the number of verts in a face
+        usize index_offset = 0;
+        for (usize f=0; f<shapes[si].mesh.num_face_vertices.size(); f++)
+        {
+            // Get number of verts for the given face
+            size_t fv = shapes[si].mesh.num_face_vertices[f];
+            bool estimate_normals = false;            
+
+            // Load vertex data
+            for (usize v=0; v<fv; v++)
+            {
+                // Get the list of indices for the given face
+                tinyobj::index_t idx = shapes[si].mesh.indices[index_offset + v];
+                
+                // Vertex positions
+                verts[(vertex_index+v)*VERTEX_SIZE + 0] = attrib.vertices[3*((usize)idx.vertex_index)+0];
+                verts[(vertex_index+v)*VERTEX_SIZE + 1] = attrib.vertices[3*((usize)idx.vertex_index)+1];
+                verts[(vertex_index+v)*VERTEX_SIZE + 2] = attrib.vertices[3*((usize)idx.vertex_index)+2];
+
+                // Normals
+                if (idx.normal_index >= 0)
+                {
+                    verts[(vertex_index+v)*VERTEX_SIZE + 3] = attrib.normals[3*((usize)idx.normal_index)+0];
+                    verts[(vertex_index+v)*VERTEX_SIZE + 4] = attrib.normals[3*((usize)idx.normal_index)+1];
+                    verts[(vertex_index+v)*VERTEX_SIZE + 5] = attrib.normals[3*((usize)idx.normal_index)+2];
+                }
+                else estimate_normals = true;
+
+                // Texcoords
+                if (idx.texcoord_index >= 0)
+                {
+                    verts[(vertex_index+v)*VERTEX_SIZE + 6] = attrib.texcoords[2*(usize)idx.texcoord_index+0];
+                    verts[(vertex_index+v)*VERTEX_SIZE + 7] = attrib.texcoords[2*(usize)idx.texcoord_index+1];
+                }
+                else
+                {
+                    verts[(vertex_index+v)*VERTEX_SIZE + 6] = 0;
+                    verts[(vertex_index+v)*VERTEX_SIZE + 7] = 0;
+                }
+            }
+
+            // Calculate normals using cross product between face edges
+            if (estimate_normals)
+            {
+                // Get edges
+                Vector4 edge0(
+                    verts[(vertex_index+1)*VERTEX_SIZE + 0]-verts[(vertex_index+0)*VERTEX_SIZE + 0],
+                    verts[(vertex_index+1)*VERTEX_SIZE + 1]-verts[(vertex_index+0)*VERTEX_SIZE + 1],
+                    verts[(vertex_index+1)*VERTEX_SIZE + 2]-verts[(vertex_index+0)*VERTEX_SIZE + 2],
+                    0
+                );
+                Vector4 edge1(
+                    verts[(vertex_index+2)*VERTEX_SIZE + 0]-verts[(vertex_index+0)*VERTEX_SIZE + 0],
+                    verts[(vertex_index+2)*VERTEX_SIZE + 1]-verts[(vertex_index+0)*VERTEX_SIZE + 1],
+                    verts[(vertex_index+2)*VERTEX_SIZE + 2]-verts[(vertex_index+0)*VERTEX_SIZE + 2],
+                    0
+                );
+                Vector4 n = Vector4::Cross(edge0, edge1);
+                
+                for (usize v=0; v<fv; v++)
+                {
+                    verts[(vertex_index+v)*VERTEX_SIZE + 3] = n.xyzw[0];
+                    verts[(vertex_index+v)*VERTEX_SIZE + 4] = n.xyzw[1];
+                    verts[(vertex_index+v)*VERTEX_SIZE + 5] = n.xyzw[2];
+                }
+            }
+
+            vertex_index += fv;
+            index_offset += fv;
+        }
+    }
+
+    *pp_vertices = verts;
+    *p_size = vtx_count;
+
+    return MD_SUCCESS;
+}
+
+MdResult mdLoadTextureFromPath(MdRenderer &renderer, const std::string& path, MdGPUTexture &texture, MdGPUTextureBuilder &tex_builder)
+{
+    MdRenderState *p_renderer_state;
+    mdGetRenderState(&p_renderer_state);
+
+    int w = 0, h = 0, bpp = 0;
+    stbi_uc *img = stbi_load(path.c_str(), &w, &h, &bpp, 4);
+    if (img == NULL)
+    {
+        LOG_ERROR("failed to load image");
+        return MD_ERROR_UNKNOWN;
+    }
+    
+    u64 size = w*h*bpp;
+    printf("image_size: %zu\n", size);
+    
+    mdCreateTextureBuilder2D(tex_builder, w, h, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, bpp);
+    mdSetTextureUsage(tex_builder, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+    mdSetFilterWrap(tex_builder, VK_SAMPLER_ADDRESS_MODE_REPEAT, VK_SAMPLER_ADDRESS_MODE_REPEAT, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+    mdSetMipmapOptions(tex_builder, VK_SAMPLER_MIPMAP_MODE_LINEAR);
+    mdSetMagFilters(tex_builder, VK_FILTER_LINEAR, VK_FILTER_LINEAR);
+    VkResult result = mdBuildTexture2D(*renderer.context, tex_builder, p_renderer_state->allocator, texture, img);
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("failed to build texture");
+        free(img);
+        return MD_ERROR_UNKNOWN;
+    }
+
+    free(img);
+    return MD_SUCCESS;
+}
+
+MdResult mdLoadOBJFromPath(MdRenderer &renderer, const std::string& path, MdGPUBuffer &vertex_buffer, MdGPUBuffer &index_buffer, usize *geometry_size)
+{
+    MdRenderState *p_renderer_state;
+    mdGetRenderState(&p_renderer_state);
+
+    float *geometry;
+    mdLoadOBJ(path.c_str(), &geometry, geometry_size);
+
+    VkResult result = mdAllocateGPUBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
+        *geometry_size*VERTEX_SIZE*sizeof(f32), 
+        p_renderer_state->allocator, 
+        vertex_buffer
+    );
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("failed to allocate GPU memory for geometry");
+        free(geometry);
+        return MD_SUCCESS;
+    }
+
+    result = mdUploadToGPUBuffer(
+        *renderer.context, 
+        p_renderer_state->allocator, 
+        0, 
+        *geometry_size*VERTEX_SIZE*sizeof(f32),
+        geometry, 
+        vertex_buffer
+    );
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("failed to allocate GPU memory for geometry");
+        free(geometry);
+        return MD_SUCCESS;
+    }
+    
+    free(geometry);
+    return MD_SUCCESS;
+}
+
+MdResult mdLoadOBJModelFromPath(MdRenderer &renderer, const std::string& obj_path, MdModel &model, const std::string& tex_path)
+{
+    MdResult result = mdLoadOBJFromPath(
+        renderer, 
+        obj_path.c_str(), 
+        model.vertex_buffer, 
+        model.index_buffer, 
+        &model.geometry_size
+    );
+    if (result != MD_SUCCESS)
+    {
+        LOG_ERROR("failed to load model from path \"%s\"", obj_path.c_str());
+        return result;
+    }
+
+    if (tex_path == "")
+        return result;
+
+    result =  mdLoadTextureFromPath(renderer, tex_path, model.texture, model.texture_builder);
+    if (result != MD_SUCCESS)
+    {
+        LOG_ERROR("failed to load texture from path \"%s\"", tex_path.c_str());
+        mdDestroyModel(renderer, model);
+        return result;
+    }
+
+    return result;
+}
+
+void mdDestroyModel(MdRenderer &renderer, MdModel &model)
+{
+    MdRenderState *p_renderer_state;
+    mdGetRenderState(&p_renderer_state);
+
+    mdDestroyTexture(p_renderer_state->allocator, model.texture);
+    mdFreeGPUBuffer(p_renderer_state->allocator, model.vertex_buffer);
+    mdFreeGPUBuffer(p_renderer_state->allocator, model.index_buffer);
+}
+#pragma endregion
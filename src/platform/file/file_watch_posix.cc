@@ -0,0 +1,113 @@
+#include <file/file_watch.h>
+#include <typedefs.h>
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include <algorithm>
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+struct MdFileWatchDescriptor
+{
+    int fd;
+    int wd;
+};
+
+MdResult mdCreateFileWatch(const char *p_directory, MdFileWatch &watch)
+{
+    watch.p_descriptor = NULL;
+
+    char path[PATH_MAX];
+    if (realpath(p_directory, path) == NULL)
+    {
+        LOG_ERROR("failed to resolve \"%s\": %s", p_directory, strerror(errno));
+        return MD_ERROR_FILE_NOT_FOUND;
+    }
+    watch.directory = path;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("failed to create inotify instance: %s", strerror(errno));
+        return MD_ERROR_FILE_WATCH_FAILURE;
+    }
+
+    // Editors either write in place or write a temporary and rename it over the original
+    int wd = inotify_add_watch(fd, path, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+    {
+        LOG_ERROR("failed to watch \"%s\": %s", path, strerror(errno));
+        close(fd);
+        return MD_ERROR_FILE_WATCH_FAILURE;
+    }
+
+    watch.p_descriptor = (MdFileWatchDescriptor*)malloc(sizeof(MdFileWatchDescriptor));
+    watch.p_descriptor->fd = fd;
+    watch.p_descriptor->wd = wd;
+    return MD_SUCCESS;
+}
+
+MdResult mdWaitFileWatch(   MdFileWatch &watch, 
+                            u32 timeout_ms, 
+                            std::vector<std::string> &changed)
+{
+    if (watch.p_descriptor == NULL)
+        return MD_ERROR_FILE_WATCH_FAILURE;
+
+    pollfd pfd = {};
+    pfd.fd = watch.p_descriptor->fd;
+    pfd.events = POLLIN;
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR)
+    {
+        LOG_ERROR("failed to poll file watch: %s", strerror(errno));
+        return MD_ERROR_FILE_WATCH_FAILURE;
+    }
+    if (ready <= 0)
+        return MD_SUCCESS;
+
+    alignas(inotify_event) char buffer[4096];
+    for (;;)
+    {
+        ssize len = read(watch.p_descriptor->fd, buffer, sizeof(buffer));
+        if (len <= 0)
+        {
+            if (len < 0 && errno != EAGAIN)
+            {
+                LOG_ERROR("failed to read file watch events: %s", strerror(errno));
+                return MD_ERROR_FILE_WATCH_FAILURE;
+            }
+            break;
+        }
+
+        for (char *p=buffer; p<buffer + len;)
+        {
+            inotify_event *p_event = (inotify_event*)p;
+            p += sizeof(inotify_event) + p_event->len;
+            if (p_event->len == 0 || (p_event->mask & IN_ISDIR))
+                continue;
+
+            std::string path = watch.directory + "/" + p_event->name;
+            if (std::find(changed.begin(), changed.end(), path) == changed.end())
+                changed.push_back(path);
+        }
+    }
+
+    return MD_SUCCESS;
+}
+
+void mdDestroyFileWatch(MdFileWatch &watch)
+{
+    if (watch.p_descriptor != NULL)
+    {
+        inotify_rm_watch(watch.p_descriptor->fd, watch.p_descriptor->wd);
+        close(watch.p_descriptor->fd);
+        free(watch.p_descriptor);
+        watch.p_descriptor = NULL;
+    }
+}
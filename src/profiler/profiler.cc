@@ -0,0 +1,126 @@
+#include <profiler/profiler.h>
+
+#ifdef MD_PROFILER
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+struct MdProfiler
+{
+    std::mutex lock;
+    std::vector<MdProfilerThread*> threads;
+
+    // Tick and steady clock reference points, ticks are converted to microseconds from these
+    u64 start_ticks = 0;
+    i64 start_ns = 0;
+};
+MdProfiler profiler;
+
+thread_local MdProfilerThread *p_profiler_thread = NULL;
+
+i64 mdProfilerNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+MdProfilerThread *mdProfilerRegisterThread()
+{
+    // Rings outlive their threads, so traces still have the scopes of threads that exited
+    MdProfilerThread *p_thread = new MdProfilerThread;
+    p_thread->head.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(profiler.lock);
+    if (profiler.threads.empty())
+    {
+        profiler.start_ticks = mdProfilerTicks();
+        profiler.start_ns = mdProfilerNow();
+    }
+    p_thread->id = profiler.threads.size();
+    profiler.threads.push_back(p_thread);
+
+    p_profiler_thread = p_thread;
+    return p_thread;
+}
+
+void mdProfilerWriteName(FILE *p_file, const char *p_name)
+{
+    for (const char *c=p_name; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', p_file);
+        if ((u8)*c >= 0x20)
+            fputc(*c, p_file);
+    }
+}
+
+MdResult mdProfilerExportChromeTrace(const char *p_path)
+{
+    FILE *p_file = fopen(p_path, "w");
+    if (p_file == NULL)
+    {
+        LOG_ERROR("failed to open \"%s\" for writing", p_path);
+        return MD_ERROR_FILE_WRITE_FAILURE;
+    }
+
+    std::lock_guard<std::mutex> guard(profiler.lock);
+
+    // Scale ticks by how many passed over the steady clock since the first thread registered
+    f64 us_per_tick = 0.001;
+#ifdef MD_PROFILER_RDTSC
+    u64 ticks = mdProfilerTicks() - profiler.start_ticks;
+    i64 ns = mdProfilerNow() - profiler.start_ns;
+    if (ticks > 0)
+        us_per_tick = ((f64)ns / (f64)ticks) * 0.001;
+#endif
+
+    fprintf(p_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<MdProfileEvent> events(MD_PROFILER_RING_SIZE);
+    for (usize t=0; t<profiler.threads.size(); t++)
+    {
+        MdProfilerThread *p_thread = profiler.threads[t];
+        fprintf(
+            p_file, 
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}", 
+            first ? "" : ",\n", 
+            p_thread->id, 
+            p_thread->id
+        );
+        first = false;
+
+        u64 head = p_thread->head.load(std::memory_order_acquire);
+        u64 begin = (head > MD_PROFILER_RING_SIZE) ? head - MD_PROFILER_RING_SIZE : 0;
+        for (u64 i=begin; i<head; i++)
+            events[i - begin] = p_thread->events[i & (MD_PROFILER_RING_SIZE - 1)];
+
+        // Anything the thread wrote over while it was being copied is dropped, along with the slot
+        // it may be writing right now, which holds event end_head - MD_PROFILER_RING_SIZE
+        u64 end_head = p_thread->head.load(std::memory_order_acquire);
+        u64 valid = (end_head + 1 > MD_PROFILER_RING_SIZE) ? end_head + 1 - MD_PROFILER_RING_SIZE : 0;
+        for (u64 i=MAX_VAL(begin, valid); i<head; i++)
+        {
+            MdProfileEvent *p_event = &events[i - begin];
+            if (p_event->start < profiler.start_ticks)
+                continue;
+
+            fprintf(p_file, ",\n{\"name\":\"");
+            mdProfilerWriteName(p_file, p_event->p_name);
+            fprintf(
+                p_file, 
+                "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", 
+                p_thread->id, 
+                (f64)(p_event->start - profiler.start_ticks) * us_per_tick, 
+                (f64)(p_event->end - p_event->start) * us_per_tick
+            );
+        }
+    }
+    fprintf(p_file, "\n]}\n");
+    fclose(p_file);
+
+    return MD_SUCCESS;
+}
+
+#endif
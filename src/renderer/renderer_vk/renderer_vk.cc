@@ -6,13 +6,28 @@
 #define MD_USE_VULKAN
 #include <renderer.h>
 #include <platform/file/file.h>
+#include <platform/file/file_watch.h>
 #include <platform/window/window.h>
 #include <simd_math.h>
 
 #include <renderer_vk/renderer_vk_utils.h>
+#include <profiler/profiler.h>
 
 #include <vector>
 #include <map>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
 
 /*
 struct MdRenderState
@@ -48,7 +63,7 @@ void mdGetRenderState(MdRenderState **pp_state) { *pp_state = &renderer_state; }
 
 #pragma region [ Deletion Queue ]
 
-// TO-DO: Make this lock free somehow
+// Shutdown-only, everything destroyed while frames are in flight goes through the retire queue below
 struct MdDeletionQueue
 {
     std::vector<std::function<void()>> delete_items;
@@ -75,6 +90,233 @@ void mdRunDeletionQueue()
     }
 }
 
+// Bounded MPSC ring, producers claim a slot by bumping tail and publish it through the slot's sequence
+// number. The single consumer is mdCollectRetired on the render thread, which tags whatever was
+// retired since the last frame with the next graphics value to be signaled
+#define MD_RETIRE_QUEUE_SIZE 4096
+
+struct MdRetireSlot
+{
+    std::atomic<u64> sequence;
+    MdDeleter deleter;
+};
+
+struct MdRetiredDeleter
+{
+    u64 graphics_value;
+    u64 compute_value;
+    MdDeleter deleter;
+};
+
+struct MdRetireQueue
+{
+    MdRetireSlot slots[MD_RETIRE_QUEUE_SIZE];
+    alignas(64) std::atomic<u64> tail;
+    alignas(64) u64 head;
+
+    // Only taken when the ring is full, so a burst of retirements can't stall the producers
+    std::mutex overflow_lock;
+    std::vector<MdDeleter> overflow;
+    std::atomic<bool> has_overflow;
+
+    // Sorted by value, since the submitted values only grow
+    std::deque<MdRetiredDeleter> pending;
+    std::vector<MdDeleter> collected;
+
+    MdRetireQueue() : tail(0), head(0), has_overflow(false)
+    {
+        for (u64 i=0; i<MD_RETIRE_QUEUE_SIZE; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+};
+MdRetireQueue retire_queue;
+
+void mdRetire(MdDeleterFunc p_func, const void *p_payload, usize size)
+{
+    if (size > MD_DELETER_PAYLOAD_SIZE)
+    {
+        LOG_ERROR("deleter payload (%zu bytes) exceeds %d bytes", size, MD_DELETER_PAYLOAD_SIZE);
+        return;
+    }
+
+    u64 pos = retire_queue.tail.load(std::memory_order_relaxed);
+    MdRetireSlot *p_slot = NULL;
+    for (;;)
+    {
+        p_slot = &retire_queue.slots[pos & (MD_RETIRE_QUEUE_SIZE - 1)];
+        i64 diff = (i64)p_slot->sequence.load(std::memory_order_acquire) - (i64)pos;
+        if (diff == 0)
+        {
+            if (retire_queue.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Full, the consumer only drains once per frame
+            MdDeleter deleter = {p_func, {}};
+            memcpy(deleter.payload, p_payload, size);
+
+            std::lock_guard<std::mutex> guard(retire_queue.overflow_lock);
+            retire_queue.overflow.push_back(deleter);
+            retire_queue.has_overflow.store(true, std::memory_order_release);
+            return;
+        }
+        else pos = retire_queue.tail.load(std::memory_order_relaxed);
+    }
+
+    p_slot->deleter.p_func = p_func;
+    memcpy(p_slot->deleter.payload, p_payload, size);
+    p_slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void mdDrainRetireQueue(std::vector<MdDeleter> &dst)
+{
+    for (;;)
+    {
+        MdRetireSlot *p_slot = &retire_queue.slots[retire_queue.head & (MD_RETIRE_QUEUE_SIZE - 1)];
+        if (p_slot->sequence.load(std::memory_order_acquire) != retire_queue.head + 1)
+            break;
+
+        dst.push_back(p_slot->deleter);
+        p_slot->sequence.store(retire_queue.head + MD_RETIRE_QUEUE_SIZE, std::memory_order_release);
+        retire_queue.head++;
+    }
+
+    if (retire_queue.has_overflow.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> guard(retire_queue.overflow_lock);
+        dst.insert(dst.end(), retire_queue.overflow.begin(), retire_queue.overflow.end());
+        retire_queue.overflow.clear();
+        retire_queue.has_overflow.store(false, std::memory_order_relaxed);
+    }
+}
+
+void mdRunDeleters(std::vector<MdDeleter> &deleters)
+{
+    for (usize i=0; i<deleters.size(); i++)
+        deleters[i].p_func(deleters[i].payload);
+    deleters.clear();
+}
+
+void mdCollectRetired()
+{
+    // Retired objects can still be in use by the frame about to be recorded, or by a present that
+    // isn't on the timeline, so they wait for the next graphics value rather than the last one. The 
+    // last submitted value is often already complete by now. Compute is only submitted on demand, so 
+    // a value it hasn't handed out yet might never be signaled
+    MdTimeline *p_graphics = &renderer_state.graphics_timeline;
+    MdTimeline *p_compute = &renderer_state.compute_timeline;
+    u64 graphics_value = p_graphics->submitted + 1;
+    u64 compute_value = p_compute->submitted;
+
+    mdDrainRetireQueue(retire_queue.collected);
+    for (usize i=0; i<retire_queue.collected.size(); i++)
+        retire_queue.pending.push_back({graphics_value, compute_value, retire_queue.collected[i]});
+    retire_queue.collected.clear();
+
+    while (!retire_queue.pending.empty())
+    {
+        MdRetiredDeleter *p_retired = &retire_queue.pending.front();
+        bool complete = mdTimelineIsComplete(*p_graphics, p_retired->graphics_value) && 
+            mdTimelineIsComplete(*p_compute, p_retired->compute_value);
+        if (!complete)
+            break;
+        
+        p_retired->deleter.p_func(p_retired->deleter.payload);
+        retire_queue.pending.pop_front();
+    }
+
+    mdReleaseUploads(renderer_state.allocator);
+}
+
+void mdFlushRetired()
+{
+    while (!retire_queue.pending.empty())
+    {
+        MdDeleter *p_deleter = &retire_queue.pending.front().deleter;
+        p_deleter->p_func(p_deleter->payload);
+        retire_queue.pending.pop_front();
+    }
+
+    std::vector<MdDeleter> pending;
+    mdDrainRetireQueue(pending);
+    mdRunDeleters(pending);
+}
+
+void mdRetireBuffer(MdGPUBuffer &buffer)
+{
+    struct Payload { VmaAllocation allocation; VkBuffer buffer; };
+    Payload payload = {buffer.allocation, buffer.buffer};
+    mdRetire([](void *p_payload){
+        Payload *p = (Payload*)p_payload;
+        mdUntrackAllocation(renderer_state.allocator, p->allocation);
+        vmaDestroyBuffer(renderer_state.allocator.allocator, p->buffer, p->allocation);
+    }, &payload, sizeof(payload));
+
+    buffer.buffer = VK_NULL_HANDLE;
+    buffer.allocation = VK_NULL_HANDLE;
+}
+
+void mdRetireTexture(MdGPUTexture &texture, bool attachment)
+{
+    struct Payload { VmaAllocation allocation; VkImage image; VkImageView view; VkSampler sampler; bool attachment; };
+    Payload payload = {texture.allocation, texture.image, texture.image_view, texture.sampler, attachment};
+    mdRetire([](void *p_payload){
+        Payload *p = (Payload*)p_payload;
+        MdGPUAllocator *p_allocator = &renderer_state.allocator;
+        if (p->sampler != VK_NULL_HANDLE)
+            vkDestroySampler(p_allocator->device, p->sampler, NULL);
+        if (p->view != VK_NULL_HANDLE)
+            vkDestroyImageView(p_allocator->device, p->view, NULL);
+
+        // Attachments are created with their memory bound separately
+        mdUntrackAllocation(*p_allocator, p->allocation);
+        if (p->attachment)
+        {
+            if (p->image != VK_NULL_HANDLE)
+                vkDestroyImage(p_allocator->device, p->image, NULL);
+            vmaFreeMemory(p_allocator->allocator, p->allocation);
+        }
+        else vmaDestroyImage(p_allocator->allocator, p->image, p->allocation);
+    }, &payload, sizeof(payload));
+
+    texture.allocation = VK_NULL_HANDLE;
+    texture.image = VK_NULL_HANDLE;
+    texture.image_view = VK_NULL_HANDLE;
+    texture.sampler = VK_NULL_HANDLE;
+}
+
+void mdRetireImageView(VkImageView view)
+{
+    mdRetire([](void *p_payload){
+        vkDestroyImageView(renderer_state.allocator.device, *(VkImageView*)p_payload, NULL);
+    }, &view, sizeof(view));
+}
+
+void mdRetireFramebuffer(VkFramebuffer framebuffer)
+{
+    mdRetire([](void *p_payload){
+        vkDestroyFramebuffer(renderer_state.allocator.device, *(VkFramebuffer*)p_payload, NULL);
+    }, &framebuffer, sizeof(framebuffer));
+}
+
+void mdRetireSwapchain(VkSwapchainKHR swapchain)
+{
+    mdRetire([](void *p_payload){
+        vkDestroySwapchainKHR(renderer_state.allocator.device, *(VkSwapchainKHR*)p_payload, NULL);
+    }, &swapchain, sizeof(swapchain));
+}
+
+void mdRetirePipelineVariant(MdRenderer &renderer, MdPipeline *p_pipeline)
+{
+    struct Payload { MdRenderer *p_renderer; MdPipeline *p_pipeline; };
+    Payload payload = {&renderer, p_pipeline};
+    mdRetire([](void *p_payload){
+        Payload *p = (Payload*)p_payload;
+        mdReleasePipelineVariant(*p->p_renderer, p->p_pipeline);
+    }, &payload, sizeof(payload));
+}
+
 #pragma endregion
 
 #pragma region [ Render Graph ]
@@ -111,6 +353,11 @@ struct MdRenderPassAttachment
 {
     bool swapchain_attachment = false;
     MdRenderPassAttachmentType  type;
+    MdRenderPassAttachmentSizeMode size_mode = MD_ATTACHMENT_SIZE_SWAPCHAIN_RELATIVE;
+    f32                         scale_x = 1.0f, 
+                                scale_y = 1.0f;
+    VkExtent2D                  extent = {0, 0};
+    u64                         generation = 0;
     MdGPUTextureBuilder         builder;
     MdGPUTexture                texture;
 };
@@ -128,6 +375,11 @@ struct MdRenderPassEntry
 
     VkRenderPass pass = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> framebuffers;
+    VkExtent2D extent = {0, 0};
+
+    // Attachment formats, needed by pipelines when using dynamic rendering
+    VkFormat color_format = VK_FORMAT_UNDEFINED;
+    VkFormat depth_format = VK_FORMAT_UNDEFINED;
 
     std::function<void(VkCommandBuffer, VkFramebuffer)> record = NULL;
 
@@ -135,8 +387,35 @@ struct MdRenderPassEntry
     std::vector<std::string> output_attachments;
     VkCommandBuffer buffer = VK_NULL_HANDLE;
 
+    // Subpass merging, local inputs are only read at the same pixel. A merged pass is 
+    // recorded as subpass 1 of its parent's render pass.
+    std::vector<std::string> local_inputs;
+    std::vector<std::string> pass_attachments;
+    u32 merged_parent = UINT32_MAX;
+    u32 merged_child = UINT32_MAX;
+    u32 subpass = 0;
+
+    // Clear values of a merged child's own outputs, its execute call is skipped so they're kept here
+    std::vector<VkClearValue> clear_values;
+
+    // Hash of the pass, extent and image views the framebuffers were made with
+    u64 framebuffer_hash = 0;
+
+    MdRenderPassQueue queue = MD_RENDER_PASS_QUEUE_GRAPHICS;
+    VkCommandPool buffer_pool = VK_NULL_HANDLE;
+
     VkPipelineStageFlags wait_stages = 0;
     //VkEvent render_event = VK_NULL_HANDLE;
+
+    // GPU time ring in milliseconds, head is where the next duration goes
+    std::array<f32, MD_GPU_TIMING_HISTORY> gpu_ms = {};
+    u32 gpu_ms_head = 0;
+    u32 gpu_ms_count = 0;
+
+    // Pipeline statistics of the last frame read back, and the sum over stats_frames frames
+    MdPipelineStatistics stats_last = {};
+    MdPipelineStatistics stats_total = {};
+    u32 stats_frames = 0;
 };
 
 struct MdRenderGraphNode
@@ -153,8 +432,8 @@ struct MdAdjacencyMatrix
     void SetBit(u32 i, u32 j, bool set);
 };
 
-bool MdAdjacencyMatrix::GetBit(u32 i, u32 j)            { return (matrix[j] & (1<<i)) != 0; }
-void MdAdjacencyMatrix::SetBit(u32 i, u32 j, bool set)  { matrix[j] = (set) ? (matrix[j] | (1<<i)) : (matrix[j] & ~(1<<i)); }
+bool MdAdjacencyMatrix::GetBit(u32 i, u32 j)            { return (matrix[j] & (1ull<<i)) != 0; }
+void MdAdjacencyMatrix::SetBit(u32 i, u32 j, bool set)  { matrix[j] = (set) ? (matrix[j] | (1ull<<i)) : (matrix[j] & ~(1ull<<i)); }
 
 struct MdRenderGraph
 {
@@ -169,7 +448,39 @@ struct MdRenderGraph
     VkDevice device;
     MdRenderContext *p_context;
 
+    // Reference extent for swapchain-relative attachments
+    VkExtent2D output_extent = {0, 0};
+
+    // Bumped on every swapchain rebuild, swapchain image view handles can be reused
+    u64 swapchain_generation = 0;
+    MdRenderGraphBackend backend = MD_RENDER_GRAPH_BACKEND_RENDER_PASS;
+
     VkCommandPool pool = VK_NULL_HANDLE;
+    VkCommandPool compute_pool = VK_NULL_HANDLE;
+
+    // Compile caching, passes with the same attachment signature share a VkRenderPass. Entries keep
+    // the whole signature, a hash collision must not hand out a pass with different attachments
+    u64 compiled_hash = 0;
+    std::map<u64, std::vector<std::pair<std::vector<u8>, VkRenderPass>>> render_pass_cache;
+
+    // Upload timeline value each queue has already waited on, graphics then compute
+    u64 upload_waited[2] = {0, 0};
+
+    // Advanced once per frame, picks the query pools the frame writes to
+    u64 query_frame = 0;
+
+    // GPU timestamps, one query pool per frame in flight with a begin and end query per pass slot
+    bool timestamps = false;
+    std::array<VkQueryPool, MD_FRAMES_IN_FLIGHT> query_pools = {};
+    std::array<u64, MD_FRAMES_IN_FLIGHT> query_written = {};
+    f64 timestamp_period = 0.0;
+    u32 graphics_timestamp_bits = 0;
+    u32 compute_timestamp_bits = 0;
+
+    // Pipeline statistics, one query per pass slot in a pool per frame in flight
+    bool statistics = false;
+    std::array<VkQueryPool, MD_FRAMES_IN_FLIGHT> stats_pools = {};
+    std::array<u64, MD_FRAMES_IN_FLIGHT> stats_written = {};
 };
 MdRenderGraph render_graph;
 
@@ -177,18 +488,38 @@ struct MdAttachmentList
 {
     std::map<std::string, MdRenderPassAttachmentBarrier> barriers; 
     std::map<std::string, MdRenderPassAttachment> attachments;
+
+    // Bumped whenever an attachment's image is recreated, image view handles can be reused
+    u64 generation = 0;
 };
 MdAttachmentList attachment_list;
 
+VkExtent2D mdGetAttachmentExtent(MdRenderPassAttachmentSizeMode mode, u32 w, u32 h, f32 scale_x, f32 scale_y)
+{
+    VkExtent2D extent = {w, h};
+    if (mode == MD_ATTACHMENT_SIZE_SWAPCHAIN_RELATIVE)
+    {
+        extent.width = (u32)((f32)render_graph.output_extent.width * scale_x);
+        extent.height = (u32)((f32)render_graph.output_extent.height * scale_y);
+    }
+
+    extent.width = MIN_VAL(MAX_VAL(extent.width, 1u), MAX_ATTACHMENT_WIDTH);
+    extent.height = MIN_VAL(MAX_VAL(extent.height, 1u), MAX_ATTACHMENT_HEIGHT);
+    return extent;
+}
+
 VkResult mdAddAttachment(const std::string &name, MdRenderPassAttachmentInfo &info)
 {
     MdRenderPassAttachment att = {};
     att.type = info.type;
     att.swapchain_attachment = info.is_swapchain;
+    att.size_mode = info.size_mode;
+    att.scale_x = info.scale_x;
+    att.scale_y = info.scale_y;
+    att.extent = mdGetAttachmentExtent(info.size_mode, info.width, info.height, info.scale_x, info.scale_y);
 
-    // TO-DO: make it so that the user can define their own resolution, rather than setting it to that of the swapchain
-    info.width = render_graph.p_context->swapchain.extent.width;
-    info.height = render_graph.p_context->swapchain.extent.height;
+    info.width = att.extent.width;
+    info.height = att.extent.height;
     
     // Check if we need to make a new attachment
     auto att_iter = attachment_list.attachments.find(name);
@@ -204,7 +535,33 @@ VkResult mdAddAttachment(const std::string &name, MdRenderPassAttachmentInfo &in
         dirty_texture = true;
         att_iter->second.builder = {};
         mdDestroyTexture(renderer_state.allocator, att_iter->second.texture);
+        att_iter->second.type = att.type;
+        att_iter->second.swapchain_attachment = att.swapchain_attachment;
+    }
+
+    // Same attachment at a different resolution, rebind the backing memory to a resized image
+    if (!dirty_texture && 
+        (att_iter->second.extent.width != att.extent.width || 
+         att_iter->second.extent.height != att.extent.height))
+    {
+        VkResult result = mdResizeAttachmentTexture(
+            *render_graph.p_context, 
+            att.extent.width, 
+            att.extent.height, 
+            att_iter->second.builder, 
+            renderer_state.allocator, 
+            att_iter->second.texture
+        );
+        VK_CHECK(result, "failed to resize attachment \"%s\"", name.c_str());
+
+        att_iter->second.texture.w = att.extent.width;
+        att_iter->second.texture.h = att.extent.height;
+        att_iter->second.generation = ++attachment_list.generation;
     }
+    att_iter->second.size_mode = att.size_mode;
+    att_iter->second.scale_x = att.scale_x;
+    att_iter->second.scale_y = att.scale_y;
+    att_iter->second.extent = att.extent;
 
     // If the texture is marked as 'dirty', make a new one
     if (dirty_texture)
@@ -226,7 +583,16 @@ VkResult mdAddAttachment(const std::string &name, MdRenderPassAttachmentInfo &in
                 mdSetTextureBorderColor(att_iter->second.builder, info.border_color);
                 result = mdBuildDepthAttachmentTexture2D(*render_graph.p_context, att_iter->second.builder, renderer_state.allocator, att_iter->second.texture);
                 break;
+            case MD_ATTACHMENT_TYPE_STORAGE:
+                mdCreateTextureBuilder2D(att_iter->second.builder, info.width, info.height, info.format, VK_IMAGE_ASPECT_COLOR_BIT);
+                mdSetTextureUsage(att_iter->second.builder, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+                mdSetFilterWrap(att_iter->second.builder, info.address[0], info.address[1], info.address[2]);
+                mdSetTextureBorderColor(att_iter->second.builder, info.border_color);
+                result = mdBuildColorAttachmentTexture2D(*render_graph.p_context, att_iter->second.builder, renderer_state.allocator, att_iter->second.texture);
+                break;
         }
+        VK_CHECK(result, "failed to build attachment \"%s\"", name.c_str());
+        att_iter->second.generation = ++attachment_list.generation;
     }
 
     return VK_SUCCESS;
@@ -288,37 +654,73 @@ void mdRenderGraphInit(MdRenderContext *p_context)
     }
     render_graph.p_context = p_context;
     render_graph.device = p_context->device;
+    render_graph.output_extent = p_context->swapchain.extent;
 }
 
+void mdRenderGraphClearFramebuffers();
+
 void mdRenderGraphDestroy()
 {
-    std::vector<VkCommandBuffer> buffers;
-    buffers.reserve(render_graph.compiled_count);
-    for (u32 i=0; i<render_graph.compiled_count; i++)
+    // Command buffers are freed along with their pools
+    if (render_graph.pool != VK_NULL_HANDLE)
+        vkDestroyCommandPool(render_graph.device, render_graph.pool, NULL);
+    if (render_graph.compute_pool != VK_NULL_HANDLE)
+        vkDestroyCommandPool(render_graph.device, render_graph.compute_pool, NULL);
+    render_graph.pool = VK_NULL_HANDLE;
+    render_graph.compute_pool = VK_NULL_HANDLE;
+    render_graph.build_buffers = true;
+
+    for (u32 i=0; i<render_graph.query_pools.size(); i++)
     {
-        u32 pass_index = render_graph.compiled_nodes[i].index;
-        buffers.push_back(render_graph.passes[pass_index].buffer);
+        if (render_graph.query_pools[i] != VK_NULL_HANDLE)
+            vkDestroyQueryPool(render_graph.device, render_graph.query_pools[i], NULL);
+        render_graph.query_pools[i] = VK_NULL_HANDLE;
+        render_graph.query_written[i] = 0;
     }
 
-    vkFreeCommandBuffers(
-        render_graph.device, 
-        render_graph.pool, 
-        buffers.size(), 
-        buffers.data()
-    );
-    vkDestroyCommandPool(render_graph.device, render_graph.pool, NULL);
+    for (u32 i=0; i<render_graph.stats_pools.size(); i++)
+    {
+        if (render_graph.stats_pools[i] != VK_NULL_HANDLE)
+            vkDestroyQueryPool(render_graph.device, render_graph.stats_pools[i], NULL);
+        render_graph.stats_pools[i] = VK_NULL_HANDLE;
+        render_graph.stats_written[i] = 0;
+    }
+
+    for (u32 i=0; i<render_graph.passes.size(); i++)
+    {
+        render_graph.passes[i].buffer = VK_NULL_HANDLE;
+        render_graph.passes[i].buffer_pool = VK_NULL_HANDLE;
+    }
 
+    mdRenderGraphClearFramebuffers();
     mdFlushAttachments();
     for (u32 i=0; i<render_graph.passes.size(); i++)
+        render_graph.passes[i].pass = VK_NULL_HANDLE;
+
+    for (auto it=render_graph.render_pass_cache.begin(); it!=render_graph.render_pass_cache.end(); it++)
+        for (usize i=0; i<it->second.size(); i++)
+            vkDestroyRenderPass(render_graph.device, it->second[i].second, NULL);
+    render_graph.render_pass_cache.clear();
+    render_graph.compiled_hash = 0;
+}
+
+VkResult mdRenderGraphSetBackend(MdRenderGraphBackend backend)
+{
+    if (backend == MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING && 
+        !render_graph.p_context->features_13.dynamicRendering)
     {
-        if (render_graph.passes[i].pass != VK_NULL_HANDLE)
-        {
-            vkDestroyRenderPass(render_graph.device, render_graph.passes[i].pass, NULL);
-            render_graph.passes[i].pass = VK_NULL_HANDLE;
-        }
+        LOG_ERROR("dynamic rendering is not supported by this device, using render passes");
+        render_graph.backend = MD_RENDER_GRAPH_BACKEND_RENDER_PASS;
+        return VK_ERROR_FEATURE_NOT_PRESENT;
     }
+
+    // Takes effect on the next call to mdBuildRenderGraph
+    render_graph.backend = backend;
+    return VK_SUCCESS;
 }
 
+MdRenderGraphBackend mdRenderGraphGetBackend() { return render_graph.backend; }
+
 void mdRenderGraphClear()
 {
     render_graph.node_count = 0;
@@ -358,6 +760,8 @@ void mdAddRenderPass(const std::string& id, bool is_swapchain)
         render_graph.passes[i].id = id;
         render_graph.passes[i].input_attachments.clear();
         render_graph.passes[i].output_attachments.clear();
+        render_graph.passes[i].local_inputs.clear();
+        render_graph.passes[i].queue = MD_RENDER_PASS_QUEUE_GRAPHICS;
         printf("added pass %s\n", id.c_str());
         render_graph.pass_count++;
 
@@ -368,6 +772,56 @@ void mdAddRenderPass(const std::string& id, bool is_swapchain)
     return;
 }
 
+void mdRemoveRenderPass(const std::string& id)
+{
+    u32 idx = mdFindRenderPass(id);
+    if (idx == UINT32_MAX)
+    {
+        LOG_ERROR("failed to find pass with id \"%s\"", id.c_str());
+        return;
+    }
+
+    // The slot is reused by the next mdAddRenderPass, its framebuffers are cleaned 
+    // up on the next call to mdBuildRenderGraph
+    render_graph.passes[idx].status = MD_NODE_AVAILABLE;
+    render_graph.passes[idx].record = NULL;
+    render_graph.pass_count--;
+}
+
+void mdSetRenderPassQueue(const std::string& id, MdRenderPassQueue queue)
+{
+    u32 idx = mdFindRenderPass(id);
+    if (idx == UINT32_MAX)
+    {
+        LOG_ERROR("failed to find pass with id \"%s\"", id.c_str());
+        return;
+    }
+
+    if (render_graph.passes[idx].is_swapchain_output && queue != MD_RENDER_PASS_QUEUE_GRAPHICS)
+    {
+        LOG_ERROR("swapchain pass \"%s\" must run on the graphics queue", id.c_str());
+        return;
+    }
+
+    // Takes effect on the next call to mdBuildRenderGraph
+    render_graph.passes[idx].queue = queue;
+}
+
+// Headless contexts have nothing to present to, their output is left ready to be copied out
+VkImageLayout mdRenderGraphOutputLayout()
+{
+    return (render_graph.p_context->surface != VK_NULL_HANDLE) 
+        ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR 
+        : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
+u32 mdRenderGraphGetPassFamily(u32 pass_index)
+{
+    return (render_graph.passes[pass_index].queue == MD_RENDER_PASS_QUEUE_ASYNC_COMPUTE)
+        ? renderer_state.compute_queue.queue_index
+        : renderer_state.graphics_queue.queue_index;
+}
+
 VkResult mdAddRenderPassInput(  const std::string& id, 
                                 const std::string& input, 
                                 MdRenderPassAttachmentInfo &info)
@@ -494,6 +948,56 @@ VkResult mdAddRenderPassOutput( const std::string& id,
     return VK_SUCCESS;
 }
 
+VkResult mdAddRenderPassLocalInput(const std::string& id, const std::string& input)
+{
+    VkResult result = mdAddRenderPassInput(id, input);
+    if (result != VK_SUCCESS)
+        return result;
+
+    // Input attachments need the usage flag, recreate the image over the same memory if it's missing
+    MdRenderPassAttachment *p_att = &attachment_list.attachments[input];
+    if ((p_att->builder.image_info.usage & VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT) == 0)
+    {
+        p_att->builder.image_info.usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+        result = mdResizeAttachmentTexture(
+            *render_graph.p_context, 
+            p_att->extent.width, 
+            p_att->extent.height, 
+            p_att->builder, 
+            renderer_state.allocator, 
+            p_att->texture
+        );
+        VK_CHECK(result, "failed to add input attachment usage to \"%s\"", input.c_str());
+        p_att->generation = ++attachment_list.generation;
+    }
+
+    render_graph.passes[mdFindRenderPass(id)].local_inputs.push_back(input);
+    return VK_SUCCESS;
+}
+
+bool mdRenderGraphIsPassMerged(const std::string &id)
+{
+    u32 idx = mdFindRenderPass(id);
+    if (idx == UINT32_MAX)
+    {
+        LOG_ERROR("failed to find pass with id \"%s\"", id.c_str());
+        return false;
+    }
+
+    return render_graph.passes[idx].merged_parent != UINT32_MAX;
+}
+
+void mdRenderGraphSetClearValues(const std::string &id, const std::vector<VkClearValue> &values)
+{
+    u32 idx = mdFindRenderPass(id);
+    if (idx == UINT32_MAX)
+    {
+        LOG_ERROR("failed to find pass with id \"%s\"", id.c_str());
+        return;
+    }
+
+    render_graph.passes[idx].clear_values = values;
+}
 
 void mdAddRenderPassFunction(const std::string& id, const std::function<void(VkCommandBuffer, VkFramebuffer)> &func)
 {
@@ -608,11 +1112,11 @@ void mdRenderGraphTopologicalSort()
 
         for (u64 i=0; i<render_graph.node_count; i++)
         {
-            if (in_degrees[i] != 0 || ((removed & (1<<i)) != 0))
+            if (in_degrees[i] != 0 || ((removed & (1ull<<i)) != 0))
                 continue;
             
             found = true;
-            marked |= (1<<i);
+            marked |= (1ull<<i);
 
             render_graph.compiled_nodes[render_graph.compiled_count].stage = stage;
             render_graph.compiled_nodes[render_graph.compiled_count++].index = render_graph.nodes[i].index;
@@ -621,12 +1125,12 @@ void mdRenderGraphTopologicalSort()
         if (!found) break;
         for (u64 i=0; i<render_graph.node_count; i++)
         {
-            if ((marked & (1<<i)) == 0)
+            if ((marked & (1ull<<i)) == 0)
                 continue;
             
             for (u32 c=0; c<render_graph.node_count; c++)
             {
-                if ((p_matrix->matrix[c] & (1<<i)) == 0)
+                if ((p_matrix->matrix[c] & (1ull<<i)) == 0)
                     continue;
                 
                 in_degrees[c]--;
@@ -643,84 +1147,416 @@ void mdRenderGraphTopologicalSort()
     while (1);
 }
 
-VkResult mdRenderGraphBuildPass(u32 index)
+// A pass renders at the extent of its output attachments, swapchain passes at the 
+// extent of the swapchain
+VkExtent2D mdRenderGraphGetOutputExtent(u32 index)
 {
-    std::array<VkSubpassDependency, 4> subpasses = {};
-    u8 subpass_count = 0;
-
-    VkAttachmentDescription attachments[2] = {};
-    VkAttachmentReference att_refs[2] = {};
-    VkSubpassDependency deps[2] = {};
-    
-    VkSubpassDescription desc = {};
-    
-    usize att_count = 0;
+    MdRenderPassEntry *p_entry = &render_graph.passes[index];
+    if (p_entry->is_swapchain_output)
+        return render_graph.p_context->swapchain.extent;
 
-    // If the pass is a swapchain pass, just build the pass with one color attachment
-    if (render_graph.passes[index].is_swapchain_output)
+    VkExtent2D extent = {0, 0};
+    for (u32 o=0; o<p_entry->output_attachments.size(); o++)
     {
-        attachments[0].flags = 0;
-        attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        attachments[0].format = render_graph.p_context->swapchain.image_format;
-        attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-        attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-        attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-
-        att_refs[0].attachment = att_count;
-        att_refs[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        auto att_it = attachment_list.attachments.find(p_entry->output_attachments[o]);
+        if (att_it == attachment_list.attachments.end())
+            continue;
 
-        deps[0].dependencyFlags = 0;
-        deps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-        deps[0].dstSubpass = 0;
-        deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        deps[0].srcAccessMask = 0;
-        deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        
-        desc.colorAttachmentCount = 1;
-        desc.pColorAttachments = &att_refs[0];
-        
-        VkRenderPassCreateInfo pass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
-    
-        pass_info.subpassCount = 1;
-        pass_info.pSubpasses = &desc;
-        pass_info.attachmentCount = 1;
-        pass_info.pAttachments = attachments;
-        pass_info.dependencyCount = 1;
-        pass_info.pDependencies = deps;
-        pass_info.flags = 0;
+        VkExtent2D att_extent = att_it->second.extent;
+        if (extent.width == 0)
+        {
+            extent = att_extent;
+            continue;
+        }
 
-        VkResult result = vkCreateRenderPass(
-            render_graph.device, 
-            &pass_info, 
-            NULL, 
-            &render_graph.passes[index].pass
-        );
-        if (result == VK_SUCCESS)
-            printf("built pass \"%s\" with %d attachments\n", 
-                render_graph.passes[index].id.c_str(),
-                pass_info.attachmentCount
+        if (att_extent.width != extent.width || att_extent.height != extent.height)
+        {
+            LOG_ERROR("attachments of pass \"%s\" differ in size (%dx%d vs %dx%d), clamping to the smallest",
+                p_entry->id.c_str(), extent.width, extent.height, att_extent.width, att_extent.height
             );
-        
-        return result;
+            extent.width = MIN_VAL(extent.width, att_extent.width);
+            extent.height = MIN_VAL(extent.height, att_extent.height);
+        }
     }
 
-    auto ptr = &render_graph.passes[index].output_attachments;
-    bool        has_color = false, 
-                has_depth = false;
-    VkFormat    color_format = VK_FORMAT_UNDEFINED, 
-                depth_format = VK_FORMAT_UNDEFINED;
-    u32         color_idx = -1,
-                depth_idx = -1;
+    return (extent.width == 0) ? render_graph.output_extent : extent;
+}
 
-    for (auto it=ptr->begin(); it!=ptr->end(); it++)
-    {
-        auto att_it = attachment_list.attachments.find(*it);
-        if (att_it == attachment_list.attachments.end())
-            continue;
+// Flattens everything the create info points to, the structs it copies have no padding
+void mdRenderPassInfoKey(const VkRenderPassCreateInfo &info, std::vector<u8> &key)
+{
+    auto append = [&key](const void *p_data, usize size) {
+        if (size > 0)
+            key.insert(key.end(), (const u8*)p_data, (const u8*)p_data + size);
+    };
+
+    key.clear();
+    append(&info.flags, sizeof(info.flags));
+    append(&info.attachmentCount, sizeof(info.attachmentCount));
+    append(info.pAttachments, info.attachmentCount * sizeof(VkAttachmentDescription));
+    append(&info.dependencyCount, sizeof(info.dependencyCount));
+    append(info.pDependencies, info.dependencyCount * sizeof(VkSubpassDependency));
+    append(&info.subpassCount, sizeof(info.subpassCount));
+    for (u32 i=0; i<info.subpassCount; i++)
+    {
+        const VkSubpassDescription *p_desc = &info.pSubpasses[i];
+        u32 has_resolve = (p_desc->pResolveAttachments != NULL);
+        u32 has_depth = (p_desc->pDepthStencilAttachment != NULL);
+
+        append(&p_desc->flags, sizeof(p_desc->flags));
+        append(&p_desc->pipelineBindPoint, sizeof(p_desc->pipelineBindPoint));
+        append(&p_desc->inputAttachmentCount, sizeof(p_desc->inputAttachmentCount));
+        append(p_desc->pInputAttachments, p_desc->inputAttachmentCount * sizeof(VkAttachmentReference));
+        append(&p_desc->colorAttachmentCount, sizeof(p_desc->colorAttachmentCount));
+        append(p_desc->pColorAttachments, p_desc->colorAttachmentCount * sizeof(VkAttachmentReference));
+        append(&has_resolve, sizeof(has_resolve));
+        if (has_resolve)
+            append(p_desc->pResolveAttachments, p_desc->colorAttachmentCount * sizeof(VkAttachmentReference));
+        append(&has_depth, sizeof(has_depth));
+        if (has_depth)
+            append(p_desc->pDepthStencilAttachment, sizeof(VkAttachmentReference));
+        append(&p_desc->preserveAttachmentCount, sizeof(p_desc->preserveAttachmentCount));
+        append(p_desc->pPreserveAttachments, p_desc->preserveAttachmentCount * sizeof(u32));
+    }
+}
+
+// Passes with the same attachment signature share one VkRenderPass, so rebuilding the 
+// graph only creates render passes for signatures it hasn't seen yet
+VkResult mdRenderGraphGetCachedPass(const VkRenderPassCreateInfo &info, VkRenderPass *p_pass)
+{
+    std::vector<u8> key;
+    mdRenderPassInfoKey(info, key);
+    u64 hash = mdHashBytes(key.data(), key.size());
+
+    std::vector<std::pair<std::vector<u8>, VkRenderPass>> *p_bucket = &render_graph.render_pass_cache[hash];
+    for (usize i=0; i<p_bucket->size(); i++)
+    {
+        if ((*p_bucket)[i].first != key)
+            continue;
+
+        *p_pass = (*p_bucket)[i].second;
+        return VK_SUCCESS;
+    }
+
+    VkResult result = vkCreateRenderPass(render_graph.device, &info, NULL, p_pass);
+    if (result != VK_SUCCESS)
+        return result;
+    
+    p_bucket->push_back(std::pair(key, *p_pass));
+    return result;
+}
+
+bool mdContainsAttachment(const std::vector<std::string> &list, const std::string &name)
+{
+    for (u32 i=0; i<list.size(); i++)
+        if (list[i] == name) return true;
+    return false;
+}
+
+// Merges a pass into the one executed right before it when every attachment it reads from 
+// that pass is a local input, both render at the same extent and nothing else reads the 
+// local inputs. Only pairs are merged, and only with the render pass backend.
+void mdRenderGraphMergeSubpasses()
+{
+    for (u32 n=0; n<render_graph.compiled_count; n++)
+    {
+        MdRenderPassEntry *p_entry = &render_graph.passes[render_graph.compiled_nodes[n].index];
+        p_entry->merged_parent = UINT32_MAX;
+        p_entry->merged_child = UINT32_MAX;
+        p_entry->subpass = 0;
+    }
+
+    if (render_graph.backend != MD_RENDER_GRAPH_BACKEND_RENDER_PASS)
+        return;
+
+    // Compiled nodes go from the final pass back to its producers, so the pass 
+    // executed right before compiled_nodes[n] is compiled_nodes[n+1]
+    for (u32 n=0; n+1<render_graph.compiled_count; n++)
+    {
+        u32 b = render_graph.compiled_nodes[n].index;
+        u32 a = render_graph.compiled_nodes[n+1].index;
+        MdRenderPassEntry *p_a = &render_graph.passes[a];
+        MdRenderPassEntry *p_b = &render_graph.passes[b];
+
+        if (p_b->local_inputs.empty() || p_a->is_swapchain_output || p_b->is_swapchain_output)
+            continue;
+        if (p_a->queue != MD_RENDER_PASS_QUEUE_GRAPHICS || p_b->queue != MD_RENDER_PASS_QUEUE_GRAPHICS)
+            continue;
+        if (p_b->merged_child != UINT32_MAX)
+            continue;
+
+        bool mergeable = true;
+        for (u32 i=0; i<p_b->input_attachments.size() && mergeable; i++)
+        {
+            const std::string &input = p_b->input_attachments[i];
+            bool local = mdContainsAttachment(p_b->local_inputs, input);
+            bool from_a = mdContainsAttachment(p_a->output_attachments, input);
+
+            // Everything read from the producer has to be pixel-local, and local inputs must come from it
+            if (local != from_a)
+                mergeable = false;
+            if (local && mdContainsAttachment(p_b->output_attachments, input))
+                mergeable = false;
+            
+            // Local inputs never leave tile memory, so nobody else may read them
+            for (u32 c=0; c<render_graph.compiled_count && local && mergeable; c++)
+            {
+                u32 other = render_graph.compiled_nodes[c].index;
+                if (other != b && mdContainsAttachment(render_graph.passes[other].input_attachments, input))
+                    mergeable = false;
+            }
+        }
+
+        VkExtent2D extent_a = mdRenderGraphGetOutputExtent(a);
+        VkExtent2D extent_b = mdRenderGraphGetOutputExtent(b);
+        if (extent_a.width != extent_b.width || extent_a.height != extent_b.height)
+            mergeable = false;
+
+        if (!mergeable)
+            continue;
+
+        p_a->merged_child = b;
+        p_b->merged_parent = a;
+        p_b->subpass = 1;
+        printf("merged pass \"%s\" into \"%s\" as subpass 1\n", p_b->id.c_str(), p_a->id.c_str());
+    }
+}
+
+VkResult mdRenderGraphBuildMergedPass(u32 index)
+{
+    MdRenderPassEntry *p_a = &render_graph.passes[index];
+    MdRenderPassEntry *p_b = &render_graph.passes[p_a->merged_child];
+
+    // Attachments are the producer's outputs followed by the consumer's
+    p_a->pass_attachments = p_a->output_attachments;
+    for (u32 o=0; o<p_b->output_attachments.size(); o++)
+    {
+        if (!mdContainsAttachment(p_a->pass_attachments, p_b->output_attachments[o]))
+            p_a->pass_attachments.push_back(p_b->output_attachments[o]);
+    }
+
+    if (p_a->pass_attachments.size() > 4)
+    {
+        LOG_ERROR("merged pass \"%s\" has too many attachments", p_a->id.c_str());
+        return VK_ERROR_UNKNOWN;
+    }
+
+    VkAttachmentDescription attachments[4] = {};
+    VkAttachmentReference color_refs[2] = {}, depth_refs[2] = {}, input_refs[4] = {};
+    bool has_color[2] = {}, has_depth[2] = {};
+    u32 input_count = 0;
+
+    for (u32 i=0; i<p_a->pass_attachments.size(); i++)
+    {
+        const std::string &name = p_a->pass_attachments[i];
+        auto att_it = attachment_list.attachments.find(name);
+        if (att_it == attachment_list.attachments.end())
+        {
+            LOG_ERROR("attachment \"%s\" not found for pass \"%s\"", name.c_str(), p_a->id.c_str());
+            return VK_ERROR_UNKNOWN;
+        }
+
+        bool is_depth = (att_it->second.type == MD_ATTACHMENT_TYPE_DEPTH);
+        bool is_local = mdContainsAttachment(p_b->local_inputs, name);
+        VkImageLayout layout = (is_depth) 
+            ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL 
+            : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        attachments[i].flags = 0;
+        attachments[i].format = att_it->second.builder.image_info.format;
+        attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[i].storeOp = (is_local) ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[i].finalLayout = (is_local) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : layout;
+
+        // Subpass 0 writes the producer's outputs, subpass 1 reads the local inputs and writes its own
+        MdRenderPassEntry *writers[2] = {p_a, p_b};
+        for (u32 s=0; s<2; s++)
+        {
+            if (!mdContainsAttachment(writers[s]->output_attachments, name))
+                continue;
+
+            if (is_depth && !has_depth[s])
+            {
+                has_depth[s] = true;
+                depth_refs[s] = {i, layout};
+            }
+            else if (!is_depth && !has_color[s])
+            {
+                has_color[s] = true;
+                color_refs[s] = {i, layout};
+            }
+        }
+
+        if (is_local)
+            input_refs[input_count++] = {i, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    }
+
+    VkSubpassDescription descs[2] = {};
+    for (u32 s=0; s<2; s++)
+    {
+        descs[s].flags = 0;
+        descs[s].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        descs[s].colorAttachmentCount = (has_color[s]) ? 1 : 0;
+        descs[s].pColorAttachments = (has_color[s]) ? &color_refs[s] : NULL;
+        descs[s].pDepthStencilAttachment = (has_depth[s]) ? &depth_refs[s] : NULL;
+        descs[s].pResolveAttachments = NULL;
+        descs[s].preserveAttachmentCount = 0;
+        descs[s].pPreserveAttachments = NULL;
+    }
+    descs[1].inputAttachmentCount = input_count;
+    descs[1].pInputAttachments = input_refs;
+
+    VkPipelineStageFlags attachment_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | 
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | 
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    VkAccessFlags attachment_writes = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | 
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkSubpassDependency deps[3] = {};
+    deps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    deps[0].dstSubpass = 0;
+    deps[0].srcStageMask = attachment_stages;
+    deps[0].dstStageMask = attachment_stages;
+    deps[0].srcAccessMask = 0;
+    deps[0].dstAccessMask = attachment_writes;
+
+    deps[1] = deps[0];
+    deps[1].dstSubpass = 1;
+
+    // Pixel-local reads of subpass 0's outputs
+    deps[2].srcSubpass = 0;
+    deps[2].dstSubpass = 1;
+    deps[2].srcStageMask = attachment_stages;
+    deps[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    deps[2].srcAccessMask = attachment_writes;
+    deps[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+    deps[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    VkRenderPassCreateInfo pass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+    pass_info.flags = 0;
+    pass_info.attachmentCount = p_a->pass_attachments.size();
+    pass_info.pAttachments = attachments;
+    pass_info.subpassCount = 2;
+    pass_info.pSubpasses = descs;
+    pass_info.dependencyCount = 3;
+    pass_info.pDependencies = deps;
+
+    VkResult result = mdRenderGraphGetCachedPass(pass_info, &p_a->pass);
+    VK_CHECK(result, "failed to make merged pass \"%s\"", p_a->id.c_str());
+
+    printf("built merged pass \"%s\" + \"%s\" with %d attachments\n", 
+        p_a->id.c_str(), 
+        p_b->id.c_str(), 
+        pass_info.attachmentCount
+    );
+    return result;
+}
+
+VkResult mdRenderGraphBuildPass(u32 index)
+{
+    std::array<VkSubpassDependency, 4> subpasses = {};
+    u8 subpass_count = 0;
+
+    VkAttachmentDescription attachments[2] = {};
+    VkAttachmentReference att_refs[2] = {};
+    VkSubpassDependency deps[2] = {};
+    
+    VkSubpassDescription desc = {};
+    
+    usize att_count = 0;
+
+    // Render passes are owned by the cache, the pass only keeps a reference
+    render_graph.passes[index].pass = VK_NULL_HANDLE;
+
+    // Compute passes don't have a render pass, they write storage attachments directly
+    if (render_graph.passes[index].queue != MD_RENDER_PASS_QUEUE_GRAPHICS)
+    {
+        auto outputs = &render_graph.passes[index].output_attachments;
+        for (u32 o=0; o<outputs->size(); o++)
+        {
+            auto att_it = attachment_list.attachments.find((*outputs)[o]);
+            if (att_it != attachment_list.attachments.end() && att_it->second.type != MD_ATTACHMENT_TYPE_STORAGE)
+                LOG_ERROR("compute pass \"%s\" writes \"%s\", which is not a storage attachment", 
+                    render_graph.passes[index].id.c_str(), 
+                    (*outputs)[o].c_str()
+                );
+        }
+
+        render_graph.passes[index].color_format = VK_FORMAT_UNDEFINED;
+        render_graph.passes[index].depth_format = VK_FORMAT_UNDEFINED;
+        render_graph.passes[index].pass_attachments = *outputs;
+        return VK_SUCCESS;
+    }
+
+    // If the pass is a swapchain pass, just build the pass with one color attachment
+    if (render_graph.passes[index].is_swapchain_output)
+    {
+        render_graph.passes[index].color_format = render_graph.p_context->swapchain.image_format;
+        render_graph.passes[index].depth_format = VK_FORMAT_UNDEFINED;
+        if (render_graph.backend == MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING)
+            return VK_SUCCESS;
+
+        attachments[0].flags = 0;
+        attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[0].finalLayout = mdRenderGraphOutputLayout();
+        attachments[0].format = render_graph.p_context->swapchain.image_format;
+        attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+        att_refs[0].attachment = att_count;
+        att_refs[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        deps[0].dependencyFlags = 0;
+        deps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        deps[0].dstSubpass = 0;
+        deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        deps[0].srcAccessMask = 0;
+        deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        
+        desc.colorAttachmentCount = 1;
+        desc.pColorAttachments = &att_refs[0];
+        
+        VkRenderPassCreateInfo pass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+    
+        pass_info.subpassCount = 1;
+        pass_info.pSubpasses = &desc;
+        pass_info.attachmentCount = 1;
+        pass_info.pAttachments = attachments;
+        pass_info.dependencyCount = 1;
+        pass_info.pDependencies = deps;
+        pass_info.flags = 0;
+
+        VkResult result = mdRenderGraphGetCachedPass(pass_info, &render_graph.passes[index].pass);
+        if (result == VK_SUCCESS)
+            printf("built pass \"%s\" with %d attachments\n", 
+                render_graph.passes[index].id.c_str(),
+                pass_info.attachmentCount
+            );
+        
+        return result;
+    }
+
+    auto ptr = &render_graph.passes[index].output_attachments;
+    bool        has_color = false, 
+                has_depth = false;
+    VkFormat    color_format = VK_FORMAT_UNDEFINED, 
+                depth_format = VK_FORMAT_UNDEFINED;
+    u32         color_idx = -1,
+                depth_idx = -1;
+
+    for (auto it=ptr->begin(); it!=ptr->end(); it++)
+    {
+        auto att_it = attachment_list.attachments.find(*it);
+        if (att_it == attachment_list.attachments.end())
+            continue;
 
         has_color |= (att_it->second.type == MD_ATTACHMENT_TYPE_COLOR);
         has_depth |= (att_it->second.type == MD_ATTACHMENT_TYPE_DEPTH);
@@ -739,6 +1575,18 @@ VkResult mdRenderGraphBuildPass(u32 index)
         att_count++;
     }
 
+    render_graph.passes[index].color_format = color_format;
+    render_graph.passes[index].depth_format = depth_format;
+    render_graph.passes[index].pass_attachments = *ptr;
+    if (render_graph.backend == MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING)
+        return VK_SUCCESS;
+
+    // Merged passes are built together with their parent
+    if (render_graph.passes[index].merged_parent != UINT32_MAX)
+        return VK_SUCCESS;
+    if (render_graph.passes[index].merged_child != UINT32_MAX)
+        return mdRenderGraphBuildMergedPass(index);
+
     // Setup color attachment descriptions, refs, and subpass dependencies
     if (has_color)
     {
@@ -812,12 +1660,7 @@ VkResult mdRenderGraphBuildPass(u32 index)
     pass_info.pDependencies = deps;
     pass_info.flags = 0;
 
-    VkResult result = vkCreateRenderPass(
-        render_graph.device, 
-        &pass_info, 
-        NULL, 
-        &render_graph.passes[index].pass
-    );
+    VkResult result = mdRenderGraphGetCachedPass(pass_info, &render_graph.passes[index].pass);
     VK_CHECK(result, "failed to make pass \"%s\"", render_graph.passes[index].id.c_str());
     
     printf("built pass \"%s\" with %ld attachments\n", 
@@ -827,52 +1670,55 @@ VkResult mdRenderGraphBuildPass(u32 index)
     return result;
 }
 
-void mdRenderGraphClearFramebuffers()
+void mdRenderGraphDestroyPassFramebuffers(usize p)
 {
-    for (usize p=0; p<render_graph.pass_count; p++)
+    auto pass_ptr = &render_graph.passes[p];
+    for (usize fb=0; fb<pass_ptr->framebuffers.size(); fb++)
     {
-        auto pass_ptr = &render_graph.passes[p];
-        for (usize o=0; o<pass_ptr->output_attachments.size(); o++)
-        {
-            auto att_ptr = &attachment_list.attachments;
-            auto att_it = att_ptr->find(pass_ptr->output_attachments[o]);
-            if (att_it == att_ptr->end())
-            {
-                LOG_ERROR("Attachment \"%s\" not found for pass \"%s\"", 
-                    pass_ptr->output_attachments[o].c_str(),
-                    pass_ptr->id.c_str()
-                );
-                return;
-            }
-
-            for (usize fb=0; fb<pass_ptr->framebuffers.size(); fb++)
-            {
-                if (pass_ptr->framebuffers[fb] == VK_NULL_HANDLE)
-                    continue;
-                
-                vkDestroyFramebuffer(render_graph.device, pass_ptr->framebuffers[fb], NULL);
-                pass_ptr->framebuffers[fb] = NULL;
-            }
-        }
+        if (pass_ptr->framebuffers[fb] == VK_NULL_HANDLE)
+            continue;
+        
+        // Command buffers from frames still in flight can reference the framebuffer
+        mdRetireFramebuffer(pass_ptr->framebuffers[fb]);
+        pass_ptr->framebuffers[fb] = NULL;
     }
+    pass_ptr->framebuffers.clear();
+    pass_ptr->framebuffer_hash = 0;
+}
+
+void mdRenderGraphClearFramebuffers()
+{
+    for (usize p=0; p<render_graph.passes.size(); p++)
+        mdRenderGraphDestroyPassFramebuffers(p);
+}
+
+u64 mdRenderGraphHashFramebuffer(const VkFramebufferCreateInfo &fb_info, const std::vector<VkImageView> &views, u64 hash)
+{
+    hash = mdHashValue(fb_info.renderPass, hash);
+    hash = mdHashValue(fb_info.width, hash);
+    hash = mdHashValue(fb_info.height, hash);
+    return mdHashBytes(views.data(), views.size() * sizeof(VkImageView), hash);
 }
 
-// TO-DO: make it so that the user can render to their own target texture, and 
-// don't assume that the width and height of a buffer will always be that of
-// the swapchain.    
 VkResult mdRenderGraphGenerateFramebuffers(const std::vector<VkImageView> &swapchain_images)
 {
     VkFramebufferCreateInfo fb_info = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
     fb_info.layers = 1;
-    fb_info.width = render_graph.p_context->swapchain.extent.width;
-    fb_info.height = render_graph.p_context->swapchain.extent.height;
     
     VkFramebuffer handle = VK_NULL_HANDLE;
     std::vector<VkImageView> views;
     views.reserve(16);
 
-    // Clear framebuffers if need be
-    mdRenderGraphClearFramebuffers();
+    // Passes that dropped out of the graph don't need their framebuffers anymore
+    u64 compiled_mask = 0;
+    for (usize n=0; n<render_graph.compiled_count; n++)
+        compiled_mask |= 1ull << render_graph.compiled_nodes[n].index;
+    
+    for (usize p=0; p<render_graph.passes.size(); p++)
+    {
+        if ((compiled_mask & (1ull << p)) == 0)
+            mdRenderGraphDestroyPassFramebuffers(p);
+    }
 
     // For every pass, look at the output attachments and add them to a list
     VkResult result = VK_SUCCESS;
@@ -883,22 +1729,37 @@ VkResult mdRenderGraphGenerateFramebuffers(const std::vector<VkImageView> &swapc
         
         // Reset the image view list
         views.clear();
+        u64 image_hash = MD_HASH_SEED;
         
         // Get the current render pass
         auto pass_ptr = &render_graph.passes[p];
         fb_info.renderPass = pass_ptr->pass;
+
+        pass_ptr->extent = mdRenderGraphGetOutputExtent(p);
+        fb_info.width = pass_ptr->extent.width;
+        fb_info.height = pass_ptr->extent.height;
+
+        // Dynamic rendering binds image views directly when recording, merged passes 
+        // use their parent's framebuffer and compute passes don't have one
+        if (render_graph.backend == MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING || 
+            pass_ptr->merged_parent != UINT32_MAX || 
+            pass_ptr->queue != MD_RENDER_PASS_QUEUE_GRAPHICS)
+        {
+            mdRenderGraphDestroyPassFramebuffers(p);
+            continue;
+        }
         
         if (!pass_ptr->is_swapchain_output)
         {
             // For every attachment, push back its image view
-            for (int o=0; o<pass_ptr->output_attachments.size(); o++)
+            for (int o=0; o<pass_ptr->pass_attachments.size(); o++)
             {
                 auto att_ptr = &attachment_list.attachments;
-                auto att_it = att_ptr->find(pass_ptr->output_attachments[o]);
+                auto att_it = att_ptr->find(pass_ptr->pass_attachments[o]);
                 if (att_it == att_ptr->end())
                 {
                     LOG_ERROR("Attachment \"%s\" not found for pass \"%s\"", 
-                        pass_ptr->output_attachments[o].c_str(),
+                        pass_ptr->pass_attachments[o].c_str(),
                         pass_ptr->id.c_str()
                     );
                     return VK_ERROR_UNKNOWN;
@@ -906,11 +1767,15 @@ VkResult mdRenderGraphGenerateFramebuffers(const std::vector<VkImageView> &swapc
 
                 // Push back VK_NULL_HANDLE since we'll set it to the swapchain's image view(s)
                 views.push_back(att_it->second.texture.image_view);
+                image_hash = mdHashValue(att_it->second.generation, image_hash);
             }
 
-            // If this pass is a swapchain output, then generate a framebuffer for each swapchain image,
-            // else push back only one framebuffer
-            usize sw_index = 0;
+            // Only rebuild the framebuffer if one of its images changed
+            u64 hash = mdRenderGraphHashFramebuffer(fb_info, views, image_hash);
+            if (!pass_ptr->framebuffers.empty() && hash == pass_ptr->framebuffer_hash)
+                continue;
+            mdRenderGraphDestroyPassFramebuffers(p);
+            pass_ptr->framebuffer_hash = hash;
             
             fb_info.attachmentCount = views.size();
             fb_info.pAttachments = views.data();        
@@ -941,6 +1806,7 @@ VkResult mdRenderGraphGenerateFramebuffers(const std::vector<VkImageView> &swapc
                     views.push_back(att_it->second.texture.image_view);
                 else
                     views.push_back(VK_NULL_HANDLE);
+                image_hash = mdHashValue(att_it->second.generation, image_hash);
             }
 
             // If this pass is a swapchain output, then generate a framebuffer for each swapchain image,
@@ -954,6 +1820,14 @@ VkResult mdRenderGraphGenerateFramebuffers(const std::vector<VkImageView> &swapc
                 break;
             }
 
+            u64 hash = mdRenderGraphHashFramebuffer(fb_info, views, image_hash);
+            hash = mdHashBytes(swapchain_images.data(), swapchain_images.size() * sizeof(VkImageView), hash);
+            hash = mdHashValue(render_graph.swapchain_generation, hash);
+            if (!pass_ptr->framebuffers.empty() && hash == pass_ptr->framebuffer_hash)
+                continue;
+            mdRenderGraphDestroyPassFramebuffers(p);
+            pass_ptr->framebuffer_hash = hash;
+
             for (usize sw_img=0; sw_img<swapchain_images.size(); sw_img++)
             {
                 views[sw_index] = swapchain_images[sw_img];
@@ -976,7 +1850,7 @@ VkResult mdRenderGraphGenerateFramebuffers(const std::vector<VkImageView> &swapc
 
 void mdBuildRenderGraphEdges(u32 index, u64 *p_visited)
 {
-    *p_visited |= 1 << index;
+    *p_visited |= 1ull << index;
 
     // For a given input, find all nodes with a corresponding output
     MdRenderPassEntry *p_end = &render_graph.passes[index];
@@ -986,7 +1860,7 @@ void mdBuildRenderGraphEdges(u32 index, u64 *p_visited)
     {
         for (u32 p=0; p<render_graph.passes.size(); p++)
         {   
-            bool visited = (*p_visited & (1 << p)) != 0;
+            bool visited = (*p_visited & (1ull << p)) != 0;
             if (visited || render_graph.passes[p].status != MD_NODE_USED)
                 continue;
             
@@ -1018,6 +1892,52 @@ void mdBuildRenderGraphEdges(u32 index, u64 *p_visited)
     }
 }
 
+void mdHashAttachment(const std::string &name, u64 *p_hash, bool hash_extent)
+{
+    *p_hash = mdHashString(name, *p_hash);
+    auto it = attachment_list.attachments.find(name);
+    if (it == attachment_list.attachments.end())
+        return;
+    
+    const MdRenderPassAttachment *p_att = &it->second;
+    *p_hash = mdHashValue(p_att->type, *p_hash);
+    *p_hash = mdHashValue(p_att->swapchain_attachment, *p_hash);
+    *p_hash = mdHashValue(p_att->builder.image_info.format, *p_hash);
+    *p_hash = mdHashValue(p_att->builder.image_info.usage, *p_hash);
+    if (hash_extent)
+        *p_hash = mdHashValue(p_att->extent, *p_hash);
+}
+
+u64 mdRenderGraphHashDeclarations()
+{
+    u64 hash = mdHashValue(render_graph.backend);
+    hash = mdHashValue(render_graph.p_context->swapchain.image_format, hash);
+    for (u32 p=0; p<render_graph.passes.size(); p++)
+    {
+        const MdRenderPassEntry *p_entry = &render_graph.passes[p];
+        if (p_entry->status != MD_NODE_USED)
+            continue;
+        
+        hash = mdHashValue(p, hash);
+        hash = mdHashString(p_entry->id, hash);
+        hash = mdHashValue(p_entry->is_swapchain_output, hash);
+        hash = mdHashValue(p_entry->queue, hash);
+
+        // Subpass merging compares extents, so they only matter for passes with local inputs
+        bool hash_extent = !p_entry->local_inputs.empty();
+        for (u32 i=0; i<p_entry->input_attachments.size(); i++)
+            mdHashAttachment(p_entry->input_attachments[i], &hash, hash_extent);
+        hash = mdHashValue(p_entry->input_attachments.size(), hash);
+        for (u32 o=0; o<p_entry->output_attachments.size(); o++)
+            mdHashAttachment(p_entry->output_attachments[o], &hash, hash_extent);
+        hash = mdHashValue(p_entry->output_attachments.size(), hash);
+        for (u32 l=0; l<p_entry->local_inputs.size(); l++)
+            hash = mdHashString(p_entry->local_inputs[l], hash);
+        hash = mdHashValue(p_entry->local_inputs.size(), hash);
+    }
+    return hash;
+}
+
 void mdBuildRenderGraph()
 {
     if (render_graph.pass_count < 1)
@@ -1033,25 +1953,86 @@ void mdBuildRenderGraph()
         return;
     }
 
-    u64 visited = UINT64_MAX << render_graph.pass_count;
-    
-    // Build edges of the graph
-    mdRenderGraphClear();
-    mdRenderGraphAddNode(index);
-    mdBuildRenderGraphEdges(index, &visited);
-
-    // Sort the graph
-    mdRenderGraphTopologicalSort();
-
-    // Only build the render passes that are used
-    for (u32 n=0; n<render_graph.compiled_count; n++)
-        mdRenderGraphBuildPass(render_graph.compiled_nodes[n].index);
+    // If no pass or attachment declaration changed since the last build, the compiled 
+    // graph is still valid and only framebuffers need to be looked at
+    u64 hash = mdRenderGraphHashDeclarations();
+    if (hash != render_graph.compiled_hash)
+    {
+        // Passes can be removed, so slots past pass_count may still be in use
+        u64 visited = 0;
+        
+        // Build edges of the graph
+        mdRenderGraphClear();
+        mdRenderGraphAddNode(index);
+        mdBuildRenderGraphEdges(index, &visited);
+
+        // Sort the graph
+        mdRenderGraphTopologicalSort();
+        mdRenderGraphMergeSubpasses();
+        render_graph.build_buffers = true;
+
+        // Only build the render passes that are used
+        for (u32 n=0; n<render_graph.compiled_count; n++)
+            mdRenderGraphBuildPass(render_graph.compiled_nodes[n].index);
+        
+        render_graph.compiled_hash = hash;
+    }
     
     // Generate framebuffers
     mdRenderGraphGenerateFramebuffers(render_graph.p_context->sw_image_views);
     return;
 }
 
+VkResult mdRenderGraphResize(VkExtent2D extent)
+{
+    render_graph.output_extent = extent;
+    render_graph.swapchain_generation++;
+
+    for (auto it=attachment_list.attachments.begin(); it!=attachment_list.attachments.end(); it++)
+    {
+        MdRenderPassAttachment *p_att = &it->second;
+        if (p_att->swapchain_attachment || p_att->size_mode != MD_ATTACHMENT_SIZE_SWAPCHAIN_RELATIVE)
+            continue;
+
+        VkExtent2D att_extent = mdGetAttachmentExtent(p_att->size_mode, 0, 0, p_att->scale_x, p_att->scale_y);
+        if (att_extent.width == p_att->extent.width && att_extent.height == p_att->extent.height)
+            continue;
+
+        // The old image and view can still be referenced by descriptors and command buffers in flight, 
+        // the memory stays with the attachment and gets bound to the resized image
+        struct Payload { VkImage image; VkImageView view; };
+        Payload payload = {p_att->texture.image, p_att->texture.image_view};
+        mdRetire([](void *p_payload){
+            Payload *p = (Payload*)p_payload;
+            vkDestroyImageView(renderer_state.allocator.device, p->view, NULL);
+            vkDestroyImage(renderer_state.allocator.device, p->image, NULL);
+        }, &payload, sizeof(payload));
+        p_att->texture.image = VK_NULL_HANDLE;
+        p_att->texture.image_view = VK_NULL_HANDLE;
+
+        VkResult result = mdResizeAttachmentTexture(
+            *render_graph.p_context, 
+            att_extent.width, 
+            att_extent.height, 
+            p_att->builder, 
+            renderer_state.allocator, 
+            p_att->texture
+        );
+        VK_CHECK(result, "failed to resize attachment \"%s\"", it->first.c_str());
+
+        p_att->texture.w = att_extent.width;
+        p_att->texture.h = att_extent.height;
+        p_att->extent = att_extent;
+        p_att->generation = ++attachment_list.generation;
+    }
+
+    // Only the framebuffers that reference a resized attachment or the swapchain get regenerated, 
+    // nothing to regenerate if the graph hasn't been declared yet
+    if (render_graph.pass_count > 0)
+        mdBuildRenderGraph();
+    return VK_SUCCESS;
+}
+
 VkRenderPass mdRenderGraphGetPass(const std::string &pass)
 {
     bool found = false;
@@ -1062,7 +2043,9 @@ VkRenderPass mdRenderGraphGetPass(const std::string &pass)
             continue;
         
         found = true;
-        rp = it->pass;
+        rp = (it->merged_parent != UINT32_MAX) 
+            ? render_graph.passes[it->merged_parent].pass 
+            : it->pass;
         break;
     }
     
@@ -1081,601 +2064,3225 @@ VkRenderPass mdRenderGraphGetPass(const std::string &pass)
     return rp;
 }
 
-VkResult mdPrimeRenderGraph()
+VkExtent2D mdRenderGraphGetPassExtent(const std::string &pass)
 {
-    VkResult result = VK_SUCCESS;
-    std::vector<VkCommandBuffer> buffers;
-
-    if (render_graph.pool == VK_NULL_HANDLE)
+    u32 index = mdFindRenderPass(pass);
+    if (index == UINT32_MAX)
     {
-        VkCommandPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
-        pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        pool_info.queueFamilyIndex = renderer_state.graphics_queue.queue_index;
+        LOG_ERROR("pass with id \"%s\" does not exist", pass.c_str());
+        return {0, 0};
+    }
 
-        result = vkCreateCommandPool(render_graph.device, &pool_info, NULL, &render_graph.pool);
-        VK_CHECK(result, "failed to create command pool");
+    return render_graph.passes[index].extent;
+}
 
-        if (render_graph.build_buffers)
-        {
-            buffers.reserve(render_graph.compiled_count);
-            for (u32 i=0; i<render_graph.node_count; i++)
-                buffers.push_back(VK_NULL_HANDLE);
-        }
-    }
+VkResult mdRenderGraphCreatePool(u32 family, VkCommandPool *p_pool)
+{
+    VkCommandPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = family;
 
-    if (render_graph.build_buffers)
-    {
-        VkCommandBufferAllocateInfo buffer_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-        buffer_info.commandBufferCount = buffers.size();
-        buffer_info.commandPool = render_graph.pool;
-        buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-
-        result = vkAllocateCommandBuffers(render_graph.device, &buffer_info, buffers.data());
-        VK_CHECK(result, "failed to create command buffers");
-
-        for (u32 i=0; i<render_graph.compiled_count; i++)
-        {
-            u32 pass_index = render_graph.compiled_nodes[i].index;
-            render_graph.passes[pass_index].buffer = buffers[i];
-        }
-
-        vkResetCommandPool(render_graph.device, render_graph.pool, 0);
-    }
-
-    render_graph.build_buffers = false;
+    VkResult result = vkCreateCommandPool(render_graph.device, &pool_info, NULL, p_pool);
+    VK_CHECK(result, "failed to create command pool");
     return result;
 }
 
-usize mdGetCommandBufferCount() { return render_graph.compiled_count; }
+#pragma region [ GPU Timestamps ]
+void mdRenderGraphEnableTimestamps(bool enable)
+{
+    render_graph.timestamps = enable;
+}
 
-VkResult mdRenderGraphResetBuffers()
+VkResult mdRenderGraphCreateQueryPools()
 {
-    return vkResetCommandPool(render_graph.device, render_graph.pool, 0);
+    VkPhysicalDevice physical_device = render_graph.p_context->physical_device;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    render_graph.timestamp_period = properties.limits.timestampPeriod;
+
+    // Queues that don't support timestamps report 0 valid bits, their passes aren't timed
+    u32 family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, NULL);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+    render_graph.graphics_timestamp_bits = families[renderer_state.graphics_queue.queue_index].timestampValidBits;
+    render_graph.compute_timestamp_bits = families[renderer_state.compute_queue.queue_index].timestampValidBits;
+
+    VkQueryPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = 2 * render_graph.passes.size();
+    for (u32 i=0; i<render_graph.query_pools.size(); i++)
+    {
+        VkResult result = vkCreateQueryPool(render_graph.device, &pool_info, NULL, &render_graph.query_pools[i]);
+        VK_CHECK(result, "failed to create timestamp query pool");
+    }
+
+    return VK_SUCCESS;
 }
 
-void mdExecuteRenderPass(const std::vector<VkClearValue> &values, const std::string &pass, u32 fb_index)
+// Reads every pool whose frame has completed without blocking, a pool that gets reused before 
+// its results were available drops them
+void mdRenderGraphReadTimestamps()
 {
-    bool found = false;
-    auto it=render_graph.passes.begin();
-    u32 pass_index = 0;
-    
-    while (it != render_graph.passes.end())
+    u64 results[4];
+    for (u32 f=0; f<render_graph.query_pools.size(); f++)
     {
-        if (it->id != pass) 
+        u64 written = render_graph.query_written[f];
+        for (u32 p=0; written != 0; p++, written >>= 1)
         {
-            it++;
-            pass_index++;
-            continue;
+            if ((written & 1) == 0)
+                continue;
+            
+            // Begin and end values, each followed by its availability
+            VkResult result = vkGetQueryPoolResults(
+                render_graph.device, 
+                render_graph.query_pools[f], 
+                2 * p, 
+                2, 
+                sizeof(results), 
+                results, 
+                2 * sizeof(u64), 
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+            );
+            if (result != VK_SUCCESS || results[1] == 0 || results[3] == 0)
+                continue;
+
+            bool compute = (mdRenderGraphGetPassFamily(p) != renderer_state.graphics_queue.queue_index);
+            u32 bits = (compute) ? render_graph.compute_timestamp_bits : render_graph.graphics_timestamp_bits;
+            u64 mask = (bits >= 64) ? UINT64_MAX : ((1ull << bits) - 1);
+            u64 ticks = ((results[2] & mask) - (results[0] & mask)) & mask;
+
+            MdRenderPassEntry *p_entry = &render_graph.passes[p];
+            p_entry->gpu_ms[p_entry->gpu_ms_head] = (f32)((f64)ticks * render_graph.timestamp_period / 1000000.0);
+            p_entry->gpu_ms_head = (p_entry->gpu_ms_head + 1) % MD_GPU_TIMING_HISTORY;
+            p_entry->gpu_ms_count = MIN_VAL(p_entry->gpu_ms_count + 1, (u32)MD_GPU_TIMING_HISTORY);
+            render_graph.query_written[f] &= ~(1ull << p);
         }
-        found = true;
-        break;
     }
-    
-    if (!found)
-    {
-        LOG_ERROR("pass with id \"%s\" does not exist", pass.c_str());
+}
+
+void mdRenderGraphBeginTimestampFrame()
+{
+    if (!render_graph.timestamps)
         return;
-    }
 
-    if (render_graph.passes[pass_index].pass == VK_NULL_HANDLE)
+    if (render_graph.query_pools[0] == VK_NULL_HANDLE && mdRenderGraphCreateQueryPools() != VK_SUCCESS)
     {
-        LOG_ERROR("pass with id \"%s\" has not been built yet", pass.c_str());
+        render_graph.timestamps = false;
         return;
     }
 
-    mdExecuteRenderPass(values, pass_index, fb_index);
+    mdRenderGraphReadTimestamps();
+    render_graph.query_written[render_graph.query_frame % MD_FRAMES_IN_FLIGHT] = 0;
 }
 
-void mdExecuteRenderPass(const std::vector<VkClearValue> &values, u32 index, u32 fb_index)
+// Queries are reset from the pass's own command buffer, outside of any render pass
+void mdRenderGraphWriteTimestamp(u32 pass_index, VkCommandBuffer buffer, bool end)
 {
-    if (index >= render_graph.compiled_count)
-    {
-        LOG_ERROR("index cannot be greater than or equal to the number of passes in the graph");
+    if (!render_graph.timestamps || render_graph.query_pools[0] == VK_NULL_HANDLE)
         return;
+
+    bool compute = (mdRenderGraphGetPassFamily(pass_index) != renderer_state.graphics_queue.queue_index);
+    if ((compute ? render_graph.compute_timestamp_bits : render_graph.graphics_timestamp_bits) == 0)
+        return;
+
+    u32 frame = render_graph.query_frame % MD_FRAMES_IN_FLIGHT;
+    VkQueryPool pool = render_graph.query_pools[frame];
+    u32 query = 2 * pass_index + (end ? 1 : 0);
+    if (!end)
+        vkCmdResetQueryPool(buffer, pool, query, 2);
+
+    if (render_graph.p_context->features_13.synchronization2)
+    {
+        VkPipelineStageFlags2 stage = (end) 
+            ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT 
+            : VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+        vkCmdWriteTimestamp2(buffer, stage, pool, query);
     }
+    else vkCmdWriteTimestamp(buffer, (end) ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, query);
 
-    // Get the index of the current and previous pass
-    u32 pass_index_1 = (((i32)index-1) >= 0) 
-        ? render_graph.compiled_nodes[index-1].index
-        : 0;
-    u32 pass_index = render_graph.compiled_nodes[index].index;
+    if (end)
+        render_graph.query_written[frame] |= (1ull << pass_index);
+}
 
-    // Get the command buffer
-    VkCommandBuffer buffer = render_graph.passes[pass_index].buffer;
-    VkFramebuffer fb = render_graph.passes[pass_index].framebuffers[fb_index];
-    
-    VkCommandBufferBeginInfo info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-    info.pInheritanceInfo = NULL;
-    VkResult result = vkBeginCommandBuffer(buffer, &info);
-    if (result != VK_SUCCESS)
+u32 mdRenderGraphGetPassTimings(const std::string &pass, f32 *p_durations_ms)
+{
+    u32 index = mdFindRenderPass(pass);
+    if (index == UINT32_MAX)
     {
-        LOG_ERROR("failed to begin command buffer for pass \"%s\"", render_graph.passes[pass_index].id.c_str());
-        return;
+        LOG_ERROR("pass with id \"%s\" does not exist", pass.c_str());
+        return 0;
     }
 
-    // Insert barriers as needed
-    auto input_ptr = &render_graph.passes[pass_index];
-    for (u32 i=0; i<input_ptr->input_attachments.size(); i++)
+    MdRenderPassEntry *p_entry = &render_graph.passes[index];
+    u32 first = (p_entry->gpu_ms_head + MD_GPU_TIMING_HISTORY - p_entry->gpu_ms_count) % MD_GPU_TIMING_HISTORY;
+    for (u32 i=0; i<p_entry->gpu_ms_count; i++)
+        p_durations_ms[i] = p_entry->gpu_ms[(first + i) % MD_GPU_TIMING_HISTORY];
+    
+    return p_entry->gpu_ms_count;
+}
+
+void mdRenderGraphPrintPassTimings()
+{
+    for (u32 n=0; n<render_graph.compiled_count; n++)
     {
-        // Insert the barrier if there is one for this resource
-        auto it = attachment_list.barriers.find(input_ptr->input_attachments[i]);
-        if (it == attachment_list.barriers.end())
+        MdRenderPassEntry *p_entry = &render_graph.passes[render_graph.compiled_nodes[n].index];
+        if (p_entry->gpu_ms_count == 0)
             continue;
-
-        // TO-DO: make barrier inserts more intelligent
-        auto att_ptr = &attachment_list.attachments[input_ptr->input_attachments[i]];
-        switch (it->second.type)
+        
+        f32 sum = 0.0f, max = 0.0f;
+        for (u32 i=0; i<p_entry->gpu_ms_count; i++)
         {
-            case MD_ATTACHMENT_TYPE_COLOR:
-            mdTransitionImageLayout(
-                att_ptr->texture, 
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
-                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 
-                VK_ACCESS_SHADER_READ_BIT, 
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
-                buffer
-            );
-            break;
-            case MD_ATTACHMENT_TYPE_DEPTH:
-            mdTransitionImageLayout(
-                att_ptr->texture, 
-                VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, 
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
-                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, 
-                VK_ACCESS_SHADER_READ_BIT, 
-                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
-                buffer
-            );
-            break;
+            sum += p_entry->gpu_ms[i];
+            max = MAX_VAL(max, p_entry->gpu_ms[i]);
         }
+        printf(
+            "Pass \"%s\": %.3fms average, %.3fms max over %d frames\n", 
+            p_entry->id.c_str(), 
+            sum / p_entry->gpu_ms_count, 
+            max, 
+            p_entry->gpu_ms_count
+        );
     }
-    
-    // Start the render pass
-    VkRenderPassBeginInfo begin_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-    begin_info.renderPass = render_graph.passes[pass_index].pass;
-    begin_info.renderArea.offset = {0,0};
-    begin_info.renderArea.extent = render_graph.p_context->swapchain.extent;
-    begin_info.clearValueCount = values.size();
-    begin_info.pClearValues = values.data();
-    
-    begin_info.framebuffer = fb;
-
-    vkCmdBeginRenderPass(buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+}
+#pragma endregion
 
-    if (render_graph.passes[pass_index].record != NULL)
-        render_graph.passes[pass_index].record(buffer, fb);
+#pragma region [ Pipeline Statistics ]
+#define MD_PIPELINE_STATISTICS_FLAGS (  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | \
+                                        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | \
+                                        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+                                        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | \
+                                        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | \
+                                        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
 
-    vkCmdEndRenderPass(buffer);
-    vkEndCommandBuffer(buffer);
+void mdRenderGraphEnablePipelineStatistics(bool enable)
+{
+    render_graph.statistics = enable;
 }
 
-void mdRenderGraphSubmit(std::vector<VkCommandBuffer> &buffers, bool refill)
+VkResult mdRenderGraphCreateStatisticsPools()
 {
-    // Populate the buffer if need be
-    if (refill)
-        buffers.clear();
+    if (!render_graph.p_context->features.pipelineStatisticsQuery)
+    {
+        LOG_ERROR("pipeline statistics queries are not supported by this device");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
 
-    if (refill || buffers.empty())
+    VkQueryPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    pool_info.queryCount = render_graph.passes.size();
+    pool_info.pipelineStatistics = MD_PIPELINE_STATISTICS_FLAGS;
+    for (u32 i=0; i<render_graph.stats_pools.size(); i++)
     {
-        if (buffers.capacity() < render_graph.compiled_count)
-            buffers.reserve(render_graph.compiled_count);
+        VkResult result = vkCreateQueryPool(render_graph.device, &pool_info, NULL, &render_graph.stats_pools[i]);
+        VK_CHECK(result, "failed to create pipeline statistics query pool");
+    }
 
-        for (i32 i=render_graph.compiled_count-1; i>=0; i--)
+    return VK_SUCCESS;
+}
+
+// Same as the timestamps, completed pools are read without blocking and unavailable results are dropped
+void mdRenderGraphReadStatistics()
+{
+    // Counters are written in the order of their bits, followed by the availability
+    u64 results[7];
+    for (u32 f=0; f<render_graph.stats_pools.size(); f++)
+    {
+        u64 written = render_graph.stats_written[f];
+        for (u32 p=0; written != 0; p++, written >>= 1)
         {
-            u32 pass_index = render_graph.compiled_nodes[i].index;
-            buffers.push_back(render_graph.passes[pass_index].buffer);
+            if ((written & 1) == 0)
+                continue;
+            
+            VkResult result = vkGetQueryPoolResults(
+                render_graph.device, 
+                render_graph.stats_pools[f], 
+                p, 
+                1, 
+                sizeof(results), 
+                results, 
+                sizeof(results), 
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+            );
+            if (result != VK_SUCCESS || results[6] == 0)
+                continue;
+
+            MdRenderPassEntry *p_entry = &render_graph.passes[p];
+            p_entry->stats_last = {results[0], results[1], results[2], results[3], results[4], results[5]};
+            p_entry->stats_total.ia_vertices += results[0];
+            p_entry->stats_total.ia_primitives += results[1];
+            p_entry->stats_total.vs_invocations += results[2];
+            p_entry->stats_total.clipping_invocations += results[3];
+            p_entry->stats_total.clipping_primitives += results[4];
+            p_entry->stats_total.fs_invocations += results[5];
+            p_entry->stats_frames++;
+            render_graph.stats_written[f] &= ~(1ull << p);
         }
     }
 }
-#pragma endregion
-
-#pragma region [ Material System ]
-#include <array>
-#define MD_UNIFORM_POOL_BLOCK_SIZE 128
-#define MD_MAX_UNIFORM_SETS 4096
-enum MdDescriptorPoolStatus
-{
-    UNALLOCATED,
-    AVAILABLE,
-    FREE
-};
 
-struct MdDescriptorPool
+void mdRenderGraphBeginStatisticsFrame()
 {
-    MdDescriptorPoolStatus status;
-    VkDescriptorPool pool;
-};
+    if (!render_graph.statistics)
+        return;
 
-struct MdDescriptorAllocator
-{
-    std::vector<MdDescriptorPool> pools;
-    std::array<VkDescriptorPoolSize, 4> sizes;
-    std::array<std::vector<VkDescriptorSet>, 4> sets;
+    if (render_graph.stats_pools[0] == VK_NULL_HANDLE && mdRenderGraphCreateStatisticsPools() != VK_SUCCESS)
+    {
+        render_graph.statistics = false;
+        return;
+    }
 
-    u32 pool_count;
-    u32 max_sets;
-    VkDevice device;
+    mdRenderGraphReadStatistics();
+    render_graph.stats_written[render_graph.query_frame % MD_FRAMES_IN_FLIGHT] = 0;
+}
 
-    VkResult Init(VkDevice device);
-    VkResult GetPool(VkDescriptorPool *p_pool);
-    VkResult CreatePool(VkDescriptorPool *p_pool = VK_NULL_HANDLE);
-    bool ResetPools(u32 index);
-    
-    VkResult AllocateSets(VkDescriptorSetLayout layout, u32 set_index, u32 size, VkDescriptorSet *p_sets);
-    void Destroy();
-    ~MdDescriptorAllocator(){};
-};
+// Graphics counters can only be queried from a graphics capable command pool
+bool mdRenderGraphCountsStatistics(u32 pass_index)
+{
+    return  render_graph.statistics && 
+            render_graph.stats_pools[0] != VK_NULL_HANDLE && 
+            mdRenderGraphGetPassFamily(pass_index) == renderer_state.graphics_queue.queue_index;
+}
 
-VkResult MdDescriptorAllocator::Init(VkDevice device)
+// The query is begun and ended outside of the render pass, so merged subpasses count towards their parent
+void mdRenderGraphBeginStatistics(u32 pass_index, VkCommandBuffer buffer)
 {
-    // Initialize pools
-    pools.reserve(MD_UNIFORM_POOL_BLOCK_SIZE);
-    for (u32 i=0; i<MD_UNIFORM_POOL_BLOCK_SIZE; i++)
-        pools.push_back({
-            .status = UNALLOCATED,
-            .pool = VK_NULL_HANDLE
-        });
+    if (!mdRenderGraphCountsStatistics(pass_index))
+        return;
 
-    this->max_sets = MD_MAX_UNIFORM_SETS;
-    this->pool_count = 0;
-    this->device = device;
+    VkQueryPool pool = render_graph.stats_pools[render_graph.query_frame % MD_FRAMES_IN_FLIGHT];
+    vkCmdResetQueryPool(buffer, pool, pass_index, 1);
+    vkCmdBeginQuery(buffer, pool, pass_index, 0);
+}
 
-    // TO-DO: Make this user configurable
-    sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;          sizes[0].descriptorCount = 4;
-    sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;          sizes[1].descriptorCount = 4;
-    sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;           sizes[2].descriptorCount = 4;
-    sizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;  sizes[3].descriptorCount = 4;
+void mdRenderGraphEndStatistics(u32 pass_index, VkCommandBuffer buffer)
+{
+    if (!mdRenderGraphCountsStatistics(pass_index))
+        return;
 
-    // Create the first pool
-    return CreatePool();
+    u32 frame = render_graph.query_frame % MD_FRAMES_IN_FLIGHT;
+    vkCmdEndQuery(buffer, render_graph.stats_pools[frame], pass_index);
+    render_graph.stats_written[frame] |= (1ull << pass_index);
 }
 
-VkResult MdDescriptorAllocator::GetPool(VkDescriptorPool *p_pool)
+u32 mdRenderGraphGetPassStatistics(const std::string &pass, MdPipelineStatistics *p_last, MdPipelineStatistics *p_average)
 {
-    for (u32 i=0; i<pool_count; i++)
+    u32 index = mdFindRenderPass(pass);
+    if (index == UINT32_MAX)
     {
-        if (pools[i].status == AVAILABLE)
-        {
-            *p_pool = pools[i].pool;
-            return VK_SUCCESS;
-        }
+        LOG_ERROR("pass with id \"%s\" does not exist", pass.c_str());
+        return 0;
     }
 
-    return CreatePool(p_pool);
-}
-
-VkResult MdDescriptorAllocator::CreatePool(VkDescriptorPool *p_pool)
-{
-    VkDescriptorPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
-    pool_info.poolSizeCount = sizes.size();
-    pool_info.pPoolSizes = sizes.data();
-    pool_info.flags = 0;
-    pool_info.maxSets = max_sets;
+    MdRenderPassEntry *p_entry = &render_graph.passes[index];
+    if (p_last != NULL)
+        *p_last = p_entry->stats_last;
     
-    VkDescriptorPool pool;
-    VkResult result = vkCreateDescriptorPool(this->device, &pool_info, NULL, &pool);
-    if (result != VK_SUCCESS) return result;
-
-    if (pool_count >= pools.size())
+    if (p_average != NULL)
     {
-        pools.reserve(pool_count + MD_UNIFORM_POOL_BLOCK_SIZE);
-        for (u32 i=0; i<MD_UNIFORM_POOL_BLOCK_SIZE; i++)
-        {
-            pools.push_back({
-                .status = UNALLOCATED,
-                .pool = VK_NULL_HANDLE
-            });
-        }
+        u64 frames = MAX_VAL(p_entry->stats_frames, 1u);
+        p_average->ia_vertices = p_entry->stats_total.ia_vertices / frames;
+        p_average->ia_primitives = p_entry->stats_total.ia_primitives / frames;
+        p_average->vs_invocations = p_entry->stats_total.vs_invocations / frames;
+        p_average->clipping_invocations = p_entry->stats_total.clipping_invocations / frames;
+        p_average->clipping_primitives = p_entry->stats_total.clipping_primitives / frames;
+        p_average->fs_invocations = p_entry->stats_total.fs_invocations / frames;
     }
 
-    pools[pool_count].status = AVAILABLE;
-    pools[pool_count].pool = pool;
-    pool_count++;
-
-    if (p_pool != NULL)
-        *p_pool = pool;
-    
-    return result;
+    return p_entry->stats_frames;
 }
 
-bool MdDescriptorAllocator::ResetPools(u32 index)
+void mdRenderGraphPrintPassStatistics()
 {
-    for (u32 i=0; i<pool_count; i++)
+    for (u32 n=0; n<render_graph.compiled_count; n++)
     {
-        if (pools[i].status == UNALLOCATED)
+        MdRenderPassEntry *p_entry = &render_graph.passes[render_graph.compiled_nodes[n].index];
+        if (p_entry->stats_frames == 0)
             continue;
         
-        VkResult result = vkResetDescriptorPool(
-            this->device, 
-            this->pools[i].pool, 
-            0
+        MdPipelineStatistics average;
+        mdRenderGraphGetPassStatistics(p_entry->id, NULL, &average);
+        printf(
+            "Pass \"%s\": %lu vertices, %lu primitives, %lu vertex invocations, "
+            "%lu/%lu primitives clipped in/out, %lu fragment invocations, average over %d frames\n", 
+            p_entry->id.c_str(), 
+            average.ia_vertices, 
+            average.ia_primitives, 
+            average.vs_invocations, 
+            average.clipping_invocations, 
+            average.clipping_primitives, 
+            average.fs_invocations, 
+            p_entry->stats_frames
         );
-        if (result != VK_SUCCESS) return result;
     }
-
-    return VK_SUCCESS;
 }
-    
-VkResult MdDescriptorAllocator::AllocateSets(VkDescriptorSetLayout layout, u32 set_index, u32 size, VkDescriptorSet *p_sets)
-{
-    VkDescriptorPool pool = VK_NULL_HANDLE;
-    VkResult result = GetPool(&pool);
-    if (result != VK_SUCCESS) return result;
+#pragma endregion
 
-    // Allocate memory for layout and set list, because Vulkan expects an array of each
-    std::vector<VkDescriptorSetLayout> layouts;
-    layouts.reserve(size);
-    for (u32 i=0; i<size; i++) layouts.push_back(layout);
+// Every query a pass takes part in, written into its own command buffer outside of any render pass
+void mdRenderGraphBeginPassQueries(u32 pass_index, VkCommandBuffer buffer)
+{
+    mdRenderGraphWriteTimestamp(pass_index, buffer, false);
+    mdRenderGraphBeginStatistics(pass_index, buffer);
+}
 
-    // Allocate descriptor sets    
-    VkDescriptorSetAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
-    alloc_info.descriptorPool = pool;
-    alloc_info.descriptorSetCount = size;
-    alloc_info.pSetLayouts = layouts.data();
+void mdRenderGraphEndPassQueries(u32 pass_index, VkCommandBuffer buffer)
+{
+    mdRenderGraphEndStatistics(pass_index, buffer);
+    mdRenderGraphWriteTimestamp(pass_index, buffer, true);
+}
 
-    // Allocate the descriptor sets
-    result = vkAllocateDescriptorSets(this->device, &alloc_info, p_sets);
-    
-    // If the pool has reached capacity, make a new one
-    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+VkResult mdPrimeRenderGraph()
+{
+    MD_PROFILE_SCOPE("mdPrimeRenderGraph");
+    VkResult result = VK_SUCCESS;
+    if (render_graph.pool == VK_NULL_HANDLE)
     {
-        result = CreatePool(&pool);
+        result = mdRenderGraphCreatePool(renderer_state.graphics_queue.queue_index, &render_graph.pool);
         if (result != VK_SUCCESS) return result;
-
-        alloc_info.descriptorPool = pool;
-        result = vkAllocateDescriptorSets(this->device, &alloc_info, p_sets);
-        
-        // If we are still failing to allocate descriptor sets, then exit early
-        if (result != VK_SUCCESS) return result;    
     }
-    
-    // If there are still errors, exit
-    if (result != VK_SUCCESS)
+
+    // Called once per frame, so this is where the query pools move forward
+    render_graph.query_frame++;
+    mdRenderGraphBeginTimestampFrame();
+    mdRenderGraphBeginStatisticsFrame();
+
+    if (!render_graph.build_buffers)
+        return result;
+
+    // Async compute passes record into a pool on the compute queue's family
+    for (u32 i=0; i<render_graph.compiled_count; i++)
+    {
+        u32 pass_index = render_graph.compiled_nodes[i].index;
+        MdRenderPassEntry *p_entry = &render_graph.passes[pass_index];
+
+        VkCommandPool *p_pool = &render_graph.pool;
+        if (mdRenderGraphGetPassFamily(pass_index) != renderer_state.graphics_queue.queue_index)
+        {
+            p_pool = &render_graph.compute_pool;
+            if (*p_pool == VK_NULL_HANDLE)
+            {
+                result = mdRenderGraphCreatePool(renderer_state.compute_queue.queue_index, p_pool);
+                if (result != VK_SUCCESS) return result;
+            }
+        }
+
+        if (p_entry->buffer != VK_NULL_HANDLE)
+        {
+            if (p_entry->buffer_pool == *p_pool)
+                continue;
+            
+            vkFreeCommandBuffers(render_graph.device, p_entry->buffer_pool, 1, &p_entry->buffer);
+        }
+
+        VkCommandBufferAllocateInfo buffer_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        buffer_info.commandBufferCount = 1;
+        buffer_info.commandPool = *p_pool;
+        buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+        result = vkAllocateCommandBuffers(render_graph.device, &buffer_info, &p_entry->buffer);
+        VK_CHECK(result, "failed to create command buffers");
+        p_entry->buffer_pool = *p_pool;
+    }
+
+    render_graph.build_buffers = false;
+    return result;
+}
+
+usize mdGetCommandBufferCount() { return render_graph.compiled_count; }
+
+VkResult mdRenderGraphResetBuffers()
+{
+    VkResult result = vkResetCommandPool(render_graph.device, render_graph.pool, 0);
+    if (result != VK_SUCCESS || render_graph.compute_pool == VK_NULL_HANDLE)
+        return result;
+
+    return vkResetCommandPool(render_graph.device, render_graph.compute_pool, 0);
+}
+
+void mdExecuteRenderPass(const std::vector<VkClearValue> &values, const std::string &pass, u32 fb_index)
+{
+    bool found = false;
+    auto it=render_graph.passes.begin();
+    u32 pass_index = 0;
+    
+    while (it != render_graph.passes.end())
+    {
+        if (it->id != pass) 
+        {
+            it++;
+            pass_index++;
+            continue;
+        }
+        found = true;
+        break;
+    }
+    
+    if (!found)
+    {
+        LOG_ERROR("pass with id \"%s\" does not exist", pass.c_str());
+        return;
+    }
+
+    // Merged passes are recorded along with their parent
+    if (render_graph.passes[pass_index].merged_parent != UINT32_MAX)
+        return;
+
+    if (render_graph.passes[pass_index].pass == VK_NULL_HANDLE && 
+        render_graph.passes[pass_index].queue == MD_RENDER_PASS_QUEUE_GRAPHICS && 
+        render_graph.backend == MD_RENDER_GRAPH_BACKEND_RENDER_PASS)
+    {
+        LOG_ERROR("pass with id \"%s\" has not been built yet", pass.c_str());
+        return;
+    }
+
+    mdExecuteRenderPass(values, pass_index, fb_index);
+}
+
+void mdRenderGraphImageBarrier(VkCommandBuffer buffer, 
+                                VkImage image, 
+                                VkImageAspectFlags aspect,
+                                VkImageLayout src_layout, 
+                                VkImageLayout dst_layout, 
+                                VkAccessFlags src_access,
+                                VkAccessFlags dst_access,
+                                VkPipelineStageFlags src_stage,
+                                VkPipelineStageFlags dst_stage,
+                                u32 src_family = VK_QUEUE_FAMILY_IGNORED,
+                                u32 dst_family = VK_QUEUE_FAMILY_IGNORED)
+{
+    VkImageMemoryBarrier image_barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    image_barrier.image = image;
+    image_barrier.srcQueueFamilyIndex = src_family;
+    image_barrier.dstQueueFamilyIndex = dst_family;
+    image_barrier.oldLayout = src_layout;
+    image_barrier.newLayout = dst_layout;
+    image_barrier.srcAccessMask = src_access;
+    image_barrier.dstAccessMask = dst_access;
+    image_barrier.subresourceRange = {aspect, 0, 1, 0, 1};
+
+    vkCmdPipelineBarrier(buffer, src_stage, dst_stage, 0, 0, NULL, 0, NULL, 1, &image_barrier);
+}
+
+// Records a pass with vkCmdBeginRendering. Clear values are indexed the same way as 
+// the render pass backend (by output attachment order), and the layout transitions that 
+// a render pass would do implicitly are done with explicit barriers.
+void mdRenderGraphRecordDynamic(const std::vector<VkClearValue> &values, u32 pass_index, u32 fb_index, VkCommandBuffer buffer)
+{
+    MdRenderPassEntry *p_entry = &render_graph.passes[pass_index];
+
+    VkRenderingAttachmentInfo color_info = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    VkRenderingAttachmentInfo depth_info = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    bool has_color = false, has_depth = false;
+
+    VkRenderingInfo rendering_info = {VK_STRUCTURE_TYPE_RENDERING_INFO};
+    rendering_info.renderArea.offset = {0,0};
+    rendering_info.renderArea.extent = p_entry->extent;
+    rendering_info.layerCount = 1;
+    rendering_info.viewMask = 0;
+
+    VkImage swapchain_image = VK_NULL_HANDLE;
+    if (p_entry->is_swapchain_output)
+    {
+        swapchain_image = render_graph.p_context->sw_images[fb_index];
+        mdRenderGraphImageBarrier(
+            buffer, 
+            swapchain_image, 
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, 
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 
+            0, 
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+        );
+
+        has_color = true;
+        color_info.imageView = render_graph.p_context->sw_image_views[fb_index];
+        color_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        color_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+    else
+    {
+        for (u32 o=0; o<p_entry->output_attachments.size(); o++)
+        {
+            auto att_it = attachment_list.attachments.find(p_entry->output_attachments[o]);
+            if (att_it == attachment_list.attachments.end())
+                continue;
+            
+            VkClearValue clear = (o < values.size()) ? values[o] : VkClearValue{};
+            MdGPUTexture *p_texture = &att_it->second.texture;
+            if (att_it->second.type == MD_ATTACHMENT_TYPE_COLOR && !has_color)
+            {
+                has_color = true;
+                mdTransitionImageLayout(
+                    *p_texture, 
+                    VK_IMAGE_LAYOUT_UNDEFINED, 
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 
+                    0, 
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+                    buffer
+                );
+                color_info.imageView = p_texture->image_view;
+                color_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                color_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                color_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                color_info.clearValue = clear;
+            }
+            else if (att_it->second.type == MD_ATTACHMENT_TYPE_DEPTH && !has_depth)
+            {
+                has_depth = true;
+                mdTransitionImageLayout(
+                    *p_texture, 
+                    VK_IMAGE_LAYOUT_UNDEFINED, 
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 
+                    0, 
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, 
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 
+                    buffer
+                );
+                depth_info.imageView = p_texture->image_view;
+                depth_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+                depth_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                depth_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                depth_info.clearValue = clear;
+            }
+        }
+    }
+
+    rendering_info.colorAttachmentCount = (has_color) ? 1 : 0;
+    rendering_info.pColorAttachments = (has_color) ? &color_info : NULL;
+    rendering_info.pDepthAttachment = (has_depth) ? &depth_info : NULL;
+    rendering_info.pStencilAttachment = NULL;
+
+    vkCmdBeginRendering(buffer, &rendering_info);
+
+    if (p_entry->record != NULL)
+        p_entry->record(buffer, VK_NULL_HANDLE);
+
+    vkCmdEndRendering(buffer);
+
+    if (swapchain_image != VK_NULL_HANDLE)
+    {
+        bool present = (mdRenderGraphOutputLayout() == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        mdRenderGraphImageBarrier(
+            buffer, 
+            swapchain_image, 
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 
+            mdRenderGraphOutputLayout(), 
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 
+            (present) ? 0 : VK_ACCESS_TRANSFER_READ_BIT, 
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+            (present) ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT
+        );
+    }
+}
+
+u32 mdRenderGraphFindProducer(const std::string &attachment)
+{
+    for (u32 n=0; n<render_graph.compiled_count; n++)
+    {
+        u32 pass_index = render_graph.compiled_nodes[n].index;
+        if (mdContainsAttachment(render_graph.passes[pass_index].output_attachments, attachment))
+            return pass_index;
+    }
+    return UINT32_MAX;
+}
+
+// Layout, access and stage an attachment is left in by the pass that writes it
+void mdRenderGraphGetWriteState(MdRenderPassAttachmentType type, VkImageLayout *p_layout, VkAccessFlags *p_access, VkPipelineStageFlags *p_stage)
+{
+    switch (type)
+    {
+        case MD_ATTACHMENT_TYPE_COLOR:
+            *p_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            *p_access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            *p_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            break;
+        case MD_ATTACHMENT_TYPE_DEPTH:
+            *p_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            *p_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            *p_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            break;
+        case MD_ATTACHMENT_TYPE_STORAGE:
+            *p_layout = VK_IMAGE_LAYOUT_GENERAL;
+            *p_access = VK_ACCESS_SHADER_WRITE_BIT;
+            *p_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            break;
+    }
+}
+
+VkPipelineStageFlags mdRenderGraphGetReadStage(u32 pass_index)
+{
+    return (render_graph.passes[pass_index].queue == MD_RENDER_PASS_QUEUE_GRAPHICS)
+        ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+        : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+}
+
+// Transitions inputs to SHADER_READ_ONLY_OPTIMAL. If the producer ran on another queue family, 
+// this is the acquire half of the ownership transfer, the semaphore wait covers the read stage.
+void mdRenderGraphInsertInputBarriers(u32 pass_index, VkCommandBuffer buffer)
+{
+    auto input_ptr = &render_graph.passes[pass_index];
+    u32 family = mdRenderGraphGetPassFamily(pass_index);
+    VkPipelineStageFlags read_stage = mdRenderGraphGetReadStage(pass_index);
+
+    for (u32 i=0; i<input_ptr->input_attachments.size(); i++)
+    {
+        // Local inputs of a merged pass are synchronized by the subpass dependency
+        if (input_ptr->merged_parent != UINT32_MAX && 
+            mdContainsAttachment(input_ptr->local_inputs, input_ptr->input_attachments[i]))
+            continue;
+
+        // Insert the barrier if there is one for this resource
+        auto it = attachment_list.barriers.find(input_ptr->input_attachments[i]);
+        if (it == attachment_list.barriers.end())
+            continue;
+
+        // TO-DO: make barrier inserts more intelligent
+        auto att_ptr = &attachment_list.attachments[input_ptr->input_attachments[i]];
+        VkImageLayout src_layout;
+        VkAccessFlags src_access;
+        VkPipelineStageFlags src_stage;
+        mdRenderGraphGetWriteState(it->second.type, &src_layout, &src_access, &src_stage);
+
+        u32 producer = mdRenderGraphFindProducer(input_ptr->input_attachments[i]);
+        u32 src_family = (producer != UINT32_MAX) ? mdRenderGraphGetPassFamily(producer) : family;
+        if (src_family == family)
+        {
+            mdTransitionImageLayout(
+                att_ptr->texture, 
+                src_layout, 
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
+                src_access, 
+                VK_ACCESS_SHADER_READ_BIT, 
+                src_stage, 
+                read_stage, 
+                buffer
+            );
+            continue;
+        }
+
+        mdRenderGraphImageBarrier(
+            buffer, 
+            att_ptr->texture.image, 
+            att_ptr->texture.subresource.aspectMask, 
+            src_layout, 
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
+            0, 
+            VK_ACCESS_SHADER_READ_BIT, 
+            read_stage, 
+            read_stage, 
+            src_family, 
+            family
+        );
+    }
+}
+
+// Release half of the ownership transfer for outputs read by a pass on another queue family.
+// An attachment read on another family should only be read there.
+void mdRenderGraphInsertReleaseBarriers(u32 pass_index, VkCommandBuffer buffer)
+{
+    auto output_ptr = &render_graph.passes[pass_index];
+    u32 family = mdRenderGraphGetPassFamily(pass_index);
+
+    for (u32 o=0; o<output_ptr->output_attachments.size(); o++)
+    {
+        const std::string &name = output_ptr->output_attachments[o];
+        for (u32 n=0; n<render_graph.compiled_count; n++)
+        {
+            u32 consumer = render_graph.compiled_nodes[n].index;
+            u32 dst_family = mdRenderGraphGetPassFamily(consumer);
+            if (dst_family == family || !mdContainsAttachment(render_graph.passes[consumer].input_attachments, name))
+                continue;
+
+            auto att_ptr = &attachment_list.attachments[name];
+            VkImageLayout src_layout;
+            VkAccessFlags src_access;
+            VkPipelineStageFlags src_stage;
+            mdRenderGraphGetWriteState(att_ptr->type, &src_layout, &src_access, &src_stage);
+
+            mdRenderGraphImageBarrier(
+                buffer, 
+                att_ptr->texture.image, 
+                att_ptr->texture.subresource.aspectMask, 
+                src_layout, 
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
+                src_access, 
+                0, 
+                src_stage, 
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 
+                family, 
+                dst_family
+            );
+            break;
+        }
+    }
+}
+
+// Compute passes transition their storage outputs, dispatch, and release anything read on another queue
+void mdRenderGraphRecordCompute(u32 pass_index, VkCommandBuffer buffer)
+{
+    MdRenderPassEntry *p_entry = &render_graph.passes[pass_index];
+    for (u32 o=0; o<p_entry->output_attachments.size(); o++)
+    {
+        auto att_it = attachment_list.attachments.find(p_entry->output_attachments[o]);
+        if (att_it == attachment_list.attachments.end())
+            continue;
+        
+        mdTransitionImageLayout(
+            att_it->second.texture, 
+            VK_IMAGE_LAYOUT_UNDEFINED, 
+            VK_IMAGE_LAYOUT_GENERAL, 
+            0, 
+            VK_ACCESS_SHADER_WRITE_BIT, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+            buffer
+        );
+    }
+
+    if (p_entry->record != NULL)
+        p_entry->record(buffer, VK_NULL_HANDLE);
+}
+
+void mdExecuteRenderPass(const std::vector<VkClearValue> &values, u32 index, u32 fb_index)
+{
+    MD_PROFILE_SCOPE("mdExecuteRenderPass");
+    if (index >= render_graph.compiled_count)
+    {
+        LOG_ERROR("index cannot be greater than or equal to the number of passes in the graph");
+        return;
+    }
+
+    // Get the index of the current and previous pass
+    u32 pass_index_1 = (((i32)index-1) >= 0) 
+        ? render_graph.compiled_nodes[index-1].index
+        : 0;
+    u32 pass_index = render_graph.compiled_nodes[index].index;
+
+    // Merged passes are recorded along with their parent
+    if (render_graph.passes[pass_index].merged_parent != UINT32_MAX)
+        return;
+
+    // Get the command buffer
+    VkCommandBuffer buffer = render_graph.passes[pass_index].buffer;
+    VkFramebuffer fb = (render_graph.backend == MD_RENDER_GRAPH_BACKEND_RENDER_PASS)
+        ? render_graph.passes[pass_index].framebuffers[fb_index]
+        : VK_NULL_HANDLE;
+    
+    VkCommandBufferBeginInfo info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    info.pInheritanceInfo = NULL;
+    VkResult result = vkBeginCommandBuffer(buffer, &info);
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("failed to begin command buffer for pass \"%s\"", render_graph.passes[pass_index].id.c_str());
+        return;
+    }
+
+    mdRenderGraphBeginPassQueries(pass_index, buffer);
+
+    // Insert barriers as needed, a merged child's inputs are all read inside this render pass
+    mdRenderGraphInsertInputBarriers(pass_index, buffer);
+    if (render_graph.passes[pass_index].merged_child != UINT32_MAX)
+        mdRenderGraphInsertInputBarriers(render_graph.passes[pass_index].merged_child, buffer);
+
+    if (render_graph.passes[pass_index].queue != MD_RENDER_PASS_QUEUE_GRAPHICS)
+    {
+        mdRenderGraphRecordCompute(pass_index, buffer);
+        mdRenderGraphInsertReleaseBarriers(pass_index, buffer);
+        mdRenderGraphEndPassQueries(pass_index, buffer);
+        vkEndCommandBuffer(buffer);
+        return;
+    }
+
+    if (render_graph.backend == MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING)
+    {
+        mdRenderGraphRecordDynamic(values, pass_index, fb_index, buffer);
+        mdRenderGraphInsertReleaseBarriers(pass_index, buffer);
+        mdRenderGraphEndPassQueries(pass_index, buffer);
+        vkEndCommandBuffer(buffer);
+        return;
+    }
+
+    // Start the render pass
+    VkRenderPassBeginInfo begin_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+    begin_info.renderPass = render_graph.passes[pass_index].pass;
+    begin_info.renderArea.offset = {0,0};
+    begin_info.renderArea.extent = render_graph.passes[pass_index].extent;
+    begin_info.clearValueCount = values.size();
+    begin_info.pClearValues = values.data();
+
+    // A merged pass clears every attachment, the parent's outputs come first and take the values 
+    // given here, the child's take its own by output index (or these if it has none set)
+    u32 child_index = render_graph.passes[pass_index].merged_child;
+    VkClearValue merged_values[4] = {};
+    if (child_index != UINT32_MAX)
+    {
+        MdRenderPassEntry *p_parent = &render_graph.passes[pass_index];
+        MdRenderPassEntry *p_child = &render_graph.passes[child_index];
+        const std::vector<VkClearValue> &child_values = (p_child->clear_values.empty()) 
+            ? values 
+            : p_child->clear_values;
+
+        for (u32 i=0; i<p_parent->pass_attachments.size(); i++)
+        {
+            const std::string &name = p_parent->pass_attachments[i];
+            auto parent_it = std::find(p_parent->output_attachments.begin(), p_parent->output_attachments.end(), name);
+            if (parent_it != p_parent->output_attachments.end())
+            {
+                usize o = parent_it - p_parent->output_attachments.begin();
+                if (o < values.size())
+                    merged_values[i] = values[o];
+                continue;
+            }
+
+            auto child_it = std::find(p_child->output_attachments.begin(), p_child->output_attachments.end(), name);
+            usize o = child_it - p_child->output_attachments.begin();
+            if (child_it != p_child->output_attachments.end() && o < child_values.size())
+                merged_values[i] = child_values[o];
+        }
+
+        begin_info.clearValueCount = p_parent->pass_attachments.size();
+        begin_info.pClearValues = merged_values;
+    }
+    
+    begin_info.framebuffer = fb;
+
+    vkCmdBeginRenderPass(buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    if (render_graph.passes[pass_index].record != NULL)
+        render_graph.passes[pass_index].record(buffer, fb);
+
+    if (child_index != UINT32_MAX)
+    {
+        vkCmdNextSubpass(buffer, VK_SUBPASS_CONTENTS_INLINE);
+        if (render_graph.passes[child_index].record != NULL)
+            render_graph.passes[child_index].record(buffer, fb);
+    }
+
+    vkCmdEndRenderPass(buffer);
+    mdRenderGraphInsertReleaseBarriers(pass_index, buffer);
+    if (child_index != UINT32_MAX)
+        mdRenderGraphInsertReleaseBarriers(child_index, buffer);
+    mdRenderGraphEndPassQueries(pass_index, buffer);
+    vkEndCommandBuffer(buffer);
+}
+
+void mdRenderGraphSubmit(std::vector<VkCommandBuffer> &buffers, bool refill)
+{
+    // Populate the buffer if need be
+    if (refill)
+        buffers.clear();
+
+    if (refill || buffers.empty())
+    {
+        if (buffers.capacity() < render_graph.compiled_count)
+            buffers.reserve(render_graph.compiled_count);
+
+        for (i32 i=render_graph.compiled_count-1; i>=0; i--)
+        {
+            u32 pass_index = render_graph.compiled_nodes[i].index;
+            if (render_graph.passes[pass_index].merged_parent != UINT32_MAX)
+                continue;
+
+            buffers.push_back(render_graph.passes[pass_index].buffer);
+        }
+    }
+}
+
+// Splits the graph into batches of consecutive passes on the same queue, in execution order.
+// A batch waits on the timeline value of a batch from the other queue whose outputs it reads, 
+// unless an earlier batch on its own queue already waited on that value or a later one.
+VkResult mdRenderGraphSubmitFrame(  VkSemaphore wait_semaphore, 
+                                    VkPipelineStageFlags wait_stage, 
+                                    VkSemaphore signal_semaphore, 
+                                    u64 *p_frame_value)
+{
+    MD_PROFILE_SCOPE("mdRenderGraphSubmitFrame");
+    VkCommandBuffer buffers[64];
+    u32 batch_first[64], batch_count[64], batch_family[64];
+    u32 batch_of_pass[64];
+    u64 batch_value[64];
+    u32 batch_total = 0, buffer_count = 0, swapchain_batch = UINT32_MAX;
+
+    for (i32 i=render_graph.compiled_count-1; i>=0; i--)
+    {
+        u32 pass_index = render_graph.compiled_nodes[i].index;
+        MdRenderPassEntry *p_entry = &render_graph.passes[pass_index];
+        if (p_entry->merged_parent != UINT32_MAX)
+        {
+            batch_of_pass[pass_index] = batch_of_pass[p_entry->merged_parent];
+            continue;
+        }
+
+        u32 family = mdRenderGraphGetPassFamily(pass_index);
+        if (batch_total == 0 || batch_family[batch_total-1] != family)
+        {
+            batch_first[batch_total] = buffer_count;
+            batch_count[batch_total] = 0;
+            batch_family[batch_total] = family;
+            batch_total++;
+        }
+
+        if (p_entry->is_swapchain_output)
+            swapchain_batch = batch_total-1;
+        
+        batch_of_pass[pass_index] = batch_total-1;
+        batch_count[batch_total-1]++;
+        buffers[buffer_count++] = p_entry->buffer;
+    }
+
+    if (batch_total == 0)
+        return VK_SUCCESS;
+    if (swapchain_batch == UINT32_MAX)
+        swapchain_batch = batch_total-1;
+
+    // Find which batches have to wait on which
+    u64 waits_on[64] = {0};
+    for (u32 n=0; n<render_graph.compiled_count; n++)
+    {
+        u32 consumer = render_graph.compiled_nodes[n].index;
+        u32 dst_batch = batch_of_pass[consumer];
+        auto inputs = &render_graph.passes[consumer].input_attachments;
+        for (u32 i=0; i<inputs->size(); i++)
+        {
+            u32 producer = mdRenderGraphFindProducer((*inputs)[i]);
+            if (producer == UINT32_MAX)
+                continue;
+
+            u32 src_batch = batch_of_pass[producer];
+            if (batch_family[src_batch] != batch_family[dst_batch])
+                waits_on[dst_batch] |= (1ull << src_batch);
+        }
+    }
+
+    // Highest value of the other queue's timeline each queue has waited on, waits are cumulative. 
+    // Uploads signal the allocator's timeline, the first batch on each queue makes their writes visible
+    u64 waited[2] = {0, 0};
+    MdTimeline *p_upload_timeline = renderer_state.allocator.queue.p_timeline;
+    u64 upload_value = p_upload_timeline->upload_value.load(std::memory_order_acquire);
+
+    // Submit every batch in order, so that signals are always submitted before their waits
+    for (u32 b=0; b<batch_total; b++)
+    {
+        bool graphics = (batch_family[b] == renderer_state.graphics_queue.queue_index);
+        MdTimeline *p_timeline = (graphics) 
+            ? renderer_state.graphics_queue.p_timeline 
+            : renderer_state.compute_queue.p_timeline;
+        
+        MdTimelineWait waits[MD_TIMELINE_MAX_WAITS];
+        u32 wait_count = 0;
+        u32 queue_slot = (graphics) ? 0 : 1;
+        
+        u64 *p_upload_waited = &render_graph.upload_waited[queue_slot];
+        if (upload_value > *p_upload_waited)
+        {
+            waits[wait_count++] = {p_upload_timeline, upload_value, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+            *p_upload_waited = upload_value;
+        }
+
+        for (u32 w=0; w<b; w++)
+        {
+            if ((waits_on[b] & (1ull << w)) == 0 || batch_value[w] <= waited[queue_slot])
+                continue;
+            
+            if (wait_count == MD_TIMELINE_MAX_WAITS)
+            {
+                LOG_ERROR("render graph batch %d waits on too many batches", b);
+                return VK_ERROR_UNKNOWN;
+            }
+
+            MdTimeline *p_src = (batch_family[w] == renderer_state.graphics_queue.queue_index) 
+                ? renderer_state.graphics_queue.p_timeline 
+                : renderer_state.compute_queue.p_timeline;
+            VkPipelineStageFlags stage = (graphics) 
+                ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            waits[wait_count++] = {p_src, batch_value[w], stage};
+            waited[queue_slot] = MAX_VAL(waited[queue_slot], batch_value[w]);
+        }
+
+        bool last = (b == batch_total-1);
+        VkResult result = mdTimelineSubmit(
+            *p_timeline, 
+            batch_count[b], 
+            &buffers[batch_first[b]], 
+            wait_count, 
+            waits, 
+            (b == swapchain_batch) ? wait_semaphore : VK_NULL_HANDLE, 
+            wait_stage, 
+            (last) ? signal_semaphore : VK_NULL_HANDLE, 
+            &batch_value[b]
+        );
+        VK_CHECK(result, "failed to submit render graph batch %d", b);
+    }
+
+    if (p_frame_value != NULL)
+        *p_frame_value = batch_value[batch_total-1];
+
+    return VK_SUCCESS;
+}
+#pragma endregion
+
+#pragma region [ Material System ]
+#include <array>
+#define MD_UNIFORM_POOL_BLOCK_SIZE 128
+#define MD_MAX_UNIFORM_SETS 1024
+#define MD_DESCRIPTOR_TYPE_COUNT (VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT + 1)
+#define MD_DESCRIPTOR_ALLOCATE_BATCH 16
+enum MdDescriptorPoolStatus
+{
+    UNALLOCATED,
+    AVAILABLE,
+    FULL
+};
+
+struct MdDescriptorPool
+{
+    MdDescriptorPoolStatus status;
+    VkDescriptorPool pool;
+};
+
+struct MdDescriptorAllocator
+{
+    std::vector<MdDescriptorPool> pools;
+    std::vector<u32> free_pools;
+
+    // Descriptors of each type declared by the registered layouts, new pools are 
+    // sized so that max_sets sets of the average layout fit in them
+    std::array<u32, MD_DESCRIPTOR_TYPE_COUNT> demand;
+    u32 layout_count;
+    std::array<VkDescriptorPoolSize, MD_DESCRIPTOR_TYPE_COUNT> sizes;
+    u32 size_count;
+
+    u32 pool_count;
+    u32 max_sets;
+    VkDevice device;
+
+    VkResult Init(VkDevice device);
+    void RegisterLayout(const VkDescriptorSetLayoutBinding *p_bindings, u32 binding_count);
+    void UpdatePoolSizes();
+    VkResult GetPool(u32 *p_index);
+    VkResult CreatePool(u32 *p_index = NULL);
+    bool ResetPools();
+    
+    VkResult AllocateSets(VkDescriptorSetLayout layout, u32 size, VkDescriptorSet *p_sets);
+    void Destroy();
+    ~MdDescriptorAllocator(){};
+};
+
+VkResult MdDescriptorAllocator::Init(VkDevice device)
+{
+    // Initialize pools
+    pools.reserve(MD_UNIFORM_POOL_BLOCK_SIZE);
+    free_pools.reserve(MD_UNIFORM_POOL_BLOCK_SIZE);
+    for (u32 i=0; i<MD_UNIFORM_POOL_BLOCK_SIZE; i++)
+        pools.push_back({
+            .status = UNALLOCATED,
+            .pool = VK_NULL_HANDLE
+        });
+
+    this->max_sets = MD_MAX_UNIFORM_SETS;
+    this->pool_count = 0;
+    this->layout_count = 0;
+    this->device = device;
+    demand.fill(0);
+    UpdatePoolSizes();
+
+    // Pools are created on the first allocation, once layouts have been registered
+    return VK_SUCCESS;
+}
+
+void MdDescriptorAllocator::RegisterLayout(const VkDescriptorSetLayoutBinding *p_bindings, u32 binding_count)
+{
+    if (binding_count == 0)
+        return;
+    
+    for (u32 i=0; i<binding_count; i++)
+    {
+        if (p_bindings[i].descriptorType >= MD_DESCRIPTOR_TYPE_COUNT)
+            continue;
+        
+        demand[p_bindings[i].descriptorType] += p_bindings[i].descriptorCount;
+    }
+    layout_count++;
+    UpdatePoolSizes();
+}
+
+void MdDescriptorAllocator::UpdatePoolSizes()
+{
+    size_count = 0;
+    for (u32 t=0; t<MD_DESCRIPTOR_TYPE_COUNT; t++)
+    {
+        if (demand[t] == 0)
+            continue;
+        
+        // Average descriptors per set times the number of sets, rounded up
+        u64 count = ((u64)demand[t] * max_sets + layout_count - 1) / layout_count;
+        sizes[size_count].type = (VkDescriptorType)t;
+        sizes[size_count].descriptorCount = (u32)count;
+        size_count++;
+    }
+
+    // Nothing registered yet, fall back to a small general purpose mix
+    if (size_count == 0)
+    {
+        sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;          sizes[0].descriptorCount = 4;
+        sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;          sizes[1].descriptorCount = 4;
+        sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;           sizes[2].descriptorCount = 4;
+        sizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;  sizes[3].descriptorCount = 4;
+        sizes[4].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;        sizes[4].descriptorCount = 4;
+        size_count = 5;
+    }
+}
+
+VkResult MdDescriptorAllocator::GetPool(u32 *p_index)
+{
+    // Pools that aren't full sit on the free list, the most recent one is tried first
+    if (!free_pools.empty())
+    {
+        *p_index = free_pools.back();
+        return VK_SUCCESS;
+    }
+
+    return CreatePool(p_index);
+}
+
+VkResult MdDescriptorAllocator::CreatePool(u32 *p_index)
+{
+    VkDescriptorPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    pool_info.poolSizeCount = size_count;
+    pool_info.pPoolSizes = sizes.data();
+    pool_info.flags = 0;
+    pool_info.maxSets = max_sets;
+    
+    VkDescriptorPool pool;
+    VkResult result = vkCreateDescriptorPool(this->device, &pool_info, NULL, &pool);
+    if (result != VK_SUCCESS) return result;
+
+    if (pool_count >= pools.size())
+    {
+        pools.reserve(pool_count + MD_UNIFORM_POOL_BLOCK_SIZE);
+        for (u32 i=0; i<MD_UNIFORM_POOL_BLOCK_SIZE; i++)
+        {
+            pools.push_back({
+                .status = UNALLOCATED,
+                .pool = VK_NULL_HANDLE
+            });
+        }
+    }
+
+    pools[pool_count].status = AVAILABLE;
+    pools[pool_count].pool = pool;
+    free_pools.push_back(pool_count);
+
+    if (p_index != NULL)
+        *p_index = pool_count;
+    
+    pool_count++;
+    return result;
+}
+
+bool MdDescriptorAllocator::ResetPools()
+{
+    free_pools.clear();
+    for (u32 i=0; i<pool_count; i++)
+    {
+        if (pools[i].status == UNALLOCATED)
+            continue;
+        
+        VkResult result = vkResetDescriptorPool(
+            this->device, 
+            this->pools[i].pool, 
+            0
+        );
+        if (result != VK_SUCCESS) return false;
+
+        pools[i].status = AVAILABLE;
+        free_pools.push_back(i);
+    }
+
+    return true;
+}
+    
+VkResult MdDescriptorAllocator::AllocateSets(VkDescriptorSetLayout layout, u32 size, VkDescriptorSet *p_sets)
+{
+    // Vulkan expects one layout per set, allocate in fixed size batches so this never hits the heap
+    std::array<VkDescriptorSetLayout, MD_DESCRIPTOR_ALLOCATE_BATCH> layouts;
+    layouts.fill(layout);
+
+    VkResult result = VK_SUCCESS;
+    for (u32 first=0; first<size; first+=MD_DESCRIPTOR_ALLOCATE_BATCH)
+    {
+        VkDescriptorSetAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        alloc_info.descriptorSetCount = MIN_VAL(size - first, (u32)MD_DESCRIPTOR_ALLOCATE_BATCH);
+        alloc_info.pSetLayouts = layouts.data();
+
+        // If a pool has reached capacity, take it off the free list and move on to the next one
+        do
+        {
+            // A freshly made pool that can't fit the sets never will
+            bool fresh = free_pools.empty();
+            u32 index = 0;
+            result = GetPool(&index);
+            if (result != VK_SUCCESS) return result;
+
+            alloc_info.descriptorPool = pools[index].pool;
+            result = vkAllocateDescriptorSets(this->device, &alloc_info, &p_sets[first]);
+            if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+            {
+                pools[index].status = FULL;
+                free_pools.pop_back();
+                if (fresh)
+                    return result;
+            }
+        } while (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL);
+        
+        // If there are still errors, exit
+        if (result != VK_SUCCESS)
+            return result;
+    }
+
+    return result;
+}
+
+void MdDescriptorAllocator::Destroy()
+{
+    for (u32 i=0; i<pool_count; i++)
+    {
+        if (pools[i].status == UNALLOCATED)
+            continue;
+        
+        vkDestroyDescriptorPool(this->device, pools[i].pool, NULL);
+        pools[i].status = UNALLOCATED;
+        pools[i].pool = VK_NULL_HANDLE;
+    }
+    free_pools.clear();
+    pool_count = 0;
+}
+
+MdDescriptorAllocator uniform_allocator;
+
+// Transient descriptors only live for one frame, so each frame in flight allocates them 
+// linearly from its own arena, and the whole arena is reset once that frame's timeline value completes
+#define MD_TRANSIENT_DESCRIPTOR_SETS 256
+struct MdDescriptorArena
+{
+    std::vector<VkDescriptorPool> pools;
+    u32 current;
+    u32 scale;
+};
+
+struct MdTransientDescriptors
+{
+    std::array<MdDescriptorArena, MD_FRAMES_IN_FLIGHT> arenas;
+    u32 frame;
+    VkDevice device;
+};
+MdTransientDescriptors transient_descriptors;
+
+VkResult mdCreateArenaPool(MdDescriptorArena &arena)
+{
+    // Same mix as the persistent pools, scaled up to the arena's peak usage
+    std::array<VkDescriptorPoolSize, MD_DESCRIPTOR_TYPE_COUNT> sizes;
+    u32 max_sets = MD_TRANSIENT_DESCRIPTOR_SETS * arena.scale;
+    for (u32 i=0; i<uniform_allocator.size_count; i++)
+    {
+        u64 count = (u64)uniform_allocator.sizes[i].descriptorCount * max_sets / uniform_allocator.max_sets;
+        sizes[i].type = uniform_allocator.sizes[i].type;
+        sizes[i].descriptorCount = MAX_VAL((u32)count, 1u);
+    }
+
+    VkDescriptorPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    pool_info.poolSizeCount = uniform_allocator.size_count;
+    pool_info.pPoolSizes = sizes.data();
+    pool_info.flags = 0;
+    pool_info.maxSets = max_sets;
+    
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkResult result = vkCreateDescriptorPool(transient_descriptors.device, &pool_info, NULL, &pool);
+    VK_CHECK(result, "failed to create transient descriptor pool");
+
+    arena.pools.push_back(pool);
+    return result;
+}
+
+void mdDestroyTransientDescriptors()
+{
+    for (u32 f=0; f<MD_FRAMES_IN_FLIGHT; f++)
+    {
+        MdDescriptorArena *p_arena = &transient_descriptors.arenas[f];
+        for (u32 i=0; i<p_arena->pools.size(); i++)
+            vkDestroyDescriptorPool(transient_descriptors.device, p_arena->pools[i], NULL);
+        p_arena->pools.clear();
+    }
+}
+
+VkResult mdBeginDescriptorFrame(u32 frame_index)
+{
+    transient_descriptors.frame = frame_index % MD_FRAMES_IN_FLIGHT;
+    MdDescriptorArena *p_arena = &transient_descriptors.arenas[transient_descriptors.frame];
+    p_arena->current = 0;
+
+    // If the arena overflowed last time, replace its pools with one big enough for the 
+    // peak, so resetting it stays a single vkResetDescriptorPool call
+    if (p_arena->pools.size() > 1)
+    {
+        p_arena->scale *= p_arena->pools.size();
+        for (u32 i=0; i<p_arena->pools.size(); i++)
+            vkDestroyDescriptorPool(transient_descriptors.device, p_arena->pools[i], NULL);
+        p_arena->pools.clear();
+        return mdCreateArenaPool(*p_arena);
+    }
+    
+    if (p_arena->pools.empty())
+        return mdCreateArenaPool(*p_arena);
+    
+    return vkResetDescriptorPool(transient_descriptors.device, p_arena->pools[0], 0);
+}
+
+VkResult mdAllocateTransientSet(VkDescriptorSetLayout layout, VkDescriptorSet *p_set)
+{
+    MdDescriptorArena *p_arena = &transient_descriptors.arenas[transient_descriptors.frame];
+
+    VkDescriptorSetAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+
+    VkResult result = VK_ERROR_OUT_OF_POOL_MEMORY;
+    while (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+    {
+        // Move on to the next pool once the current one is exhausted
+        bool fresh = (p_arena->current >= p_arena->pools.size());
+        if (fresh)
+        {
+            result = mdCreateArenaPool(*p_arena);
+            if (result != VK_SUCCESS) return result;
+        }
+
+        alloc_info.descriptorPool = p_arena->pools[p_arena->current];
+        result = vkAllocateDescriptorSets(transient_descriptors.device, &alloc_info, p_set);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+        {
+            if (fresh) return result;
+            p_arena->current++;
+        }
+    }
+
+    return result;
+}
+
+VkResult mdCreateDescriptorAllocator(MdRenderer &renderer)
+{
+    transient_descriptors.device = renderer.context->device;
+    transient_descriptors.frame = 0;
+    for (u32 f=0; f<MD_FRAMES_IN_FLIGHT; f++)
+    {
+        transient_descriptors.arenas[f].current = 0;
+        transient_descriptors.arenas[f].scale = 1;
+    }
+
+    return uniform_allocator.Init(renderer.context->device);
+}
+
+void mdDestroyDescriptorAllocator()
+{
+    mdDestroyTransientDescriptors();
+    uniform_allocator.Destroy();
+}
+
+// Layouts are shared between every pipeline declaring the same bindings, and 
+// destroyed when the last pipeline referencing them is destroyed
+struct MdSetLayoutCacheEntry
+{
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    VkDescriptorSetLayout layout;
+    u32 ref_count;
+
+    // Writes every binding of a set at once, from an MdDescriptorData array where each 
+    // binding starts at first_slot[binding index]
+    VkDescriptorUpdateTemplate update_template;
+    std::vector<u32> first_slot;
+    u32 slot_count;
+};
+
+struct MdPipelineLayoutCacheEntry
+{
+    std::vector<VkDescriptorSetLayout> set_layouts;
+    std::vector<VkPushConstantRange> push_constants;
+    VkPipelineLayout layout;
+    u32 ref_count;
+};
+
+struct MdLayoutCache
+{
+    std::multimap<u64, MdSetLayoutCacheEntry> set_layouts;
+    std::multimap<u64, MdPipelineLayoutCacheEntry> pipeline_layouts;
+    std::map<VkDescriptorSetLayout, MdSetLayoutCacheEntry*> set_layout_handles;
+};
+MdLayoutCache layout_cache;
+
+bool mdCompareBindings(const std::vector<VkDescriptorSetLayoutBinding> &a, const std::vector<VkDescriptorSetLayoutBinding> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    
+    for (usize i=0; i<a.size(); i++)
+    {
+        if (a[i].binding != b[i].binding || 
+            a[i].descriptorType != b[i].descriptorType || 
+            a[i].descriptorCount != b[i].descriptorCount || 
+            a[i].stageFlags != b[i].stageFlags || 
+            a[i].pImmutableSamplers != b[i].pImmutableSamplers)
+            return false;
+    }
+    return true;
+}
+
+u64 mdHashBindings(const std::vector<VkDescriptorSetLayoutBinding> &bindings)
+{
+    u64 hash = mdHashValue(bindings.size());
+    for (usize i=0; i<bindings.size(); i++)
+    {
+        hash = mdHashValue(bindings[i].binding, hash);
+        hash = mdHashValue(bindings[i].descriptorType, hash);
+        hash = mdHashValue(bindings[i].descriptorCount, hash);
+        hash = mdHashValue(bindings[i].stageFlags, hash);
+        hash = mdHashValue(bindings[i].pImmutableSamplers, hash);
+    }
+    return hash;
+}
+
+VkResult mdCreateSetUpdateTemplate(MdRenderer &renderer, MdSetLayoutCacheEntry &entry)
+{
+    entry.update_template = VK_NULL_HANDLE;
+    entry.first_slot.resize(entry.bindings.size());
+    entry.slot_count = 0;
+
+    std::vector<VkDescriptorUpdateTemplateEntry> template_entries;
+    template_entries.reserve(entry.bindings.size());
+    for (usize i=0; i<entry.bindings.size(); i++)
+    {
+        entry.first_slot[i] = entry.slot_count;
+        if (entry.bindings[i].descriptorCount == 0)
+            continue;
+        
+        template_entries.push_back({
+            .dstBinding = entry.bindings[i].binding,
+            .dstArrayElement = 0,
+            .descriptorCount = entry.bindings[i].descriptorCount,
+            .descriptorType = entry.bindings[i].descriptorType,
+            .offset = entry.slot_count * sizeof(MdDescriptorData),
+            .stride = sizeof(MdDescriptorData)
+        });
+        entry.slot_count += entry.bindings[i].descriptorCount;
+    }
+
+    if (template_entries.empty())
+        return VK_SUCCESS;
+    
+    VkDescriptorUpdateTemplateCreateInfo template_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO};
+    template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    template_info.descriptorSetLayout = entry.layout;
+    template_info.descriptorUpdateEntryCount = template_entries.size();
+    template_info.pDescriptorUpdateEntries = template_entries.data();
+
+    VkResult result = vkCreateDescriptorUpdateTemplate(renderer.context->device, &template_info, NULL, &entry.update_template);
+    VK_CHECK(result, "failed to create descriptor update template");
+    return result;
+}
+
+VkResult mdGetDescriptorSetLayout( MdRenderer &renderer, 
+                                    const std::vector<VkDescriptorSetLayoutBinding> &bindings, 
+                                    VkDescriptorSetLayout *p_layout)
+{
+    // Binding order doesn't change the layout, so sort a copy before hashing
+    std::vector<VkDescriptorSetLayoutBinding> sorted = bindings;
+    std::sort(sorted.begin(), sorted.end(), 
+        [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) { return a.binding < b.binding; }
+    );
+
+    u64 hash = mdHashBindings(sorted);
+    auto range = layout_cache.set_layouts.equal_range(hash);
+    for (auto it=range.first; it!=range.second; it++)
+    {
+        if (!mdCompareBindings(it->second.bindings, sorted))
+            continue;
+        
+        it->second.ref_count++;
+        *p_layout = it->second.layout;
+        return VK_SUCCESS;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    set_layout_info.bindingCount = sorted.size();
+    set_layout_info.pBindings = sorted.data();
+    set_layout_info.flags = 0;
+    VkResult result = vkCreateDescriptorSetLayout(renderer.context->device, &set_layout_info, NULL, p_layout);
+    VK_CHECK(result, "failed to create descriptor set layout");
+
+    auto entry_it = layout_cache.set_layouts.insert(std::pair(hash, MdSetLayoutCacheEntry{sorted, *p_layout, 1}));
+    layout_cache.set_layout_handles.insert(std::pair(*p_layout, &entry_it->second));
+    uniform_allocator.RegisterLayout(sorted.data(), sorted.size());
+
+    return mdCreateSetUpdateTemplate(renderer, entry_it->second);
+}
+
+void mdReleaseDescriptorSetLayout(MdRenderer &renderer, VkDescriptorSetLayout layout)
+{
+    for (auto it=layout_cache.set_layouts.begin(); it!=layout_cache.set_layouts.end(); it++)
+    {
+        if (it->second.layout != layout)
+            continue;
+        
+        if (--it->second.ref_count == 0)
+        {
+            if (it->second.update_template != VK_NULL_HANDLE)
+                vkDestroyDescriptorUpdateTemplate(renderer.context->device, it->second.update_template, NULL);
+            vkDestroyDescriptorSetLayout(renderer.context->device, layout, NULL);
+            layout_cache.set_layout_handles.erase(layout);
+            layout_cache.set_layouts.erase(it);
+        }
+        return;
+    }
+}
+
+bool mdComparePushConstants(const std::vector<VkPushConstantRange> &a, const std::vector<VkPushConstantRange> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    
+    for (usize i=0; i<a.size(); i++)
+    {
+        if (a[i].stageFlags != b[i].stageFlags || a[i].offset != b[i].offset || a[i].size != b[i].size)
+            return false;
+    }
+    return true;
+}
+
+VkResult mdGetPipelineLayout(   MdRenderer &renderer, 
+                                const VkDescriptorSetLayout *p_set_layouts, 
+                                u32 set_layout_count, 
+                                const std::vector<VkPushConstantRange> &push_constants, 
+                                VkPipelineLayout *p_layout)
+{
+    std::vector<VkDescriptorSetLayout> set_layouts(p_set_layouts, p_set_layouts + set_layout_count);
+    u64 hash = mdHashBytes(p_set_layouts, set_layout_count * sizeof(VkDescriptorSetLayout));
+    hash = mdHashBytes(push_constants.data(), push_constants.size() * sizeof(VkPushConstantRange), hash);
+    
+    auto range = layout_cache.pipeline_layouts.equal_range(hash);
+    for (auto it=range.first; it!=range.second; it++)
+    {
+        if (it->second.set_layouts != set_layouts || !mdComparePushConstants(it->second.push_constants, push_constants))
+            continue;
+        
+        it->second.ref_count++;
+        *p_layout = it->second.layout;
+        return VK_SUCCESS;
+    }
+
+    VkPipelineLayoutCreateInfo layout_info = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    layout_info.setLayoutCount = set_layout_count;
+    layout_info.pSetLayouts = p_set_layouts;
+    layout_info.flags = 0;
+    layout_info.pushConstantRangeCount = push_constants.size();
+    layout_info.pPushConstantRanges = push_constants.data();
+
+    VkResult result = vkCreatePipelineLayout(renderer.context->device, &layout_info, NULL, p_layout);
+    VK_CHECK(result, "failed to create pipeline layout");
+
+    layout_cache.pipeline_layouts.insert(std::pair(hash, MdPipelineLayoutCacheEntry{set_layouts, push_constants, *p_layout, 1}));
+    return result;
+}
+
+void mdReleasePipelineLayout(MdRenderer &renderer, VkPipelineLayout layout)
+{
+    for (auto it=layout_cache.pipeline_layouts.begin(); it!=layout_cache.pipeline_layouts.end(); it++)
+    {
+        if (it->second.layout != layout)
+            continue;
+        
+        if (--it->second.ref_count == 0)
+        {
+            vkDestroyPipelineLayout(renderer.context->device, layout, NULL);
+            layout_cache.pipeline_layouts.erase(it);
+        }
+        return;
+    }
+}
+
+void mdDestroyLayoutCache(MdRenderer &renderer)
+{
+    for (auto it=layout_cache.pipeline_layouts.begin(); it!=layout_cache.pipeline_layouts.end(); it++)
+        vkDestroyPipelineLayout(renderer.context->device, it->second.layout, NULL);
+    for (auto it=layout_cache.set_layouts.begin(); it!=layout_cache.set_layouts.end(); it++)
+    {
+        if (it->second.update_template != VK_NULL_HANDLE)
+            vkDestroyDescriptorUpdateTemplate(renderer.context->device, it->second.update_template, NULL);
+        vkDestroyDescriptorSetLayout(renderer.context->device, it->second.layout, NULL);
+    }
+    
+    layout_cache.pipeline_layouts.clear();
+    layout_cache.set_layouts.clear();
+    layout_cache.set_layout_handles.clear();
+}
+
+void mdBeginDescriptorWrites(MdDescriptorWriter &writer, VkDescriptorSet set, VkDescriptorSetLayout layout)
+{
+    // Clearing keeps the capacity, so a reused writer stops allocating after the first few sets
+    writer.set = set;
+    writer.layout = layout;
+    writer.writes.clear();
+    writer.data.clear();
+}
+
+void mdDescriptorWriterAdd(MdDescriptorWriter &writer, u32 binding, u32 array_element, VkDescriptorType type, const MdDescriptorData &data)
+{
+    writer.writes.push_back({binding, array_element, type});
+    writer.data.push_back(data);
+}
+
+void mdDescriptorWriterImage(MdDescriptorWriter &writer, u32 binding, MdGPUTexture &texture, VkImageLayout layout, u32 array_element)
+{
+    MdDescriptorData data = {};
+    data.image.imageLayout = layout;
+    data.image.imageView = texture.image_view;
+    data.image.sampler = texture.sampler;
+    mdDescriptorWriterAdd(writer, binding, array_element, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, data);
+}
+
+void mdDescriptorWriterInputAttachment(MdDescriptorWriter &writer, u32 binding, MdGPUTexture &texture)
+{
+    MdDescriptorData data = {};
+    data.image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    data.image.imageView = texture.image_view;
+    data.image.sampler = VK_NULL_HANDLE;
+    mdDescriptorWriterAdd(writer, binding, 0, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, data);
+}
+
+void mdDescriptorWriterBuffer(MdDescriptorWriter &writer, u32 binding, VkDescriptorType type, usize offset, usize range, MdGPUBuffer &buffer, u32 array_element)
+{
+    MdDescriptorData data = {};
+    data.buffer.buffer = buffer.buffer;
+    data.buffer.offset = offset;
+    data.buffer.range = range;
+    mdDescriptorWriterAdd(writer, binding, array_element, type, data);
+}
+
+void mdFlushDescriptorWrites(MdRenderer &renderer, MdDescriptorWriter &writer)
+{
+    if (writer.writes.empty())
+        return;
+    
+    // If every descriptor of a cached layout was written, the whole set goes through its template
+    auto handle_it = layout_cache.set_layout_handles.find(writer.layout);
+    if (handle_it != layout_cache.set_layout_handles.end() && handle_it->second->update_template != VK_NULL_HANDLE)
+    {
+        MdSetLayoutCacheEntry *p_entry = handle_it->second;
+        writer.blob.assign(p_entry->slot_count, {});
+        writer.filled.assign(p_entry->slot_count, 0);
+
+        u32 filled_count = 0;
+        for (usize w=0; w<writer.writes.size(); w++)
+        {
+            for (usize b=0; b<p_entry->bindings.size(); b++)
+            {
+                if (p_entry->bindings[b].binding != writer.writes[w].binding || 
+                    writer.writes[w].array_element >= p_entry->bindings[b].descriptorCount)
+                    continue;
+                
+                u32 slot = p_entry->first_slot[b] + writer.writes[w].array_element;
+                filled_count += (writer.filled[slot] == 0) ? 1 : 0;
+                writer.filled[slot] = 1;
+                writer.blob[slot] = writer.data[w];
+                break;
+            }
+        }
+
+        if (filled_count == p_entry->slot_count)
+        {
+            vkUpdateDescriptorSetWithTemplate(renderer.context->device, writer.set, p_entry->update_template, writer.blob.data());
+            writer.writes.clear();
+            writer.data.clear();
+            return;
+        }
+    }
+
+    // Partial update, still a single call for every accumulated write
+    writer.vk_writes.resize(writer.writes.size());
+    for (usize w=0; w<writer.writes.size(); w++)
+    {
+        VkWriteDescriptorSet *p_write = &writer.vk_writes[w];
+        *p_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        p_write->dstSet = writer.set;
+        p_write->dstBinding = writer.writes[w].binding;
+        p_write->dstArrayElement = writer.writes[w].array_element;
+        p_write->descriptorCount = 1;
+        p_write->descriptorType = writer.writes[w].type;
+        
+        switch (writer.writes[w].type)
+        {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                p_write->pBufferInfo = &writer.data[w].buffer;
+                break;
+            case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                p_write->pTexelBufferView = &writer.data[w].texel_buffer;
+                break;
+            default:
+                p_write->pImageInfo = &writer.data[w].image;
+                break;
+        }
+    }
+
+    vkUpdateDescriptorSets(renderer.context->device, writer.vk_writes.size(), writer.vk_writes.data(), 0, NULL);
+    writer.writes.clear();
+    writer.data.clear();
+}
+
+// Global bindless set, textures, samplers and storage buffers are registered once and 
+// referenced by index, so switching materials doesn't need a set rebind
+#define MD_BINDLESS_MAX_TEXTURES 16384
+#define MD_BINDLESS_MAX_SAMPLERS 256
+#define MD_BINDLESS_MAX_BUFFERS 8192
+enum MdBindlessBinding
+{
+    MD_BINDLESS_BINDING_TEXTURES,
+    MD_BINDLESS_BINDING_SAMPLERS,
+    MD_BINDLESS_BINDING_BUFFERS,
+    MD_BINDLESS_BINDING_COUNT
+};
+
+struct MdBindlessTable
+{
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+
+    // Next unused index and freed indices of every binding
+    std::array<u32, MD_BINDLESS_BINDING_COUNT> capacity;
+    std::array<u32, MD_BINDLESS_BINDING_COUNT> next;
+    std::array<std::vector<u32>, MD_BINDLESS_BINDING_COUNT> free_indices;
+
+    // Samplers by create info, the table owns them so textures with the same settings share one
+    std::map<std::vector<u8>, u32> samplers;
+    std::vector<std::vector<u8>> sampler_keys;
+    std::vector<VkSampler> sampler_handles;
+    std::vector<u32> sampler_refs;
+
+    // Textures by view and layout, with how many adds each index has outstanding
+    std::map<std::pair<VkImageView, VkImageLayout>, u32> textures;
+    std::vector<std::pair<VkImageView, VkImageLayout>> texture_keys;
+    std::vector<u32> texture_refs;
+};
+MdBindlessTable bindless_table;
+
+bool mdBindlessSupported(MdRenderContext &context)
+{
+    return  context.features_12.descriptorIndexing && 
+            context.features_12.runtimeDescriptorArray && 
+            context.features_12.descriptorBindingPartiallyBound && 
+            context.features_12.descriptorBindingSampledImageUpdateAfterBind && 
+            context.features_12.descriptorBindingStorageBufferUpdateAfterBind;
+}
+
+VkResult mdCreateBindlessTable(MdRenderer &renderer)
+{
+    if (!mdBindlessSupported(*renderer.context))
+    {
+        LOG_ERROR("descriptor indexing is not supported by this device, bindless tables are disabled");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    // Array sizes are limited by what the device can bind with update-after-bind
+    VkPhysicalDeviceVulkan12Properties props_12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+    VkPhysicalDeviceProperties2 props = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    props.pNext = &props_12;
+    vkGetPhysicalDeviceProperties2(renderer.context->physical_device, &props);
+
+    bindless_table.capacity[MD_BINDLESS_BINDING_TEXTURES] = MIN_VAL(
+        (u32)MD_BINDLESS_MAX_TEXTURES, 
+        MIN_VAL(props_12.maxDescriptorSetUpdateAfterBindSampledImages, props_12.maxPerStageDescriptorUpdateAfterBindSampledImages)
+    );
+    bindless_table.capacity[MD_BINDLESS_BINDING_SAMPLERS] = MIN_VAL(
+        (u32)MD_BINDLESS_MAX_SAMPLERS, 
+        MIN_VAL(props_12.maxDescriptorSetUpdateAfterBindSamplers, props_12.maxPerStageDescriptorUpdateAfterBindSamplers)
+    );
+    bindless_table.capacity[MD_BINDLESS_BINDING_BUFFERS] = MIN_VAL(
+        (u32)MD_BINDLESS_MAX_BUFFERS, 
+        MIN_VAL(props_12.maxDescriptorSetUpdateAfterBindStorageBuffers, props_12.maxPerStageDescriptorUpdateAfterBindStorageBuffers)
+    );
+
+    const VkDescriptorType types[MD_BINDLESS_BINDING_COUNT] = {
+        VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        VK_DESCRIPTOR_TYPE_SAMPLER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+    };
+
+    std::array<VkDescriptorSetLayoutBinding, MD_BINDLESS_BINDING_COUNT> bindings;
+    std::array<VkDescriptorBindingFlags, MD_BINDLESS_BINDING_COUNT> binding_flags;
+    std::array<VkDescriptorPoolSize, MD_BINDLESS_BINDING_COUNT> sizes;
+    for (u32 b=0; b<MD_BINDLESS_BINDING_COUNT; b++)
+    {
+        bindings[b] = {
+            .binding = b,
+            .descriptorType = types[b],
+            .descriptorCount = bindless_table.capacity[b],
+            .stageFlags = VK_SHADER_STAGE_ALL,
+            .pImmutableSamplers = NULL
+        };
+        binding_flags[b] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+        if (renderer.context->features_12.descriptorBindingUpdateUnusedWhilePending)
+            binding_flags[b] |= VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        
+        sizes[b] = {types[b], bindless_table.capacity[b]};
+        bindless_table.next[b] = 0;
+        bindless_table.free_indices[b].clear();
+    }
+    bindless_table.textures.clear();
+    bindless_table.texture_keys.assign(bindless_table.capacity[MD_BINDLESS_BINDING_TEXTURES], {});
+    bindless_table.texture_refs.assign(bindless_table.capacity[MD_BINDLESS_BINDING_TEXTURES], 0);
+    bindless_table.samplers.clear();
+    bindless_table.sampler_keys.assign(bindless_table.capacity[MD_BINDLESS_BINDING_SAMPLERS], {});
+    bindless_table.sampler_handles.assign(bindless_table.capacity[MD_BINDLESS_BINDING_SAMPLERS], VK_NULL_HANDLE);
+    bindless_table.sampler_refs.assign(bindless_table.capacity[MD_BINDLESS_BINDING_SAMPLERS], 0);
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+    flags_info.bindingCount = binding_flags.size();
+    flags_info.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    layout_info.pNext = &flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = bindings.size();
+    layout_info.pBindings = bindings.data();
+    VkResult result = vkCreateDescriptorSetLayout(renderer.context->device, &layout_info, NULL, &bindless_table.layout);
+    VK_CHECK(result, "failed to create bindless set layout");
+
+    VkDescriptorPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = sizes.size();
+    pool_info.pPoolSizes = sizes.data();
+    result = vkCreateDescriptorPool(renderer.context->device, &pool_info, NULL, &bindless_table.pool);
+    VK_CHECK(result, "failed to create bindless descriptor pool");
+
+    VkDescriptorSetAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    alloc_info.descriptorPool = bindless_table.pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &bindless_table.layout;
+    result = vkAllocateDescriptorSets(renderer.context->device, &alloc_info, &bindless_table.set);
+    VK_CHECK(result, "failed to allocate bindless set");
+
+    return result;
+}
+
+void mdDestroyBindlessTable(MdRenderer &renderer)
+{
+    if (bindless_table.pool != VK_NULL_HANDLE)
+        vkDestroyDescriptorPool(renderer.context->device, bindless_table.pool, NULL);
+    if (bindless_table.layout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(renderer.context->device, bindless_table.layout, NULL);
+    
+    for (VkSampler sampler : bindless_table.sampler_handles)
+        if (sampler != VK_NULL_HANDLE)
+            vkDestroySampler(renderer.context->device, sampler, NULL);
+
+    bindless_table.pool = VK_NULL_HANDLE;
+    bindless_table.layout = VK_NULL_HANDLE;
+    bindless_table.set = VK_NULL_HANDLE;
+    bindless_table.samplers.clear();
+    bindless_table.sampler_handles.clear();
+    bindless_table.textures.clear();
+}
+
+VkDescriptorSetLayout mdBindlessGetLayout() { return bindless_table.layout; }
+VkDescriptorSet mdBindlessGetSet() { return bindless_table.set; }
+
+u32 mdBindlessAcquireIndex(MdBindlessBinding binding)
+{
+    if (bindless_table.set == VK_NULL_HANDLE)
+        return UINT32_MAX;
+    
+    std::vector<u32> *p_free = &bindless_table.free_indices[binding];
+    if (!p_free->empty())
+    {
+        u32 index = p_free->back();
+        p_free->pop_back();
+        return index;
+    }
+
+    if (bindless_table.next[binding] >= bindless_table.capacity[binding])
+    {
+        LOG_ERROR("bindless binding %d is full (%d descriptors)", binding, bindless_table.capacity[binding]);
+        return UINT32_MAX;
+    }
+    return bindless_table.next[binding]++;
+}
+
+u32 mdBindlessAddTexture(MdRenderer &renderer, MdGPUTexture &texture, VkImageLayout layout)
+{
+    std::pair<VkImageView, VkImageLayout> key = {texture.image_view, layout};
+    auto it = bindless_table.textures.find(key);
+    if (it != bindless_table.textures.end())
+    {
+        bindless_table.texture_refs[it->second]++;
+        return it->second;
+    }
+
+    u32 index = mdBindlessAcquireIndex(MD_BINDLESS_BINDING_TEXTURES);
+    if (index == UINT32_MAX)
+        return index;
+
+    bindless_table.textures.insert(std::pair(key, index));
+    bindless_table.texture_keys[index] = key;
+    bindless_table.texture_refs[index] = 1;
+    
+    VkDescriptorImageInfo image_info = {};
+    image_info.imageLayout = layout;
+    image_info.imageView = texture.image_view;
+    image_info.sampler = VK_NULL_HANDLE;
+
+    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write_set.descriptorCount = 1;
+    write_set.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write_set.dstSet = bindless_table.set;
+    write_set.dstBinding = MD_BINDLESS_BINDING_TEXTURES;
+    write_set.dstArrayElement = index;
+    write_set.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+    return index;
+}
+
+u32 mdBindlessAddSampler(MdRenderer &renderer, const VkSamplerCreateInfo &sampler_info)
+{
+    if (sampler_info.pNext != NULL)
+    {
+        LOG_ERROR("bindless samplers can't have extension structs chained");
+        return UINT32_MAX;
+    }
+
+    // Textures usually share a handful of settings, everything after pNext is plain 32-bit 
+    // fields, so its bytes are the key
+    const u8 *p_first = (const u8*)&sampler_info.flags;
+    std::vector<u8> key(p_first, (const u8*)(&sampler_info + 1));
+    auto it = bindless_table.samplers.find(key);
+    if (it != bindless_table.samplers.end())
+    {
+        bindless_table.sampler_refs[it->second]++;
+        return it->second;
+    }
+    
+    u32 index = mdBindlessAcquireIndex(MD_BINDLESS_BINDING_SAMPLERS);
+    if (index == UINT32_MAX)
+        return index;
+    
+    VkSampler sampler;
+    VkResult result = vkCreateSampler(renderer.context->device, &sampler_info, NULL, &sampler);
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("failed to create bindless sampler");
+        bindless_table.free_indices[MD_BINDLESS_BINDING_SAMPLERS].push_back(index);
+        return UINT32_MAX;
+    }
+    
+    VkDescriptorImageInfo image_info = {};
+    image_info.sampler = sampler;
+
+    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write_set.descriptorCount = 1;
+    write_set.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    write_set.dstSet = bindless_table.set;
+    write_set.dstBinding = MD_BINDLESS_BINDING_SAMPLERS;
+    write_set.dstArrayElement = index;
+    write_set.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+    bindless_table.samplers.insert(std::pair(key, index));
+    bindless_table.sampler_keys[index] = std::move(key);
+    bindless_table.sampler_handles[index] = sampler;
+    bindless_table.sampler_refs[index] = 1;
+    return index;
+}
+
+u32 mdBindlessAddBuffer(MdRenderer &renderer, MdGPUBuffer &buffer, usize offset, usize range)
+{
+    u32 index = mdBindlessAcquireIndex(MD_BINDLESS_BINDING_BUFFERS);
+    if (index == UINT32_MAX)
+        return index;
+    
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = buffer.buffer;
+    buffer_info.offset = offset;
+    buffer_info.range = range;
+
+    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write_set.descriptorCount = 1;
+    write_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write_set.dstSet = bindless_table.set;
+    write_set.dstBinding = MD_BINDLESS_BINDING_BUFFERS;
+    write_set.dstArrayElement = index;
+    write_set.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+    return index;
+}
+
+// Frames in flight may still read the descriptor, so the index only goes back on the free list
+// once they complete
+void mdBindlessRetireIndex(MdBindlessBinding binding, u32 index)
+{
+    struct Payload { MdBindlessBinding binding; u32 index; };
+    Payload payload = {binding, index};
+    mdRetire([](void *p_payload){
+        Payload *p = (Payload*)p_payload;
+        bindless_table.free_indices[p->binding].push_back(p->index);
+    }, &payload, sizeof(payload));
+}
+
+void mdBindlessRemoveTexture(u32 index)
+{
+    if (index >= bindless_table.next[MD_BINDLESS_BINDING_TEXTURES] || bindless_table.texture_refs[index] == 0)
+        return;
+
+    if (--bindless_table.texture_refs[index] > 0)
+        return;
+
+    // Forgotten right away, the view could be destroyed and its handle reused before the index is free
+    bindless_table.textures.erase(bindless_table.texture_keys[index]);
+    mdBindlessRetireIndex(MD_BINDLESS_BINDING_TEXTURES, index);
+}
+
+void mdBindlessRemoveSampler(u32 index)
+{
+    if (index >= bindless_table.next[MD_BINDLESS_BINDING_SAMPLERS] || bindless_table.sampler_refs[index] == 0)
+        return;
+
+    if (--bindless_table.sampler_refs[index] > 0)
+        return;
+
+    bindless_table.samplers.erase(bindless_table.sampler_keys[index]);
+    mdRetire([](void *p_payload){
+        vkDestroySampler(renderer_state.allocator.device, *(VkSampler*)p_payload, NULL);
+    }, &bindless_table.sampler_handles[index], sizeof(VkSampler));
+    bindless_table.sampler_handles[index] = VK_NULL_HANDLE;
+    mdBindlessRetireIndex(MD_BINDLESS_BINDING_SAMPLERS, index);
+}
+
+void mdBindlessRemoveBuffer(u32 index)
+{
+    if (index < bindless_table.next[MD_BINDLESS_BINDING_BUFFERS])
+        mdBindlessRetireIndex(MD_BINDLESS_BINDING_BUFFERS, index);
+}
+
+void mdDescriptorSetWriteImage( MdRenderer &renderer, 
+                                VkDescriptorSet dst, 
+                                u32 binding_index, 
+                                MdGPUTexture &texture, 
+                                VkImageLayout layout)
+{
+    VkDescriptorImageInfo image_info = {};
+    image_info.imageLayout = layout;
+    image_info.imageView = texture.image_view;
+    image_info.sampler = texture.sampler;
+
+    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write_set.descriptorCount = 1;
+    write_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write_set.dstSet = dst;
+    write_set.dstBinding = binding_index;
+    write_set.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+}
+
+void mdDescriptorSetWriteInputAttachment(  MdRenderer &renderer, 
+                                            VkDescriptorSet dst, 
+                                            u32 binding_index, 
+                                            MdGPUTexture &texture)
+{
+    VkDescriptorImageInfo image_info = {};
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_info.imageView = texture.image_view;
+    image_info.sampler = VK_NULL_HANDLE;
+
+    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write_set.descriptorCount = 1;
+    write_set.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    write_set.dstSet = dst;
+    write_set.dstBinding = binding_index;
+    write_set.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+}
+
+void mdDescriptorSetWriteUBO(   MdRenderer &renderer, 
+                                VkDescriptorSet dst, 
+                                u32 binding_index, 
+                                usize offset, 
+                                usize range, 
+                                MdGPUBuffer &buffer)
+{
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = buffer.buffer;
+    buffer_info.offset = offset;
+    buffer_info.range = range;
+
+    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write_set.descriptorCount = 1;
+    write_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    write_set.dstSet = dst;
+    write_set.dstBinding = binding_index;
+    write_set.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+}
+
+VkResult mdCreateGraphicsPipeline(  MdRenderer &renderer, 
+                                    MdShaderSource &shaders, 
+                                    MdPipelineGeometryInputState *p_geometry_state, 
+                                    MdPipelineRasterizationState *p_raster_state, 
+                                    MdPipelineColorBlendState *p_color_blend_state, 
+                                    const std::string &pass,
+                                    MdPipeline &pipeline)
+{
+    MD_PROFILE_SCOPE("mdCreateGraphicsPipeline");
+
+    // Find renderpass from its name, or the attachment formats when using dynamic rendering
+    u32 pass_index = mdFindRenderPass(pass);
+    if (pass_index == UINT32_MAX)
+    {
+        LOG_ERROR("failed to build pipeline, pass \"%s\" does not exist", pass.c_str());
+        return VK_ERROR_UNKNOWN;
+    }
+    MdRenderPassEntry *p_entry = &render_graph.passes[pass_index];
+
+    // Every stage gets the same specialization info, ids a stage doesn't declare are ignored
+    VkSpecializationInfo spec_info = {};
+    VkResult result = mdShaderGetSpecializationInfo(shaders, spec_info);
+    if (result != VK_SUCCESS) return result;
+
+    std::vector<VkPipelineShaderStageCreateInfo> stages = shaders.modules;
+    for (usize i=0; i<stages.size() && spec_info.mapEntryCount > 0; i++)
+        stages[i].pSpecializationInfo = &spec_info;
+
+    VkRenderPass rp = VK_NULL_HANDLE;
+    VkPipelineRenderingCreateInfo rendering_info = {VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO};
+    if (render_graph.backend == MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING)
+    {
+        rendering_info.viewMask = 0;
+        rendering_info.colorAttachmentCount = (p_entry->color_format != VK_FORMAT_UNDEFINED) ? 1 : 0;
+        rendering_info.pColorAttachmentFormats = &p_entry->color_format;
+        rendering_info.depthAttachmentFormat = p_entry->depth_format;
+        rendering_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    }
+    else
+    {
+        rp = mdRenderGraphGetPass(pass);
+        if (rp == VK_NULL_HANDLE)
+        {
+            LOG_ERROR("failed to build pipeline");
+            return VK_ERROR_UNKNOWN;
+        }
+    }
+
+    //std::vector<VkDescriptorSet> sets;
+    usize layout_count = 0;
+    pipeline.set_layouts[layout_count++] = renderer_state.global_layout;
+    pipeline.set_layouts[layout_count++] = renderer_state.camera_set_layout;
+    
+    // Setup descriptor set layouts, identical binding lists share a layout
+    if (shaders.bindings.size() > 0)
+    {
+        VkDescriptorSetLayout layout;
+        result = mdGetDescriptorSetLayout(renderer, shaders.bindings, &layout);
+        if (result != VK_SUCCESS) return result;
+
+        pipeline.set_layouts[layout_count++] = layout;
+    }
+
+    // The bindless set always goes in the last slot, so the material slot needs a layout even if it's empty
+    if (bindless_table.layout != VK_NULL_HANDLE)
+    {
+        if (layout_count == MD_MATERIAL_SET_INDEX)
+        {
+            VkDescriptorSetLayout layout;
+            result = mdGetDescriptorSetLayout(renderer, {}, &layout);
+            if (result != VK_SUCCESS) return result;
+
+            pipeline.set_layouts[layout_count++] = layout;
+        }
+        pipeline.set_layouts[layout_count++] = bindless_table.layout;
+    }
+    pipeline.set_layout_count = layout_count;
+
+    // The material layout is a reference on the layout cache, failing past this point gives it back
+    auto release_layouts = [&]() {
+        if (layout_count > MD_MATERIAL_SET_INDEX)
+            mdReleaseDescriptorSetLayout(renderer, pipeline.set_layouts[MD_MATERIAL_SET_INDEX]);
+        pipeline.set_layout_count = 0;
+    };
+
+    // Push constant ranges have to fit in what the device supports
+    VkPhysicalDeviceProperties device_props;
+    vkGetPhysicalDeviceProperties(renderer.context->physical_device, &device_props);
+    for (usize i=0; i<shaders.push_constants.size(); i++)
+    {
+        const VkPushConstantRange *p_range = &shaders.push_constants[i];
+        if (p_range->offset + p_range->size > device_props.limits.maxPushConstantsSize)
+        {
+            LOG_ERROR("push constant range [%d, %d) exceeds the device limit of %d bytes", 
+                p_range->offset, 
+                p_range->offset + p_range->size, 
+                device_props.limits.maxPushConstantsSize
+            );
+            release_layouts();
+            return VK_ERROR_UNKNOWN;
+        }
+    }
+    pipeline.push_constants = shaders.push_constants;
+
+    // Create pipeline layout
+    result = mdGetPipelineLayout(renderer, pipeline.set_layouts.data(), layout_count, pipeline.push_constants, &pipeline.layout);
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("failed to create pipeline layout");
+        release_layouts();
+        return result;
+    }
+
+    // If any of these pipeline state infos are left NULL, use the defaults
+    MdPipelineGeometryInputState default_geometry_state;
+    MdPipelineRasterizationState default_raster_state;
+    MdPipelineColorBlendState default_color_blend_state; 
+    
+    if (p_geometry_state == NULL)
+    {
+        mdInitGeometryInputState(default_geometry_state);
+        mdBuildGeometryInputState(default_geometry_state);
+        p_geometry_state = &default_geometry_state;
+    }
+    
+    if (p_raster_state == NULL)
+    {
+        mdBuildDefaultRasterizationState(default_raster_state);
+        p_raster_state = &default_raster_state;
+    }
+
+    if (p_color_blend_state == NULL)
+    {
+        mdBuildDefaultColorBlendState(default_color_blend_state);
+        p_color_blend_state = &default_color_blend_state;
+    }
+
+    // Depth-only passes have no color attachments to blend into
+    VkPipelineColorBlendStateCreateInfo color_blend_info = p_color_blend_state->color_blend_info;
+    if (p_entry->color_format == VK_FORMAT_UNDEFINED)
+        color_blend_info.attachmentCount = 0;
+
+    // Setup dynamic states
+    VkDynamicState states[2] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamic_info = {VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
+    {
+        dynamic_info.dynamicStateCount = sizeof(states)/sizeof(VkDynamicState);
+        dynamic_info.pDynamicStates = states;
+    }
+
+    VkPipelineViewportStateCreateInfo viewport_info = {VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
+    {
+        viewport_info.viewportCount = 1;
+        viewport_info.scissorCount = 1;
+        viewport_info.flags = 0;
+    }
+
+    // Multisample state, for now do nothing
+    VkPipelineMultisampleStateCreateInfo multisample_info = {VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
+    {
+        multisample_info.alphaToCoverageEnable = VK_FALSE;
+        multisample_info.alphaToOneEnable = VK_FALSE;
+        multisample_info.sampleShadingEnable = VK_FALSE;
+        multisample_info.pSampleMask = NULL;
+        multisample_info.minSampleShading = 1.0f;
+        multisample_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisample_info.flags = 0;
+    }
+
+    // Depth stencil state, always enabled
+    VkPipelineDepthStencilStateCreateInfo depth_info = {VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO};
+    {
+        depth_info.depthWriteEnable = VK_TRUE;
+        depth_info.depthTestEnable = VK_TRUE;
+        depth_info.depthCompareOp = VK_COMPARE_OP_LESS;
+        depth_info.depthBoundsTestEnable = VK_FALSE;
+        depth_info.minDepthBounds = 0.0f;
+        depth_info.maxDepthBounds = 1.0f;
+        depth_info.stencilTestEnable = VK_FALSE;
+        depth_info.front = {};
+        depth_info.back = {};
+    }
+
+    // Create the pipeline
+    VkGraphicsPipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+    {
+        pipeline_info.pNext = (rp == VK_NULL_HANDLE) ? &rendering_info : NULL;
+        pipeline_info.flags = 0;
+        pipeline_info.basePipelineIndex = -1;
+        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+        pipeline_info.layout = pipeline.layout;
+        pipeline_info.renderPass = rp;
+        pipeline_info.subpass = p_entry->subpass;
+    
+        pipeline_info.stageCount = stages.size();
+        pipeline_info.pStages = stages.data();
+    
+        pipeline_info.pDynamicState = &dynamic_info;
+        pipeline_info.pViewportState = &viewport_info;
+        pipeline_info.pVertexInputState = &p_geometry_state->vertex_info;
+        pipeline_info.pInputAssemblyState = &p_geometry_state->assembly_info;
+        pipeline_info.pRasterizationState = &p_raster_state->raster_info;
+        pipeline_info.pColorBlendState = &color_blend_info;
+        pipeline_info.pDepthStencilState = &depth_info;
+        pipeline_info.pMultisampleState = &multisample_info;
+        pipeline_info.pTessellationState = NULL;
+    }
+    result = vkCreateGraphicsPipelines(renderer.context->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline.pipeline);
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("failed to create graphics pipeline");
+        mdReleasePipelineLayout(renderer, pipeline.layout);
+        pipeline.layout = VK_NULL_HANDLE;
+        release_layouts();
         return result;
+    }
+    
+    return result;
+}
+
+void mdDestroyPipeline(MdRenderer &renderer, MdPipeline &pipeline)
+{
+    if (pipeline.variant != 0)
+    {
+        LOG_ERROR("pipeline variants have to be released with mdReleasePipelineVariant\n");
+        return;
+    }
+
+    vkDestroyPipeline(renderer.context->device, pipeline.pipeline, NULL);
+    mdReleasePipelineLayout(renderer, pipeline.layout);
+
+    // Only the material layout is owned by the cache
+    if (pipeline.set_layout_count > MD_MATERIAL_SET_INDEX)
+        mdReleaseDescriptorSetLayout(renderer, pipeline.set_layouts[MD_MATERIAL_SET_INDEX]);
+    pipeline.set_layout_count = 0;
+}
+
+void mdCmdPushConstants(VkCommandBuffer cmd, MdPipeline &pipeline, u32 offset, u32 size, const void *p_data)
+{
+    // vkCmdPushConstants needs exactly the stages of every range it touches
+    VkShaderStageFlags stages = 0;
+    for (usize i=0; i<pipeline.push_constants.size(); i++)
+    {
+        const VkPushConstantRange *p_range = &pipeline.push_constants[i];
+        if (offset < p_range->offset + p_range->size && p_range->offset < offset + size)
+            stages |= p_range->stageFlags;
+    }
+
+    if (stages == 0)
+    {
+        LOG_ERROR("push constant range [%d, %d) isn't declared by the pipeline", offset, offset + size);
+        return;
+    }
+
+    vkCmdPushConstants(cmd, pipeline.layout, stages, offset, size, p_data);
+}
+
+// Variants are keyed on everything that goes into vkCreateGraphicsPipelines, shader modules by their
+// code since sources are usually destroyed right after creating their pipelines. The key's hash 
+// only picks the bucket, a hit compares the whole key
+struct MdPipelineVariant
+{
+    std::vector<u8> key;
+    MdPipeline pipeline;
+    u32 ref_count;
+};
+std::multimap<u64, MdPipelineVariant> pipeline_variants;
+
+void mdPipelineVariantKey(  const MdShaderSource &shaders, 
+                            const MdPipelineGeometryInputState *p_geometry_state, 
+                            const MdPipelineRasterizationState *p_raster_state, 
+                            const MdPipelineColorBlendState *p_color_blend_state, 
+                            const std::string &pass,
+                            std::vector<u8> &key)
+{
+    auto append = [&key](const void *p_data, usize size) {
+        if (size > 0)
+            key.insert(key.end(), (const u8*)p_data, (const u8*)p_data + size);
+    };
+    auto append_string = [&append](const char *p_str) {
+        usize size = strlen(p_str);
+        append(&size, sizeof(size));
+        append(p_str, size);
+    };
+
+    key.clear();
+    append_string(pass.c_str());
+
+    // Passes are compatible as long as their attachment formats and subpass don't change
+    u32 pass_index = mdFindRenderPass(pass);
+    if (pass_index != UINT32_MAX)
+    {
+        append(&render_graph.backend, sizeof(render_graph.backend));
+        append(&render_graph.passes[pass_index].color_format, sizeof(render_graph.passes[pass_index].color_format));
+        append(&render_graph.passes[pass_index].depth_format, sizeof(render_graph.passes[pass_index].depth_format));
+        append(&render_graph.passes[pass_index].subpass, sizeof(render_graph.passes[pass_index].subpass));
+    }
+
+    usize module_count = shaders.modules.size();
+    append(&module_count, sizeof(module_count));
+    for (usize i=0; i<module_count; i++)
+    {
+        append(&shaders.modules[i].stage, sizeof(shaders.modules[i].stage));
+        append(&shaders.code_hashes[i], sizeof(shaders.code_hashes[i]));
+        append_string(shaders.modules[i].pName);
+    }
+
+    usize binding_count = shaders.bindings.size();
+    append(&binding_count, sizeof(binding_count));
+    for (usize i=0; i<binding_count; i++)
+    {
+        append(&shaders.bindings[i].binding, sizeof(shaders.bindings[i].binding));
+        append(&shaders.bindings[i].descriptorType, sizeof(shaders.bindings[i].descriptorType));
+        append(&shaders.bindings[i].descriptorCount, sizeof(shaders.bindings[i].descriptorCount));
+        append(&shaders.bindings[i].stageFlags, sizeof(shaders.bindings[i].stageFlags));
+        append(&shaders.bindings[i].pImmutableSamplers, sizeof(shaders.bindings[i].pImmutableSamplers));
+    }
+
+    usize push_constant_count = shaders.push_constants.size();
+    append(&push_constant_count, sizeof(push_constant_count));
+    append(shaders.push_constants.data(), push_constant_count * sizeof(VkPushConstantRange));
+
+    usize spec_count = shaders.spec_entries.size();
+    append(&spec_count, sizeof(spec_count));
+    for (usize i=0; i<spec_count; i++)
+    {
+        append(&shaders.spec_entries[i].constantID, sizeof(shaders.spec_entries[i].constantID));
+        append(&shaders.spec_entries[i].size, sizeof(shaders.spec_entries[i].size));
+        append(shaders.spec_data.data() + shaders.spec_entries[i].offset, shaders.spec_entries[i].size);
+    }
+
+    // NULL states get the defaults, so they key differently from any explicit state
+    u32 has_geometry = (p_geometry_state != NULL);
+    append(&has_geometry, sizeof(has_geometry));
+    if (has_geometry)
+    {
+        usize attribute_count = p_geometry_state->attributes.size();
+        usize vertex_binding_count = p_geometry_state->bindings.size();
+        append(&attribute_count, sizeof(attribute_count));
+        append(p_geometry_state->attributes.data(), attribute_count * sizeof(VkVertexInputAttributeDescription));
+        append(&vertex_binding_count, sizeof(vertex_binding_count));
+        append(p_geometry_state->bindings.data(), vertex_binding_count * sizeof(VkVertexInputBindingDescription));
+        append(&p_geometry_state->assembly_info.topology, sizeof(p_geometry_state->assembly_info.topology));
+        append(&p_geometry_state->assembly_info.primitiveRestartEnable, sizeof(p_geometry_state->assembly_info.primitiveRestartEnable));
+    }
+
+    u32 has_raster = (p_raster_state != NULL);
+    append(&has_raster, sizeof(has_raster));
+    if (has_raster)
+    {
+        // Every field from depthClampEnable to lineWidth is 32 bits wide
+        const VkPipelineRasterizationStateCreateInfo *p_info = &p_raster_state->raster_info;
+        append(&p_info->depthClampEnable, (const u8*)(&p_info->lineWidth + 1) - (const u8*)&p_info->depthClampEnable);
+    }
+
+    u32 has_color_blend = (p_color_blend_state != NULL);
+    append(&has_color_blend, sizeof(has_color_blend));
+    if (has_color_blend)
+    {
+        const VkPipelineColorBlendStateCreateInfo *p_info = &p_color_blend_state->color_blend_info;
+        append(&p_info->logicOpEnable, sizeof(p_info->logicOpEnable));
+        append(&p_info->logicOp, sizeof(p_info->logicOp));
+        append(p_info->blendConstants, sizeof(p_info->blendConstants));
+        append(&p_info->attachmentCount, sizeof(p_info->attachmentCount));
+        append(p_info->pAttachments, p_info->attachmentCount * sizeof(VkPipelineColorBlendAttachmentState));
+    }
+}
+
+VkResult mdGetPipelineVariant(  MdRenderer &renderer, 
+                                MdShaderSource &shaders, 
+                                MdPipelineGeometryInputState *p_geometry_state, 
+                                MdPipelineRasterizationState *p_raster_state, 
+                                MdPipelineColorBlendState *p_color_blend_state, 
+                                const std::string &pass,
+                                MdPipeline **pp_pipeline)
+{
+    std::vector<u8> key;
+    mdPipelineVariantKey(shaders, p_geometry_state, p_raster_state, p_color_blend_state, pass, key);
+
+    // 0 marks pipelines that aren't in the cache
+    u64 hash = mdHashBytes(key.data(), key.size());
+    hash = (hash != 0) ? hash : 1;
+
+    auto range = pipeline_variants.equal_range(hash);
+    for (auto it=range.first; it!=range.second; it++)
+    {
+        if (it->second.key != key)
+            continue;
+        
+        it->second.ref_count++;
+        *pp_pipeline = &it->second.pipeline;
+        return VK_SUCCESS;
+    }
+
+    MdPipelineVariant variant = {};
+    VkResult result = mdCreateGraphicsPipeline(renderer, shaders, p_geometry_state, p_raster_state, p_color_blend_state, pass, variant.pipeline);
+    if (result != VK_SUCCESS) return result;
+
+    variant.key = std::move(key);
+    variant.pipeline.variant = hash;
+    variant.ref_count = 1;
+    auto it = pipeline_variants.insert(std::pair(hash, std::move(variant)));
+    *pp_pipeline = &it->second.pipeline;
+    return result;
+}
+
+void mdReleasePipelineVariant(MdRenderer &renderer, MdPipeline *p_pipeline)
+{
+    auto range = pipeline_variants.equal_range(p_pipeline->variant);
+    auto it = range.first;
+    while (it != range.second && &it->second.pipeline != p_pipeline)
+        it++;
+    
+    if (it == range.second)
+    {
+        LOG_ERROR("pipeline isn't a variant from the cache");
+        return;
+    }
+
+    if (--it->second.ref_count == 0)
+    {
+        it->second.pipeline.variant = 0;
+        mdDestroyPipeline(renderer, it->second.pipeline);
+        pipeline_variants.erase(it);
+    }
+}
+
+void mdDestroyPipelineVariants(MdRenderer &renderer)
+{
+    for (auto it=pipeline_variants.begin(); it!=pipeline_variants.end(); it++)
+    {
+        it->second.pipeline.variant = 0;
+        mdDestroyPipeline(renderer, it->second.pipeline);
+    }
+    pipeline_variants.clear();
+}
+
+VkResult mdCreateMaterial(MdRenderer &renderer, MdPipeline &pipeline, MdMaterial &material)
+{
+    VkResult result = uniform_allocator.AllocateSets(pipeline.set_layouts[MD_MATERIAL_SET_INDEX], 1, &material.set);
+    if (result != VK_SUCCESS) return result;
+
+    material.pipeline = pipeline.pipeline;
+    return result;
+}
+
+void mdMaterialSetImage(MdRenderer &renderer, MdMaterial& material, u32 binding_index, MdGPUTexture &texture, VkImageLayout layout)
+{
+    mdDescriptorSetWriteImage(renderer, material.set, binding_index, texture, layout);
+}
+
+void mdMaterialSetUBO(MdRenderer &renderer, MdMaterial& material, u32 binding_index, usize offset, usize range, MdGPUBuffer &buffer)
+{
+    mdDescriptorSetWriteUBO(renderer, material.set, binding_index, offset, range, buffer);
+}
+
+VkResult mdMaterialSetBindlessTexture(MdRenderer &renderer, MdMaterial& material, u32 slot, MdGPUTexture &texture, VkImageLayout layout)
+{
+    if (slot >= MD_MATERIAL_MAX_TEXTURES)
+    {
+        LOG_ERROR("material texture slot %d is out of range", slot);
+        return VK_ERROR_UNKNOWN;
+    }
+
+    if (texture.sampler_info.sType != VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO)
+    {
+        LOG_ERROR("texture for material slot %d was created without a sampler", slot);
+        return VK_ERROR_UNKNOWN;
+    }
+
+    u32 texture_index = mdBindlessAddTexture(renderer, texture, layout);
+    if (texture_index == UINT32_MAX)
+        return VK_ERROR_OUT_OF_POOL_MEMORY;
+    
+    // The table creates its own sampler from the texture's settings, so it stays valid after the 
+    // texture's sampler is destroyed
+    u32 sampler_index = mdBindlessAddSampler(renderer, texture.sampler_info);
+    if (sampler_index == UINT32_MAX)
+    {
+        mdBindlessRemoveTexture(texture_index);
+        return VK_ERROR_OUT_OF_POOL_MEMORY;
+    }
+    
+    // Replace whatever was in the slot before
+    if (material.textures[slot] != UINT32_MAX)
+        mdBindlessRemoveTexture(material.textures[slot]);
+    if (material.samplers[slot] != UINT32_MAX)
+        mdBindlessRemoveSampler(material.samplers[slot]);
+    
+    material.textures[slot] = texture_index;
+    material.samplers[slot] = sampler_index;
+    return VK_SUCCESS;
+}
+
+void mdCmdBindBindlessSet(VkCommandBuffer cmd, MdPipeline &pipeline, VkPipelineBindPoint bind_point)
+{
+    if (pipeline.set_layout_count == 0 || 
+        pipeline.set_layouts[pipeline.set_layout_count-1] != bindless_table.layout)
+        return;
     
-    // Push sets back and return result
-    for (u32 i=0; i<size; i++)
-        sets[set_index].push_back(p_sets[i]);
+    vkCmdBindDescriptorSets(
+        cmd, 
+        bind_point, 
+        pipeline.layout, 
+        pipeline.set_layout_count-1, 
+        1, 
+        &bindless_table.set, 
+        0, 
+        NULL
+    );
+}
+#pragma endregion
+
+#pragma region [ Shader Hot Reload ]
+VkResult mdLoadShaderSPIRVFromFile( MdRenderContext &context, 
+                                    const char *p_filepath,
+                                    VkShaderStageFlagBits stage,
+                                    MdShaderSource &source)
+{
+    MdFile file = {};
+    MdResult md_result = mdOpenFile(p_filepath, MD_FILE_ACCESS_READ_ONLY, file);
+    MD_CHECK_ANY(md_result, VK_ERROR_UNKNOWN, "failed to load file \"%s\"", p_filepath);
+
+    u32 *code = (u32*)malloc(file.size);
+    u32 size = (file.size / 4) * 4;
+
+    md_result = mdReadFile(file, size, code);
+    mdCloseFile(file);
+    if (md_result != MD_SUCCESS)
+    {
+        LOG_ERROR("failed to copy file \"%s\" to memory", p_filepath);
+        free(code);
+        return VK_ERROR_UNKNOWN;
+    }
+
+    VkResult result = mdLoadShaderSPIRV(context, size, code, stage, source);
+    free(code);
+
+    return result;
+}
+
+#define MD_GLSLANG_EXECUTABLE "glslang"
+#define MD_SHADER_WATCH_TIMEOUT_MS 100
+
+struct MdShaderProgram
+{
+    std::vector<MdShaderFile> files;
+    MdShaderProgramBuildFunc build;
+    MdPipeline *p_pipeline;
+    bool active;
+};
+
+struct MdShaderHotReload
+{
+    std::vector<MdShaderProgram> programs;
+
+    // Shared with the compile thread
+    std::thread thread;
+    std::atomic<bool> running;
+    std::mutex lock;
+    std::vector<MdShaderFile> watched;      // Every file used by a program, glsl paths are canonical
+    std::vector<std::string> compiled;      // GLSL paths whose SPIR-V was rewritten since the last update
+
+    MdShaderHotReload() : running(false) {}
+};
+MdShaderHotReload shader_reload;
+
+std::string mdCanonicalPath(const std::string &path)
+{
+    char resolved[PATH_MAX];
+    return (realpath(path.c_str(), resolved) != NULL) ? std::string(resolved) : path;
+}
+
+const char *mdGlslangStageName(VkShaderStageFlagBits stage)
+{
+    switch (stage)
+    {
+        case VK_SHADER_STAGE_VERTEX_BIT:                    return "vert";
+        case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:      return "tesc";
+        case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:   return "tese";
+        case VK_SHADER_STAGE_GEOMETRY_BIT:                  return "geom";
+        case VK_SHADER_STAGE_FRAGMENT_BIT:                  return "frag";
+        case VK_SHADER_STAGE_COMPUTE_BIT:                   return "comp";
+        default:                                            return NULL;
+    }
+}
+
+// Compiles into a temporary first, so a shader with errors leaves the last good SPIR-V in place
+bool mdCompileShaderFile(const MdShaderFile &file)
+{
+    const char *p_stage = mdGlslangStageName(file.stage);
+    if (p_stage == NULL)
+    {
+        LOG_ERROR("no glslang stage for \"%s\"", file.glsl_path.c_str());
+        return false;
+    }
+
+    std::string tmp_path = file.spv_path + ".tmp";
+    const char *argv[] = {
+        MD_GLSLANG_EXECUTABLE, "-V", file.glsl_path.c_str(), "-o", tmp_path.c_str(), "-S", p_stage, NULL
+    };
+
+    pid_t pid;
+    if (posix_spawnp(&pid, MD_GLSLANG_EXECUTABLE, NULL, NULL, (char* const*)argv, environ) != 0)
+    {
+        LOG_ERROR("failed to launch %s: %s", MD_GLSLANG_EXECUTABLE, strerror(errno));
+        return false;
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        LOG_ERROR("failed to compile \"%s\"", file.glsl_path.c_str());
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    if (rename(tmp_path.c_str(), file.spv_path.c_str()) != 0)
+    {
+        LOG_ERROR("failed to replace \"%s\": %s", file.spv_path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void mdShaderCompileThread(MdFileWatch watch)
+{
+    std::vector<std::string> changed;
+    while (shader_reload.running.load(std::memory_order_acquire))
+    {
+        changed.clear();
+        if (mdWaitFileWatch(watch, MD_SHADER_WATCH_TIMEOUT_MS, changed) != MD_SUCCESS)
+            break;
+
+        for (usize i=0; i<changed.size(); i++)
+        {
+            // Copy the file out so programs can keep being registered while glslang runs
+            MdShaderFile file = {};
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> guard(shader_reload.lock);
+                for (usize j=0; j<shader_reload.watched.size() && !found; j++)
+                {
+                    if (shader_reload.watched[j].glsl_path != changed[i])
+                        continue;
+
+                    file = shader_reload.watched[j];
+                    found = true;
+                }
+            }
+
+            if (!found || !mdCompileShaderFile(file))
+                continue;
+
+            std::lock_guard<std::mutex> guard(shader_reload.lock);
+            if (std::find(shader_reload.compiled.begin(), shader_reload.compiled.end(), file.glsl_path) == shader_reload.compiled.end())
+                shader_reload.compiled.push_back(file.glsl_path);
+        }
+    }
+    mdDestroyFileWatch(watch);
+}
+
+VkResult mdBuildShaderProgram(MdRenderer &renderer, MdShaderProgram &program, MdPipeline **pp_pipeline)
+{
+    MdShaderSource source;
+    VkResult result = VK_SUCCESS;
+    for (usize i=0; i<program.files.size() && result == VK_SUCCESS; i++)
+        result = mdLoadShaderSPIRVFromFile(*renderer.context, program.files[i].spv_path.c_str(), program.files[i].stage, source);
+
+    if (result == VK_SUCCESS)
+        result = program.build(source, pp_pipeline);
+
+    // Pipelines don't reference their modules once created
+    mdDestroyShaderSource(*renderer.context, source);
+    return result;
+}
+
+VkResult mdCreateShaderProgram( MdRenderer &renderer, 
+                                const std::vector<MdShaderFile> &files, 
+                                const MdShaderProgramBuildFunc &build, 
+                                MdShaderProgramHandle *p_handle)
+{
+    MdShaderProgram program = {};
+    program.files = files;
+    program.build = build;
+    program.active = true;
+    for (usize i=0; i<program.files.size(); i++)
+        program.files[i].glsl_path = mdCanonicalPath(program.files[i].glsl_path);
+
+    VkResult result = mdBuildShaderProgram(renderer, program, &program.p_pipeline);
+    if (result != VK_SUCCESS) return result;
+
+    {
+        std::lock_guard<std::mutex> guard(shader_reload.lock);
+        for (usize i=0; i<program.files.size(); i++)
+        {
+            bool found = false;
+            for (usize j=0; j<shader_reload.watched.size() && !found; j++)
+                found = shader_reload.watched[j].glsl_path == program.files[i].glsl_path;
+
+            if (!found)
+                shader_reload.watched.push_back(program.files[i]);
+        }
+    }
+
+    // Reuse the slot of a destroyed program if there is one
+    for (usize i=0; i<shader_reload.programs.size(); i++)
+    {
+        if (shader_reload.programs[i].active)
+            continue;
+
+        shader_reload.programs[i] = program;
+        *p_handle = i;
+        return result;
+    }
+
+    *p_handle = shader_reload.programs.size();
+    shader_reload.programs.push_back(program);
+    return result;
+}
+
+MdPipeline *mdGetShaderProgramPipeline(MdShaderProgramHandle handle)
+{
+    if (handle >= shader_reload.programs.size() || !shader_reload.programs[handle].active)
+        return NULL;
+
+    return shader_reload.programs[handle].p_pipeline;
+}
+
+void mdDestroyShaderProgram(MdRenderer &renderer, MdShaderProgramHandle handle)
+{
+    if (handle >= shader_reload.programs.size() || !shader_reload.programs[handle].active)
+        return;
+
+    MdShaderProgram *p_program = &shader_reload.programs[handle];
+    mdReleasePipelineVariant(renderer, p_program->p_pipeline);
+    p_program->p_pipeline = NULL;
+    p_program->build = NULL;
+    p_program->active = false;
+}
+
+MdResult mdEnableShaderHotReload(MdRenderer &renderer, const char *p_shader_directory)
+{
+    if (shader_reload.running.load())
+        return MD_SUCCESS;
 
-    return result;
+    MdFileWatch watch = {};
+    MdResult result = mdCreateFileWatch(p_shader_directory, watch);
+    MD_CHECK(result, "failed to watch shader directory \"%s\"", p_shader_directory);
+
+    shader_reload.running.store(true, std::memory_order_release);
+    shader_reload.thread = std::thread(mdShaderCompileThread, watch);
+    return MD_SUCCESS;
 }
 
-void MdDescriptorAllocator::Destroy()
+void mdUpdateShaderHotReload(MdRenderer &renderer)
 {
-    for (u32 i=0; i<pools.size(); i++)
+    std::vector<std::string> compiled;
     {
-        ResetPools(i);
-        vkDestroyDescriptorPool(this->device, pools[i].pool, NULL);
+        std::lock_guard<std::mutex> guard(shader_reload.lock);
+        compiled.swap(shader_reload.compiled);
     }
-}
+    if (compiled.empty())
+        return;
 
-MdDescriptorAllocator uniform_allocator;
-VkResult mdCreateDescriptorAllocator(MdRenderer &renderer)
-{
-    return uniform_allocator.Init(renderer.context->device);
+    // Only programs using one of the recompiled files get rebuilt
+    for (usize i=0; i<shader_reload.programs.size(); i++)
+    {
+        MdShaderProgram *p_program = &shader_reload.programs[i];
+        bool dirty = false;
+        for (usize j=0; j<p_program->files.size() && p_program->active && !dirty; j++)
+            dirty = std::find(compiled.begin(), compiled.end(), p_program->files[j].glsl_path) != compiled.end();
+
+        if (!dirty)
+            continue;
+
+        MdPipeline *p_pipeline = NULL;
+        if (mdBuildShaderProgram(renderer, *p_program, &p_pipeline) != VK_SUCCESS)
+        {
+            LOG_ERROR("failed to rebuild shader program %zu, keeping the previous pipeline", i);
+            continue;
+        }
+
+        // Descriptor sets and push constants were written against the old layout
+        if (p_pipeline->layout != p_program->p_pipeline->layout)
+        {
+            LOG_ERROR("shader program %zu changed its pipeline layout, restart to apply it", i);
+            mdReleasePipelineVariant(renderer, p_pipeline);
+            continue;
+        }
+
+        if (p_pipeline != p_program->p_pipeline)
+            mdRetirePipelineVariant(renderer, p_program->p_pipeline);
+        else
+            mdReleasePipelineVariant(renderer, p_pipeline);
+        p_program->p_pipeline = p_pipeline;
+    }
 }
 
-void mdDestroyDescriptorAllocator()
+void mdDisableShaderHotReload(MdRenderer &renderer)
 {
-    uniform_allocator.Destroy();
+    if (shader_reload.running.exchange(false))
+        shader_reload.thread.join();
+    shader_reload.compiled.clear();
 }
+#pragma endregion
 
-void mdDescriptorSetWriteImage( MdRenderer &renderer, 
-                                VkDescriptorSet dst, 
-                                u32 binding_index, 
-                                MdGPUTexture &texture, 
-                                VkImageLayout layout)
+#pragma region [ Frame Pacing ]
+#define MD_PACER_HISTORY 16
+#define MD_PACER_EMA_WEIGHT 0.1
+// An acquire taking longer than this waited for a flip to release an image
+#define MD_PACER_BLOCKED_NS 500000
+
+struct MdPacedFrame
 {
-    VkDescriptorImageInfo image_info = {};
-    image_info.imageLayout = layout;
-    image_info.imageView = texture.image_view;
-    image_info.sampler = texture.sampler;
+    u32 present_id;
+    i64 input_ns;
+};
 
-    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-    write_set.descriptorCount = 1;
-    write_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    write_set.dstSet = dst;
-    write_set.dstBinding = binding_index;
-    write_set.pImageInfo = &image_info;
+struct MdFramePacer
+{
+    bool enabled = false;
+    f64 margin_ns = 1000000.0;
+
+    // Moving averages in nanoseconds, work keeps its mean deviation to predict conservatively
+    f64 refresh_ns = 0.0;
+    f64 work_ns = 0.0;
+    f64 work_dev_ns = 0.0;
+    f64 latency_ns = 0.0;
+    f64 sleep_ns = 0.0;
+
+    i64 last_vblank_ns = 0;
+    i64 input_ns = 0;
+    bool frame_pending = false;
+
+    // Without display timing, vblanks come from acquires that blocked under FIFO. Missed vblanks only
+    // lengthen the intervals between them, so the refresh period is the shortest recent interval
+    i64 last_acquire_ns = 0;
+    u32 interval_count = 0;
+    std::array<f64, MD_PACER_HISTORY> intervals = {};
+
+    u32 present_id = 0;
+    std::array<MdPacedFrame, MD_PACER_HISTORY> history = {};
+
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    PFN_vkGetRefreshCycleDurationGOOGLE p_get_refresh_cycle = NULL;
+    PFN_vkGetPastPresentationTimingGOOGLE p_get_past_timing = NULL;
+
+    // Chained into the present info, so they have to outlive the call
+    VkPresentTimeGOOGLE present_time = {};
+    VkPresentTimesInfoGOOGLE present_times = {VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE};
+};
+MdFramePacer frame_pacer;
 
-    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+// CLOCK_MONOTONIC, the same time base VK_GOOGLE_display_timing reports in on Linux
+i64 mdPacerNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
 }
 
-void mdDescriptorSetWriteUBO(   MdRenderer &renderer, 
-                                VkDescriptorSet dst, 
-                                u32 binding_index, 
-                                usize offset, 
-                                usize range, 
-                                MdGPUBuffer &buffer)
+f64 mdPacerAverage(f64 average, f64 sample)
 {
-    VkDescriptorBufferInfo buffer_info = {};
-    buffer_info.buffer = buffer.buffer;
-    buffer_info.offset = offset;
-    buffer_info.range = range;
-
-    VkWriteDescriptorSet write_set = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-    write_set.descriptorCount = 1;
-    write_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    write_set.dstSet = dst;
-    write_set.dstBinding = binding_index;
-    write_set.pBufferInfo = &buffer_info;
+    return (average == 0.0) ? sample : average + (sample - average) * MD_PACER_EMA_WEIGHT;
+}
 
-    vkUpdateDescriptorSets(renderer.context->device, 1, &write_set, 0, NULL);
+void mdSetFramePacing(bool enable, f64 margin_ms)
+{
+    frame_pacer.enabled = enable;
+    frame_pacer.margin_ns = margin_ms * 1000000.0;
 }
 
-VkResult mdCreateGraphicsPipeline(  MdRenderer &renderer, 
-                                    MdShaderSource &shaders, 
-                                    MdPipelineGeometryInputState *p_geometry_state, 
-                                    MdPipelineRasterizationState *p_raster_state, 
-                                    MdPipelineColorBlendState *p_color_blend_state, 
-                                    const std::string &pass,
-                                    MdPipeline &pipeline)
+void mdFramePacerReadPastTiming(MdRenderer &renderer)
 {
-    // Find renderpass from its name
-    VkRenderPass rp = mdRenderGraphGetPass(pass);
-    if (rp == VK_NULL_HANDLE)
-    {
-        LOG_ERROR("failed to build pipeline");
-        return VK_ERROR_UNKNOWN;
-    }
+    u32 count = 0;
+    frame_pacer.p_get_past_timing(renderer.context->device, frame_pacer.swapchain, &count, NULL);
+    if (count == 0)
+        return;
 
-    //std::vector<VkDescriptorSet> sets;
-    usize layout_count = 0;
-    pipeline.set_layouts[layout_count++] = renderer_state.global_layout;
-    pipeline.set_layouts[layout_count++] = renderer_state.camera_set_layout;
-    
-    // Setup descriptor set layouts
-    VkResult result;
-    if (shaders.bindings.size() > 0)
+    VkPastPresentationTimingGOOGLE timings[MD_PACER_HISTORY];
+    count = MIN_VAL(count, (u32)MD_PACER_HISTORY);
+    frame_pacer.p_get_past_timing(renderer.context->device, frame_pacer.swapchain, &count, timings);
+
+    for (u32 i=0; i<count; i++)
     {
-        VkDescriptorSetLayout layout;
-        VkDescriptorSetLayoutCreateInfo set_layout_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
-        set_layout_info.bindingCount = shaders.bindings.size();
-        set_layout_info.pBindings = shaders.bindings.data();
-        set_layout_info.flags = 0;
-        result = vkCreateDescriptorSetLayout(renderer.context->device, &set_layout_info, NULL, &layout);
+        MdPacedFrame *p_frame = &frame_pacer.history[timings[i].presentID % MD_PACER_HISTORY];
+        if (p_frame->present_id != timings[i].presentID)
+            continue;
         
-        if (result != VK_SUCCESS) return result;
-
-        pipeline.set_layouts[layout_count++] = layout;
+        frame_pacer.latency_ns = mdPacerAverage(
+            frame_pacer.latency_ns, 
+            (f64)((i64)timings[i].actualPresentTime - p_frame->input_ns)
+        );
+        frame_pacer.last_vblank_ns = MAX_VAL(frame_pacer.last_vblank_ns, (i64)timings[i].actualPresentTime);
     }
-    
-    VkPipelineLayoutCreateInfo layout_info = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-    layout_info.setLayoutCount = layout_count;
-    layout_info.pSetLayouts = pipeline.set_layouts.data();
-    layout_info.flags = 0;
-    layout_info.pushConstantRangeCount = 0;    // TO-DO: actually use push constants
-    layout_info.pPushConstantRanges = NULL;
+}
 
-    // Create pipeline layout
-    result = vkCreatePipelineLayout(renderer.context->device, &layout_info, NULL, &pipeline.layout);
-    VK_CHECK(result, "failed to create pipeline layout");
+void mdFramePacerWait(MdRenderer &renderer)
+{
+    MdRenderContext *p_context = renderer.context;
+    i64 now = mdPacerNow();
 
-    // If any of these pipeline state infos are left NULL, use the defaults
-    MdPipelineGeometryInputState default_geometry_state;
-    MdPipelineRasterizationState default_raster_state;
-    MdPipelineColorBlendState default_color_blend_state; 
-    
-    if (p_geometry_state == NULL)
-    {
-        mdInitGeometryInputState(default_geometry_state);
-        mdBuildGeometryInputState(default_geometry_state);
-        p_geometry_state = &default_geometry_state;
-    }
-    
-    if (p_raster_state == NULL)
+    // A new swapchain can present to a different display mode, start over
+    if (frame_pacer.swapchain != p_context->swapchain.swapchain)
     {
-        mdBuildDefaultRasterizationState(default_raster_state);
-        p_raster_state = &default_raster_state;
-    }
+        frame_pacer.swapchain = p_context->swapchain.swapchain;
+        frame_pacer.refresh_ns = 0.0;
+        frame_pacer.last_vblank_ns = 0;
+        frame_pacer.last_acquire_ns = 0;
+        frame_pacer.interval_count = 0;
+        frame_pacer.frame_pending = false;
+
+        if (p_context->display_timing && frame_pacer.p_get_past_timing == NULL)
+        {
+            frame_pacer.p_get_refresh_cycle = (PFN_vkGetRefreshCycleDurationGOOGLE)
+                vkGetDeviceProcAddr(p_context->device, "vkGetRefreshCycleDurationGOOGLE");
+            frame_pacer.p_get_past_timing = (PFN_vkGetPastPresentationTimingGOOGLE)
+                vkGetDeviceProcAddr(p_context->device, "vkGetPastPresentationTimingGOOGLE");
+        }
 
-    if (p_color_blend_state == NULL)
-    {
-        mdBuildDefaultColorBlendState(default_color_blend_state);
-        p_color_blend_state = &default_color_blend_state;
+        VkRefreshCycleDurationGOOGLE refresh = {};
+        if (frame_pacer.p_get_refresh_cycle != NULL && 
+            frame_pacer.p_get_refresh_cycle(p_context->device, frame_pacer.swapchain, &refresh) == VK_SUCCESS)
+            frame_pacer.refresh_ns = (f64)refresh.refreshDuration;
     }
 
-    // Setup dynamic states
-    VkDynamicState states[2] = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
-    };
-    VkPipelineDynamicStateCreateInfo dynamic_info = {VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
+    // The previous frame's timeline value was just waited on, so now is when its GPU work finished
+    if (frame_pacer.frame_pending)
     {
-        dynamic_info.dynamicStateCount = sizeof(states)/sizeof(VkDynamicState);
-        dynamic_info.pDynamicStates = states;
-    }
+        f64 work = (f64)(now - frame_pacer.input_ns);
+        frame_pacer.work_dev_ns = mdPacerAverage(frame_pacer.work_dev_ns, fabs(work - frame_pacer.work_ns));
+        frame_pacer.work_ns = mdPacerAverage(frame_pacer.work_ns, work);
 
-    VkPipelineViewportStateCreateInfo viewport_info = {VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
-    {
-        viewport_info.viewportCount = 1;
-        viewport_info.scissorCount = 1;
-        viewport_info.flags = 0;
+        if (frame_pacer.p_get_past_timing != NULL)
+            mdFramePacerReadPastTiming(renderer);
+        else
+        {
+            // Predicted, the frame goes out on the first vblank after its work finished. The fence 
+            // says nothing about where vblanks are, so it isn't used as one
+            i64 vblank = now;
+            if (frame_pacer.last_vblank_ns != 0 && frame_pacer.refresh_ns > 0.0)
+            {
+                vblank = frame_pacer.last_vblank_ns;
+                while (vblank < now)
+                    vblank += (i64)frame_pacer.refresh_ns;
+            }
+            frame_pacer.latency_ns = mdPacerAverage(frame_pacer.latency_ns, (f64)(vblank - frame_pacer.input_ns));
+        }
+        frame_pacer.frame_pending = false;
     }
+    frame_pacer.sleep_ns = 0.0;
 
-    // Multisample state, for now do nothing
-    VkPipelineMultisampleStateCreateInfo multisample_info = {VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
+    // Only FIFO blocks on the vblank, the other modes present as soon as the frame is done
+    VkPresentModeKHR mode = p_context->swapchain.present_mode;
+    bool fifo = (mode == VK_PRESENT_MODE_FIFO_KHR || mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR);
+    if (frame_pacer.enabled && fifo && frame_pacer.last_vblank_ns != 0 && frame_pacer.refresh_ns > 0.0)
     {
-        multisample_info.alphaToCoverageEnable = VK_FALSE;
-        multisample_info.alphaToOneEnable = VK_FALSE;
-        multisample_info.sampleShadingEnable = VK_FALSE;
-        multisample_info.pSampleMask = NULL;
-        multisample_info.minSampleShading = 1.0f;
-        multisample_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisample_info.flags = 0;
-    }
+        i64 refresh = (i64)frame_pacer.refresh_ns;
+        i64 work = (i64)(frame_pacer.work_ns + 2.0 * frame_pacer.work_dev_ns + frame_pacer.margin_ns);
 
-    // Depth stencil state, always enabled
-    VkPipelineDepthStencilStateCreateInfo depth_info = {VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO};
-    {
-        depth_info.depthWriteEnable = VK_TRUE;
-        depth_info.depthTestEnable = VK_TRUE;
-        depth_info.depthCompareOp = VK_COMPARE_OP_LESS;
-        depth_info.depthBoundsTestEnable = VK_FALSE;
-        depth_info.minDepthBounds = 0.0f;
-        depth_info.maxDepthBounds = 1.0f;
-        depth_info.stencilTestEnable = VK_FALSE;
-        depth_info.front = {};
-        depth_info.back = {};
+        // Start just early enough to make the first vblank the frame can still reach
+        i64 vblank = frame_pacer.last_vblank_ns + refresh;
+        while (vblank < now + work)
+            vblank += refresh;
+        
+        i64 wake = vblank - work;
+        if (wake > now)
+        {
+            frame_pacer.sleep_ns = (f64)MIN_VAL(wake - now, refresh);
+            std::this_thread::sleep_for(std::chrono::nanoseconds((i64)frame_pacer.sleep_ns));
+        }
     }
 
-    // Create the pipeline
-    VkGraphicsPipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
-    {
-        pipeline_info.flags = 0;
-        pipeline_info.basePipelineIndex = -1;
-        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-        pipeline_info.layout = pipeline.layout;
-        pipeline_info.renderPass = rp;
-        pipeline_info.subpass = 0;
-    
-        pipeline_info.stageCount = shaders.modules.size();
-        pipeline_info.pStages = shaders.modules.data();
-    
-        pipeline_info.pDynamicState = &dynamic_info;
-        pipeline_info.pViewportState = &viewport_info;
-        pipeline_info.pVertexInputState = &p_geometry_state->vertex_info;
-        pipeline_info.pInputAssemblyState = &p_geometry_state->assembly_info;
-        pipeline_info.pRasterizationState = &p_raster_state->raster_info;
-        pipeline_info.pColorBlendState = &p_color_blend_state->color_blend_info;
-        pipeline_info.pDepthStencilState = &depth_info;
-        pipeline_info.pMultisampleState = &multisample_info;
-        pipeline_info.pTessellationState = NULL;
-    }
-    result = vkCreateGraphicsPipelines(renderer.context->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline.pipeline);
-    VK_CHECK(result, "failed to create graphics pipeline");
-    
-    return result;
+    frame_pacer.input_ns = mdPacerNow();
 }
 
-void mdDestroyPipeline(MdRenderer &renderer, MdPipeline &pipeline)
+void mdFramePacerAcquired(MdRenderer &renderer)
 {
-    vkDestroyPipeline(renderer.context->device, pipeline.pipeline, NULL);
-    vkDestroyPipelineLayout(renderer.context->device, pipeline.layout, NULL);
-    vkDestroyDescriptorSetLayout(renderer.context->device, pipeline.set_layouts[2], NULL);
-}
+    i64 now = mdPacerNow();
+    if (frame_pacer.p_get_past_timing != NULL)
+        return;
 
-VkResult mdCreateMaterial(MdRenderer &renderer, MdPipeline &pipeline, MdMaterial &material)
-{
-    VkResult result = uniform_allocator.AllocateSets(pipeline.set_layouts[2], 2, 1, &material.set);
-    if (result != VK_SUCCESS) return result;
+    // Only FIFO acquires wait for a flip, an acquire that returned right away says nothing either
+    VkPresentModeKHR mode = renderer.context->swapchain.present_mode;
+    bool fifo = (mode == VK_PRESENT_MODE_FIFO_KHR || mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR);
+    if (!fifo || now - frame_pacer.input_ns < MD_PACER_BLOCKED_NS)
+    {
+        frame_pacer.last_acquire_ns = 0;
+        return;
+    }
 
-    material.pipeline = pipeline.pipeline;
-    return result;
+    // Intervals are only measured between consecutive frames that both blocked
+    if (frame_pacer.last_acquire_ns != 0)
+    {
+        frame_pacer.intervals[frame_pacer.interval_count++ % MD_PACER_HISTORY] = (f64)(now - frame_pacer.last_acquire_ns);
+
+        f64 shortest = frame_pacer.intervals[0];
+        u32 count = MIN_VAL(frame_pacer.interval_count, (u32)MD_PACER_HISTORY);
+        for (u32 i=1; i<count; i++)
+            shortest = MIN_VAL(shortest, frame_pacer.intervals[i]);
+        frame_pacer.refresh_ns = shortest;
+    }
+    frame_pacer.last_acquire_ns = now;
+    frame_pacer.last_vblank_ns = now;
 }
 
-void mdMaterialSetImage(MdRenderer &renderer, MdMaterial& material, u32 binding_index, MdGPUTexture &texture, VkImageLayout layout)
+void mdFramePacerPresent(MdRenderer &renderer, VkPresentInfoKHR &present_info)
 {
-    mdDescriptorSetWriteImage(renderer, material.set, binding_index, texture, layout);
+    u32 id = frame_pacer.present_id++;
+    frame_pacer.history[id % MD_PACER_HISTORY] = {id, frame_pacer.input_ns};
+    frame_pacer.frame_pending = true;
+
+    if (frame_pacer.p_get_past_timing == NULL)
+        return;
+    
+    frame_pacer.present_time.presentID = id;
+    frame_pacer.present_time.desiredPresentTime = 0;
+    frame_pacer.present_times.pNext = present_info.pNext;
+    frame_pacer.present_times.swapchainCount = 1;
+    frame_pacer.present_times.pTimes = &frame_pacer.present_time;
+    present_info.pNext = &frame_pacer.present_times;
 }
 
-void mdMaterialSetUBO(MdRenderer &renderer, MdMaterial& material, u32 binding_index, usize offset, usize range, MdGPUBuffer &buffer)
+void mdGetFramePacingStats(MdFramePacingStats &stats)
 {
-    mdDescriptorSetWriteUBO(renderer, material.set, binding_index, offset, range, buffer);
+    stats.refresh_ms = frame_pacer.refresh_ns / 1000000.0;
+    stats.work_ms = frame_pacer.work_ns / 1000000.0;
+    stats.sleep_ms = frame_pacer.sleep_ns / 1000000.0;
+    stats.latency_ms = frame_pacer.latency_ns / 1000000.0;
+    stats.display_timing = (frame_pacer.p_get_past_timing != NULL);
 }
 #pragma endregion
 
@@ -1706,10 +5313,10 @@ VkResult mdCreateGlobalSetsAndLayouts(MdRenderer &renderer)
         &renderer_state.global_layout
     );
     if (result != VK_SUCCESS) return result;
+    uniform_allocator.RegisterLayout(bindings.data(), bindings.size());
 
     result = uniform_allocator.AllocateSets(
         renderer_state.global_layout, 
-        0, 
         1, 
         &renderer_state.global_set
     );
@@ -1742,12 +5349,12 @@ VkResult mdCreateMainCameraSetsAndLayouts(MdRenderer &renderer)
         &renderer_state.camera_set_layout
     );
     if (result != VK_SUCCESS) return result;
+    uniform_allocator.RegisterLayout(bindings.data(), bindings.size());
 
     VkDescriptorSet cam_set = VK_NULL_HANDLE;
     result = uniform_allocator.AllocateSets(
         renderer_state.camera_set_layout, 
         1, 
-        1, 
         &cam_set
     );
     if (result != VK_SUCCESS) return result;
@@ -1803,6 +5410,22 @@ MdResult mdCreateRendererState(MdRenderer &renderer)
     
     if (result != MD_SUCCESS) goto fail;
 
+    // Async compute runs on a separate compute family if there is one, else on the graphics queue
+    if (mdGetQueue(VK_QUEUE_COMPUTE_BIT, *renderer.context, renderer_state.compute_queue) != MD_SUCCESS)
+        renderer_state.compute_queue = renderer_state.graphics_queue;
+
+    // One timeline per VkQueue, the allocator copies the graphics queue so it has to come after
+    vk_result = mdCreateTimeline(*renderer.context, renderer_state.graphics_queue, renderer_state.graphics_timeline);
+    if (vk_result != VK_SUCCESS) { result = MD_ERROR_UNKNOWN; goto fail; }
+
+    if (renderer_state.compute_queue.queue_handle == renderer_state.graphics_queue.queue_handle)
+        renderer_state.compute_queue.p_timeline = &renderer_state.graphics_timeline;
+    else
+    {
+        vk_result = mdCreateTimeline(*renderer.context, renderer_state.compute_queue, renderer_state.compute_timeline);
+        if (vk_result != VK_SUCCESS) { result = MD_ERROR_UNKNOWN; goto fail; }
+    }
+
     // Create GPU memory allocator
     vk_result = mdCreateGPUAllocator(
         *renderer.context, 
@@ -1818,6 +5441,9 @@ MdResult mdCreateRendererState(MdRenderer &renderer)
     mdCreateGlobalSetsAndLayouts(renderer);
     mdCreateMainCameraSetsAndLayouts(renderer);
 
+    // Optional, pipelines only get the bindless set if the device supports descriptor indexing
+    mdCreateBindlessTable(renderer);
+
     mdRenderGraphInit(renderer.context);
     return result;
 
@@ -1828,8 +5454,15 @@ MdResult mdCreateRendererState(MdRenderer &renderer)
 
 void mdDestroyRendererState(MdRenderer &renderer)
 {
+    mdDisableShaderHotReload(renderer);
     mdRenderGraphDestroy();
+    mdFlushRetired();
+    mdDestroyPipelineVariants(renderer);
+    mdDestroyBindlessTable(renderer);
+    mdDestroyLayoutCache(renderer);
     mdDestroyGPUAllocator(renderer_state.allocator);
+    mdDestroyTimeline(renderer_state.compute_timeline);
+    mdDestroyTimeline(renderer_state.graphics_timeline);
 }
 
 MdResult mdCreateRenderer(u16 w, u16 h, const char *p_name, MdRenderer &renderer)
@@ -1881,6 +5514,67 @@ MdResult mdCreateRenderer(u16 w, u16 h, const char *p_name, MdRenderer &renderer
         return result;
 }
 
+MdResult mdCreateHeadlessRenderer(u16 w, u16 h, u32 image_count, MdRenderer &renderer)
+{
+    std::vector<const char*> instance_extensions;
+    mdInitDeletionQueue();
+
+    // The window only carries the size, nothing reads its context without a surface
+    renderer.window = {};
+    renderer.window.w = w;
+    renderer.window.h = h;
+
+    renderer.context = &renderer_context;
+    MdResult result = mdInitContext(*renderer.context, instance_extensions, true);
+    mdAddToDeletionQueue([&](){ mdDestroyContext(*renderer.context); });
+    if (result != MD_SUCCESS) goto fail;
+
+    result = mdCreateDevice(*renderer.context);
+    if (result != MD_SUCCESS) goto fail;
+
+    result = mdCreateOffscreenTargets(*renderer.context, w, h, image_count);
+    if (result != MD_SUCCESS) goto fail;
+
+    result = mdCreateRendererState(renderer);
+    mdAddToDeletionQueue([&](){ mdDestroyRendererState(renderer); });
+    if (result != MD_SUCCESS) goto fail;
+
+    return MD_SUCCESS;
+
+    fail:
+        mdDestroyRenderer(renderer);
+        return result;
+}
+
+MdResult mdRebuildSwapchain(MdRenderer &renderer, u16 w, u16 h)
+{
+    MdRenderContext *p_context = renderer.context;
+    VkSwapchainKHR old_swapchain = p_context->swapchain.swapchain;
+    std::vector<VkImageView> old_views = p_context->sw_image_views;
+
+    MdResult result = mdGetSwapchain(*p_context, true, w, h);
+    if (result != MD_SUCCESS)
+        return result;
+
+    // The retired swapchain can still have images being presented. It's tagged with the first frame
+    // recorded after the rebuild, which is presented on the new swapchain after the old presents
+    for (usize i=0; i<old_views.size(); i++)
+        mdRetireImageView(old_views[i]);
+    mdRetireSwapchain(old_swapchain);
+
+    VkResult vk_result = mdRenderGraphResize(p_context->swapchain.extent);
+    return (vk_result == VK_SUCCESS) ? MD_SUCCESS : MD_ERROR_UNKNOWN;
+}
+
+MdResult mdSetPresentMode(MdRenderer &renderer, VkPresentModeKHR mode, u32 image_count)
+{
+    renderer.context->present_mode = mode;
+    renderer.context->image_count = image_count;
+
+    VkExtent2D extent = renderer.context->swapchain.extent;
+    return mdRebuildSwapchain(renderer, extent.width, extent.height);
+}
+
 void mdDestroyRenderer(MdRenderer &renderer)
 {
     mdRunDeletionQueue();
@@ -1,12 +1,15 @@
 #include <renderer_vk/renderer_vk_helpers.h>
+#include <renderer_vk/renderer_vk_utils.h>
+#include <profiler/profiler.h>
 #include <vulkan/vulkan_core.h>
 
 #pragma region [ Render Context ]
-MdResult mdInitContext(MdRenderContext &context, const std::vector<const char*> &instance_extensions)
+MdResult mdInitContext(MdRenderContext &context, const std::vector<const char*> &instance_extensions, bool headless)
 {
     // Create the vulkan instance
     vkb::InstanceBuilder instance_builder;
     auto ret_instance = instance_builder
+        .set_headless(headless)
         .enable_extensions(instance_extensions)
         .require_api_version(VK_API_VERSION_1_3)
         .request_validation_layers()
@@ -34,6 +37,13 @@ void mdDestroyContext(MdRenderContext &context)
         }
     }
 
+    for (u32 i=0; i<context.offscreen_memory.size(); i++)
+    {
+        vkDestroyImage(context.device, context.sw_images[i], NULL);
+        vkFreeMemory(context.device, context.offscreen_memory[i], NULL);
+    }
+    context.offscreen_memory.clear();
+
     vkb::destroy_swapchain(context.swapchain);
     vkb::destroy_device(context.device);
     if (context.surface != VK_NULL_HANDLE)
@@ -54,8 +64,60 @@ MdResult mdCreateDevice(MdRenderContext &context)
         LOG_ERROR("failed to get physical device: %s\n", pdev_ret.error().message().c_str());
         return MD_ERROR_VULKAN_PHYSICAL_DEVICE_FAILURE;
     }
+
+    // Query optional features, these are only enabled if the device supports them
+    VkPhysicalDeviceVulkan12Features supported_12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceVulkan13Features supported_13 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    u32 device_version = pdev_ret.value().properties.apiVersion;
+    if (device_version >= VK_API_VERSION_1_2)
+    {
+        VkPhysicalDeviceFeatures2 features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        features.pNext = &supported_12;
+        supported_12.pNext = (device_version >= VK_API_VERSION_1_3) ? &supported_13 : NULL;
+        vkGetPhysicalDeviceFeatures2(pdev_ret.value(), &features);
+    }
+
+    VkPhysicalDeviceFeatures supported = {};
+    vkGetPhysicalDeviceFeatures(pdev_ret.value(), &supported);
+
+    // vk-bootstrap enables the physical device's features, which start out as the required ones
+    context.features = {};
+    context.features.pipelineStatisticsQuery = supported.pipelineStatisticsQuery;
+    pdev_ret.value().features.pipelineStatisticsQuery = supported.pipelineStatisticsQuery;
+
+    context.features_12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    context.features_13 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    context.features_13.dynamicRendering = supported_13.dynamicRendering;
+    context.features_13.synchronization2 = supported_13.synchronization2;
+
+    // Timeline semaphores, every queue submission signals one
+    context.features_12.timelineSemaphore = supported_12.timelineSemaphore;
+
+    // Descriptor indexing, used by the bindless tables
+    context.features_12.descriptorIndexing = supported_12.descriptorIndexing;
+    context.features_12.runtimeDescriptorArray = supported_12.runtimeDescriptorArray;
+    context.features_12.descriptorBindingPartiallyBound = supported_12.descriptorBindingPartiallyBound;
+    context.features_12.descriptorBindingUpdateUnusedWhilePending = supported_12.descriptorBindingUpdateUnusedWhilePending;
+    context.features_12.descriptorBindingSampledImageUpdateAfterBind = supported_12.descriptorBindingSampledImageUpdateAfterBind;
+    context.features_12.descriptorBindingStorageBufferUpdateAfterBind = supported_12.descriptorBindingStorageBufferUpdateAfterBind;
+    context.features_12.shaderSampledImageArrayNonUniformIndexing = supported_12.shaderSampledImageArrayNonUniformIndexing;
+    context.features_12.shaderStorageBufferArrayNonUniformIndexing = supported_12.shaderStorageBufferArrayNonUniformIndexing;
+
+    // Optional, frame pacing falls back to predicting present times on the CPU
+    context.display_timing = pdev_ret.value().enable_extension_if_present(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+
+    // Optional, lets the allocator report the budget the OS actually gives this process
+    context.memory_budget = pdev_ret.value().enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
     vkb::DeviceBuilder device_builder(pdev_ret.value());
+    if (device_version >= VK_API_VERSION_1_2)
+        device_builder.add_pNext(&context.features_12);
+    if (device_version >= VK_API_VERSION_1_3)
+        device_builder.add_pNext(&context.features_13);
+
     auto dev_ret = device_builder.build();
+    context.features_12.pNext = NULL;
+    context.features_13.pNext = NULL;
     if (!dev_ret)
     {
         LOG_ERROR("failed to create logical device: %s\n", dev_ret.error().message().c_str());
@@ -90,10 +152,19 @@ MdResult mdGetQueue(VkQueueFlagBits queue_type, MdRenderContext &context, MdRend
     return MD_SUCCESS;
 }
 
-MdResult mdGetSwapchain(MdRenderContext &context, bool rebuild)
+MdResult mdGetSwapchain(MdRenderContext &context, bool rebuild, u32 w, u32 h)
 {
     // Get swapchain
     vkb::SwapchainBuilder sw_builder(context.device);
+    if (w != 0 && h != 0)
+        sw_builder.set_desired_extent(w, h);
+    if (context.image_count != 0)
+        sw_builder.set_desired_min_image_count(context.image_count);
+
+    // FIFO is the only mode every surface supports
+    sw_builder
+        .set_desired_present_mode(context.present_mode)
+        .add_fallback_present_mode(VK_PRESENT_MODE_FIFO_KHR);
     auto sw_ret = (rebuild) ? sw_builder.set_old_swapchain(context.swapchain).build() : sw_builder.build();
     
     if (!sw_ret)
@@ -124,17 +195,234 @@ MdResult mdGetSwapchain(MdRenderContext &context, bool rebuild)
     return MD_SUCCESS;
 }
 
-//VkResult mdRebuildSwapchain(MdRenderContext &context, u16 w, u16 h)
-//{
-//    VkResult result = VK_ERROR_UNKNOWN;
-//
-//    if (context.swapchain.swapchain != VK_NULL_HANDLE)
-//        vkb::destroy_swapchain(context.swapchain);
-//
-//    mdGetSwapchain(context);
-//
-//    return result;
-//}
+MdResult mdCreateOffscreenTargets(MdRenderContext &context, u32 w, u32 h, u32 image_count)
+{
+    // Described the way a swapchain would be, the render graph only reads the extent and format
+    context.swapchain = {};
+    context.swapchain.image_count = image_count;
+    context.swapchain.image_format = VK_FORMAT_B8G8R8A8_SRGB;
+    context.swapchain.image_usage_flags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    context.swapchain.extent = {w, h};
+
+    VkImageCreateInfo image_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = context.swapchain.image_format;
+    image_info.extent = {w, h, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = context.swapchain.image_usage_flags;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = image_info.format;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(context.physical_device, &memory_properties);
+
+    // Added as they're created so a failure part way leaves them for mdDestroyContext
+    for (u32 i=0; i<image_count; i++)
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkResult result = vkCreateImage(context.device, &image_info, NULL, &image);
+        VK_CHECK_ANY(result, MD_ERROR_VULKAN_SWAPCHAIN_IMAGE_FAILURE, "failed to create offscreen image");
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(context.device, image, &requirements);
+
+        // Prefer device local memory, software implementations may only have host visible types
+        u32 type_index = UINT32_MAX;
+        for (u32 t=0; t<memory_properties.memoryTypeCount; t++)
+        {
+            if ((requirements.memoryTypeBits & (1u << t)) == 0)
+                continue;
+            
+            if (type_index == UINT32_MAX)
+                type_index = t;
+            if (memory_properties.memoryTypes[t].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+            {
+                type_index = t;
+                break;
+            }
+        }
+
+        VkMemoryAllocateInfo allocate_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+        allocate_info.allocationSize = requirements.size;
+        allocate_info.memoryTypeIndex = type_index;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        result = vkAllocateMemory(context.device, &allocate_info, NULL, &memory);
+        if (result != VK_SUCCESS)
+        {
+            vkDestroyImage(context.device, image, NULL);
+            LOG_ERROR("failed to allocate memory for offscreen image");
+            return MD_ERROR_VULKAN_SWAPCHAIN_IMAGE_FAILURE;
+        }
+
+        context.sw_images.push_back(image);
+        context.offscreen_memory.push_back(memory);
+
+        result = vkBindImageMemory(context.device, image, memory, 0);
+        VK_CHECK_ANY(result, MD_ERROR_VULKAN_SWAPCHAIN_IMAGE_FAILURE, "failed to bind offscreen image memory");
+
+        VkImageView view = VK_NULL_HANDLE;
+        view_info.image = image;
+        result = vkCreateImageView(context.device, &view_info, NULL, &view);
+        VK_CHECK_ANY(result, MD_ERROR_VULKAN_SWAPCHAIN_IMAGE_VIEW_FAILURE, "failed to create offscreen image view");
+        context.sw_image_views.push_back(view);
+    }
+
+    return MD_SUCCESS;
+}
+
+#pragma endregion
+
+#pragma region [ Timelines ]
+VkResult mdCreateTimeline(MdRenderContext &context, MdRenderQueue &queue, MdTimeline &timeline)
+{
+    if (!context.features_12.timelineSemaphore)
+    {
+        LOG_ERROR("timeline semaphores are not supported by the device");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    VkSemaphoreTypeCreateInfo type_info = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphore_info.pNext = &type_info;
+    VkResult result = vkCreateSemaphore(context.device, &semaphore_info, NULL, &timeline.semaphore);
+    VK_CHECK(result, "failed to create timeline semaphore");
+
+    timeline.device = context.device;
+    timeline.queue = queue.queue_handle;
+    timeline.submitted = 0;
+    timeline.completed = 0;
+    timeline.upload_value = 0;
+    queue.p_timeline = &timeline;
+
+    return result;
+}
+
+void mdDestroyTimeline(MdTimeline &timeline)
+{
+    if (timeline.semaphore == VK_NULL_HANDLE)
+        return;
+    
+    vkDestroySemaphore(timeline.device, timeline.semaphore, NULL);
+    timeline.semaphore = VK_NULL_HANDLE;
+}
+
+VkResult mdTimelineSubmit(  MdTimeline &timeline, 
+                            u32 buffer_count, 
+                            const VkCommandBuffer *p_buffers, 
+                            u32 wait_count, 
+                            const MdTimelineWait *p_waits, 
+                            VkSemaphore binary_wait, 
+                            VkPipelineStageFlags binary_wait_stage, 
+                            VkSemaphore binary_signal, 
+                            u64 *p_value)
+{
+    if (wait_count > MD_TIMELINE_MAX_WAITS)
+    {
+        LOG_ERROR("submission waits on %d values, at most %d are supported", wait_count, MD_TIMELINE_MAX_WAITS);
+        return VK_ERROR_UNKNOWN;
+    }
+
+    // Binary semaphores ignore their value, so they share the value arrays with the timelines
+    VkSemaphore wait_sems[MD_TIMELINE_MAX_WAITS + 1], signal_sems[2];
+    VkPipelineStageFlags wait_stages[MD_TIMELINE_MAX_WAITS + 1];
+    u64 wait_values[MD_TIMELINE_MAX_WAITS + 1], signal_values[2];
+    u32 wait_total = 0, signal_total = 0;
+
+    for (u32 i=0; i<wait_count; i++)
+    {
+        wait_sems[wait_total] = p_waits[i].p_timeline->semaphore;
+        wait_stages[wait_total] = p_waits[i].stage;
+        wait_values[wait_total++] = p_waits[i].value;
+    }
+
+    if (binary_wait != VK_NULL_HANDLE)
+    {
+        wait_sems[wait_total] = binary_wait;
+        wait_stages[wait_total] = binary_wait_stage;
+        wait_values[wait_total++] = 0;
+    }
+
+    if (binary_signal != VK_NULL_HANDLE)
+    {
+        signal_sems[signal_total] = binary_signal;
+        signal_values[signal_total++] = 0;
+    }
+
+    std::lock_guard<std::mutex> guard(timeline.lock);
+    u64 value = timeline.submitted + 1;
+    signal_sems[signal_total] = timeline.semaphore;
+    signal_values[signal_total++] = value;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timeline_info.waitSemaphoreValueCount = wait_total;
+    timeline_info.pWaitSemaphoreValues = wait_values;
+    timeline_info.signalSemaphoreValueCount = signal_total;
+    timeline_info.pSignalSemaphoreValues = signal_values;
+
+    VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = buffer_count;
+    submit_info.pCommandBuffers = p_buffers;
+    submit_info.waitSemaphoreCount = wait_total;
+    submit_info.pWaitSemaphores = wait_sems;
+    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.signalSemaphoreCount = signal_total;
+    submit_info.pSignalSemaphores = signal_sems;
+
+    VkResult result = vkQueueSubmit(timeline.queue, 1, &submit_info, VK_NULL_HANDLE);
+    VK_CHECK(result, "failed to submit to timeline");
+
+    timeline.submitted = value;
+    if (p_value != NULL)
+        *p_value = value;
+
+    return result;
+}
+
+bool mdTimelineIsComplete(MdTimeline &timeline, u64 value)
+{
+    if (value <= timeline.completed.load(std::memory_order_acquire))
+        return true;
+
+    u64 counter = 0;
+    if (vkGetSemaphoreCounterValue(timeline.device, timeline.semaphore, &counter) != VK_SUCCESS)
+        return false;
+    
+    // Other threads can query at the same time, the cached value only moves forward
+    u64 cached = timeline.completed.load(std::memory_order_relaxed);
+    while (cached < counter && !timeline.completed.compare_exchange_weak(cached, counter));
+    return value <= counter;
+}
+
+VkResult mdTimelineWait(MdTimeline &timeline, u64 value, u64 timeout)
+{
+    if (mdTimelineIsComplete(timeline, value))
+        return VK_SUCCESS;
+
+    VkSemaphoreWaitInfo wait_info = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline.semaphore;
+    wait_info.pValues = &value;
+    VkResult result = vkWaitSemaphores(timeline.device, &wait_info, timeout);
+    if (result != VK_SUCCESS)
+        return result;
+
+    u64 cached = timeline.completed.load(std::memory_order_relaxed);
+    while (cached < value && !timeline.completed.compare_exchange_weak(cached, value));
+    return result;
+}
+
 #pragma endregion
 
 #pragma region [ Command Encoder ]
@@ -185,8 +473,12 @@ VkResult mdCreateGPUAllocator(MdRenderContext &context, MdGPUAllocator &allocato
     alloc_info.pAllocationCallbacks = NULL;
     alloc_info.pDeviceMemoryCallbacks = NULL;
     alloc_info.vulkanApiVersion = context.api_version;
+    if (context.memory_budget)
+        alloc_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
     VkResult result = vmaCreateAllocator(&alloc_info, &allocator.allocator);
     VK_CHECK(result, "failed to create memory allocator");
+    allocator.categories = {};
+    allocator.heaps_over_threshold = 0;
 
     VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
     buffer_info.flags = 0;
@@ -206,6 +498,7 @@ VkResult mdCreateGPUAllocator(MdRenderContext &context, MdGPUAllocator &allocato
         &allocator.staging_buffer.allocation_info
     );
     VK_CHECK(result, "failed to allocate memory for staging buffer");
+    mdTrackAllocation(allocator, allocator.staging_buffer.allocation, MD_MEMORY_CATEGORY_STAGING);
 
     allocator.queue = queue;
     allocator.staging_buffer.size = staging_buffer_size;
@@ -213,7 +506,166 @@ VkResult mdCreateGPUAllocator(MdRenderContext &context, MdGPUAllocator &allocato
     return result;
 }
 
-VkResult mdAllocateGPUBuffer(VkBufferUsageFlags usage, u32 size, MdGPUAllocator &allocator, MdGPUBuffer &buffer)
+static const char *md_memory_category_names[MD_MEMORY_CATEGORY_COUNT] = {
+    "mesh", 
+    "texture", 
+    "attachment", 
+    "staging", 
+    "uniform"
+};
+
+const char *mdGetMemoryCategoryName(MdMemoryCategory category)
+{
+    return (category < MD_MEMORY_CATEGORY_COUNT) ? md_memory_category_names[category] : "unknown";
+}
+
+u32 mdGetMemoryBudgets(MdGPUAllocator &allocator, MdMemoryHeapBudget *p_budgets)
+{
+    // Without VK_EXT_memory_budget VMA estimates usage from its own blocks and the budget from the heap size
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(allocator.allocator, budgets);
+
+    const VkPhysicalDeviceMemoryProperties *p_properties = NULL;
+    vmaGetMemoryProperties(allocator.allocator, &p_properties);
+    for (u32 h=0; h<p_properties->memoryHeapCount; h++)
+    {
+        p_budgets[h].usage = budgets[h].usage;
+        p_budgets[h].budget = budgets[h].budget;
+        p_budgets[h].block_bytes = budgets[h].statistics.blockBytes;
+        p_budgets[h].allocation_bytes = budgets[h].statistics.allocationBytes;
+        p_budgets[h].device_local = (p_properties->memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    return p_properties->memoryHeapCount;
+}
+
+void mdCheckMemoryBudgets(MdGPUAllocator &allocator)
+{
+    MdMemoryHeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+    u32 heap_count = mdGetMemoryBudgets(allocator, budgets);
+    for (u32 h=0; h<heap_count; h++)
+    {
+        u32 bit = 1u << h;
+        bool over = budgets[h].usage > (VkDeviceSize)(allocator.budget_threshold * budgets[h].budget);
+        if (over && (allocator.heaps_over_threshold & bit) == 0)
+        {
+            LOG_WARNING(
+                "memory heap %d is using %.1fMiB of its %.1fMiB budget, over the %.0f%% threshold", 
+                h, 
+                budgets[h].usage / 1048576.0, 
+                budgets[h].budget / 1048576.0, 
+                allocator.budget_threshold * 100.0f
+            );
+        }
+        allocator.heaps_over_threshold = (over) 
+            ? (allocator.heaps_over_threshold | bit) 
+            : (allocator.heaps_over_threshold & ~bit);
+    }
+}
+
+void mdTrackAllocation(MdGPUAllocator &allocator, VmaAllocation allocation, MdMemoryCategory category)
+{
+    // The name shows up in the JSON stats, the user data is read back when the allocation is freed.
+    // It's stored as category + 1 so untracked allocations, which have NULL user data, are told apart
+    vmaSetAllocationUserData(allocator.allocator, allocation, (void*)((uintptr_t)category + 1));
+    vmaSetAllocationName(allocator.allocator, allocation, mdGetMemoryCategoryName(category));
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(allocator.allocator, allocation, &info);
+    allocator.categories[category].bytes += info.size;
+    allocator.categories[category].allocation_count++;
+    mdCheckMemoryBudgets(allocator);
+}
+
+void mdUntrackAllocation(MdGPUAllocator &allocator, VmaAllocation allocation)
+{
+    if (allocation == VK_NULL_HANDLE)
+        return;
+    
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(allocator.allocator, allocation, &info);
+    uintptr_t category = (uintptr_t)info.pUserData;
+    if (category == 0 || category > MD_MEMORY_CATEGORY_COUNT)
+        return;
+    
+    // Cleared, so untracking twice doesn't count the allocation twice
+    vmaSetAllocationUserData(allocator.allocator, allocation, NULL);
+    allocator.categories[category - 1].bytes -= info.size;
+    allocator.categories[category - 1].allocation_count--;
+}
+
+void mdGetMemoryCategoryUsage(MdGPUAllocator &allocator, MdMemoryCategoryUsage *p_usage)
+{
+    for (u32 c=0; c<MD_MEMORY_CATEGORY_COUNT; c++)
+        p_usage[c] = allocator.categories[c];
+}
+
+void mdSetMemoryBudgetThreshold(MdGPUAllocator &allocator, f32 threshold)
+{
+    allocator.budget_threshold = threshold;
+    allocator.heaps_over_threshold = 0;
+}
+
+bool mdBeginMemoryFrame(MdGPUAllocator &allocator, u32 frame_index)
+{
+    vmaSetCurrentFrameIndex(allocator.allocator, frame_index);
+    mdCheckMemoryBudgets(allocator);
+    return allocator.heaps_over_threshold == 0;
+}
+
+MdResult mdWriteMemoryStats(MdGPUAllocator &allocator, const char *p_path, bool detailed_map)
+{
+    FILE *p_file = fopen(p_path, "w");
+    if (p_file == NULL)
+    {
+        LOG_ERROR("failed to open \"%s\" for writing", p_path);
+        return MD_ERROR_FILE_WRITE_FAILURE;
+    }
+
+    char *p_stats = NULL;
+    vmaBuildStatsString(allocator.allocator, &p_stats, (detailed_map) ? VK_TRUE : VK_FALSE);
+    usize length = strlen(p_stats);
+    bool written = fwrite(p_stats, 1, length, p_file) == length;
+    vmaFreeStatsString(allocator.allocator, p_stats);
+    fclose(p_file);
+
+    if (!written)
+    {
+        LOG_ERROR("failed to write memory statistics to \"%s\"", p_path);
+        return MD_ERROR_FILE_WRITE_FAILURE;
+    }
+
+    return MD_SUCCESS;
+}
+
+void mdPrintMemoryUsage(MdGPUAllocator &allocator)
+{
+    for (u32 c=0; c<MD_MEMORY_CATEGORY_COUNT; c++)
+    {
+        printf(
+            "Memory \"%s\": %.2fMiB in %d allocations\n", 
+            md_memory_category_names[c], 
+            allocator.categories[c].bytes / 1048576.0, 
+            allocator.categories[c].allocation_count
+        );
+    }
+
+    MdMemoryHeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+    u32 heap_count = mdGetMemoryBudgets(allocator, budgets);
+    for (u32 h=0; h<heap_count; h++)
+    {
+        printf(
+            "Heap %d (%s): %.2fMiB of %.2fMiB budget used, %.2fMiB in this allocator's blocks\n", 
+            h, 
+            (budgets[h].device_local) ? "device local" : "host", 
+            budgets[h].usage / 1048576.0, 
+            budgets[h].budget / 1048576.0, 
+            budgets[h].block_bytes / 1048576.0
+        );
+    }
+}
+
+VkResult mdAllocateGPUBuffer(VkBufferUsageFlags usage, u32 size, MdGPUAllocator &allocator, MdGPUBuffer &buffer, MdMemoryCategory category)
 {
     VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
     buffer_info.flags = 0;
@@ -233,6 +685,7 @@ VkResult mdAllocateGPUBuffer(VkBufferUsageFlags usage, u32 size, MdGPUAllocator
         &buffer.allocation_info
     );
     VK_CHECK(result, "failed to allocate buffer");
+    mdTrackAllocation(allocator, buffer.allocation, category);
 
     buffer.size = size;
     buffer.free = false;
@@ -259,6 +712,7 @@ VkResult mdAllocateGPUUniformBuffer(u32 size, MdGPUAllocator &allocator, MdGPUBu
         &buffer.allocation_info
     );
     VK_CHECK(result, "failed to allocate buffer");
+    mdTrackAllocation(allocator, buffer.allocation, MD_MEMORY_CATEGORY_UNIFORM);
 
     buffer.size = size;
     buffer.free = false;
@@ -270,6 +724,7 @@ void mdFreeGPUBuffer(MdGPUAllocator &allocator, MdGPUBuffer &buffer)
     if (buffer.free == true)
         return;
     
+    mdUntrackAllocation(allocator, buffer.allocation);
     vmaDestroyBuffer(allocator.allocator, buffer.buffer, buffer.allocation);
     buffer.free = false;
 }
@@ -280,10 +735,60 @@ void mdFreeUniformBuffer(MdGPUAllocator &allocator, MdGPUBuffer &buffer)
         return;
     
     vmaUnmapMemory(allocator.allocator, buffer.allocation);
+    mdUntrackAllocation(allocator, buffer.allocation);
     vmaDestroyBuffer(allocator.allocator, buffer.buffer, buffer.allocation);
     buffer.free = false;
 }
 
+void mdReleaseUploads(MdGPUAllocator &allocator, bool wait)
+{
+    MdTimeline *p_timeline = allocator.queue.p_timeline;
+    usize kept = 0;
+    for (usize i=0; i<allocator.pending_uploads.size(); i++)
+    {
+        MdPendingUpload *p_upload = &allocator.pending_uploads[i];
+        if (wait)
+            mdTimelineWait(*p_timeline, p_upload->value);
+        else if (!mdTimelineIsComplete(*p_timeline, p_upload->value))
+        {
+            allocator.pending_uploads[kept++] = *p_upload;
+            continue;
+        }
+
+        // Command buffers are freed along with their pool
+        vkDestroyCommandPool(allocator.device, p_upload->pool, NULL);
+        if (p_upload->buffer != VK_NULL_HANDLE)
+        {
+            mdUntrackAllocation(allocator, p_upload->allocation);
+            vmaDestroyBuffer(allocator.allocator, p_upload->buffer, p_upload->allocation);
+        }
+    }
+    allocator.pending_uploads.resize(kept);
+}
+
+// Submits a recorded upload on the allocator's queue timeline, its pool and staging buffer are 
+// released by mdReleaseUploads once the value completes
+VkResult mdSubmitUpload(    MdGPUAllocator &allocator, 
+                            VkCommandPool pool, 
+                            VkCommandBuffer cmd_buffer, 
+                            VkBuffer staging_buffer, 
+                            VmaAllocation staging_allocation, 
+                            u64 *p_value)
+{
+    vkEndCommandBuffer(cmd_buffer);
+
+    MdTimeline *p_timeline = allocator.queue.p_timeline;
+    VkResult result = mdTimelineSubmit(*p_timeline, 1, &cmd_buffer, 0, NULL, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, p_value);
+    VK_CHECK(result, "failed to submit upload");
+    
+    u64 value = *p_value;
+    u64 upload_value = p_timeline->upload_value.load(std::memory_order_relaxed);
+    while (upload_value < value && !p_timeline->upload_value.compare_exchange_weak(upload_value, value));
+
+    allocator.pending_uploads.push_back({value, pool, staging_buffer, staging_allocation});
+    return result;
+}
+
 VkResult mdUploadToGPUBuffer(   MdRenderContext &context, 
                                 MdGPUAllocator &allocator, 
                                 u32 offset, 
@@ -293,6 +798,7 @@ VkResult mdUploadToGPUBuffer(   MdRenderContext &context,
                                 MdCommandEncoder *p_command_encoder,
                                 u32 command_buffer_index)
 {
+    MD_PROFILE_SCOPE("mdUploadToGPUBuffer");
     u32 size = range - offset;
     u32 block_size = allocator.staging_buffer.size;
     u32 block_count = (size / block_size) + 1;
@@ -320,7 +826,12 @@ VkResult mdUploadToGPUBuffer(   MdRenderContext &context,
     }
     else cmd_buffer = p_command_encoder->buffers[command_buffer_index];
 
-    // Set up data pointers
+    // Set up data pointers, the last upload reading the staging buffer has to finish first
+    if (!active_recording)
+    {
+        mdReleaseUploads(allocator);
+        mdTimelineWait(*allocator.queue.p_timeline, allocator.staging_value);
+    }
     void *dst = allocator.staging_buffer.allocation_info.pMappedData; 
     u8 *data_ptr = (u8*)p_data;
     
@@ -355,16 +866,8 @@ VkResult mdUploadToGPUBuffer(   MdRenderContext &context,
 
     if (!active_recording)
     {
-        vkEndCommandBuffer(cmd_buffer);
-        VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &cmd_buffer;
-        
-        vkQueueSubmit(allocator.queue.queue_handle, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(allocator.queue.queue_handle);
-
-        vkFreeCommandBuffers(context.device, cmd_pool, 1, &cmd_buffer);
-        vkDestroyCommandPool(context.device, cmd_pool, NULL);
+        result = mdSubmitUpload(allocator, cmd_pool, cmd_buffer, VK_NULL_HANDLE, VK_NULL_HANDLE, &allocator.staging_value);
+        VK_CHECK(result, "failed to submit buffer upload");
     }
 
     return result;
@@ -538,6 +1041,7 @@ VkResult mdBuildTexture2D(  MdRenderContext &context,
                             MdCommandEncoder *p_command_encoder,
                             u32 command_buffer_index)
 {
+    MD_PROFILE_SCOPE("mdBuildTexture2D");
     texture.channels = tex_builder.channels;
     texture.w = tex_builder.image_info.extent.width;
     texture.h = tex_builder.image_info.extent.height;
@@ -558,6 +1062,7 @@ VkResult mdBuildTexture2D(  MdRenderContext &context,
         &texture.allocation_info
     );
     VK_CHECK(result, "failed to create image allocation");
+    mdTrackAllocation(allocator, texture.allocation, MD_MEMORY_CATEGORY_TEXTURE);
     
     tex_builder.image_view_info.image = texture.image;
     result = vkCreateImageView(context.device, &tex_builder.image_view_info, NULL, &texture.image_view);
@@ -565,6 +1070,7 @@ VkResult mdBuildTexture2D(  MdRenderContext &context,
 
     result = vkCreateSampler(context.device, &tex_builder.sampler_info, NULL, &texture.sampler);
     VK_CHECK(result, "failed to create texture image sampler");
+    texture.sampler_info = tex_builder.sampler_info;
 
     MdGPUBuffer image_staging_buffer = {};
     VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
@@ -585,6 +1091,7 @@ VkResult mdBuildTexture2D(  MdRenderContext &context,
         &image_staging_buffer.allocation_info
     );
     VK_CHECK(result, "failed to create image staging buffer");
+    mdTrackAllocation(allocator, image_staging_buffer.allocation, MD_MEMORY_CATEGORY_STAGING);
 
     MdCommandEncoder encoder = {};
     VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
@@ -654,19 +1161,22 @@ VkResult mdBuildTexture2D(  MdRenderContext &context,
 
     if (p_command_encoder == NULL)
     {
-        vkEndCommandBuffer(cmd_buffer);
-
-        VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &cmd_buffer;
-
-        vkQueueSubmit(allocator.queue.queue_handle, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(allocator.queue.queue_handle);
-
-        mdDestroyCommandEncoder(context, encoder);    
+        u64 value = 0;
+        result = mdSubmitUpload(
+            allocator, 
+            encoder.pool, 
+            cmd_buffer, 
+            image_staging_buffer.buffer, 
+            image_staging_buffer.allocation, 
+            &value
+        );
+        VK_CHECK(result, "failed to submit texture upload");
+    }
+    else
+    {
+        mdUntrackAllocation(allocator, image_staging_buffer.allocation);
+        vmaDestroyBuffer(allocator.allocator, image_staging_buffer.buffer, image_staging_buffer.allocation);
     }
-    
-    vmaDestroyBuffer(allocator.allocator, image_staging_buffer.buffer, image_staging_buffer.allocation);
 
     return result;
 }
@@ -711,6 +1221,7 @@ VkResult mdBuildDepthAttachmentTexture2D(   MdRenderContext &context,
         &texture.allocation_info
     );
     VK_CHECK(result, "failed to allocate memory for texture");
+    mdTrackAllocation(allocator, texture.allocation, MD_MEMORY_CATEGORY_ATTACHMENT);
     
     // Destroy the backing image since we no longer need it, create the actual image and bind it
     vkDestroyImage(context.device, backing_image, NULL);
@@ -726,6 +1237,7 @@ VkResult mdBuildDepthAttachmentTexture2D(   MdRenderContext &context,
 
     result = vkCreateSampler(context.device, &tex_builder.sampler_info, NULL, &texture.sampler);
     VK_CHECK(result, "failed to create texture image sampler");
+    texture.sampler_info = tex_builder.sampler_info;
 
     MdCommandEncoder encoder = {};
     VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
@@ -763,16 +1275,9 @@ VkResult mdBuildDepthAttachmentTexture2D(   MdRenderContext &context,
     
     if (p_command_encoder == NULL)
     {
-        vkEndCommandBuffer(cmd_buffer);
-
-        VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &cmd_buffer;
-
-        vkQueueSubmit(allocator.queue.queue_handle, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(allocator.queue.queue_handle);
-
-        mdDestroyCommandEncoder(context, encoder);    
+        u64 value = 0;
+        result = mdSubmitUpload(allocator, encoder.pool, cmd_buffer, VK_NULL_HANDLE, VK_NULL_HANDLE, &value);
+        VK_CHECK(result, "failed to submit layout transition");
     }
     
     return result;
@@ -815,6 +1320,7 @@ VkResult mdBuildColorAttachmentTexture2D(   MdRenderContext &context,
         &texture.allocation_info
     );
     VK_CHECK(result, "failed to allocate memory for texture");
+    mdTrackAllocation(allocator, texture.allocation, MD_MEMORY_CATEGORY_ATTACHMENT);
     
     // Destroy the backing image since we no longer need it, create the actual image and bind it
     vkDestroyImage(context.device, backing_image, NULL);
@@ -830,6 +1336,7 @@ VkResult mdBuildColorAttachmentTexture2D(   MdRenderContext &context,
 
     result = vkCreateSampler(context.device, &tex_builder.sampler_info, NULL, &texture.sampler);
     VK_CHECK(result, "failed to create texture image sampler");
+    texture.sampler_info = tex_builder.sampler_info;
 
     MdCommandEncoder encoder = {};
     VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
@@ -867,16 +1374,9 @@ VkResult mdBuildColorAttachmentTexture2D(   MdRenderContext &context,
     
     if (p_command_encoder == NULL)
     {
-        vkEndCommandBuffer(cmd_buffer);
-
-        VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &cmd_buffer;
-
-        vkQueueSubmit(allocator.queue.queue_handle, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(allocator.queue.queue_handle);
-
-        mdDestroyCommandEncoder(context, encoder);    
+        u64 value = 0;
+        result = mdSubmitUpload(allocator, encoder.pool, cmd_buffer, VK_NULL_HANDLE, VK_NULL_HANDLE, &value);
+        VK_CHECK(result, "failed to submit layout transition");
     }
     
     return result;
@@ -898,8 +1398,7 @@ VkResult mdResizeAttachmentTexture( MdRenderContext &context,
         return VK_ERROR_UNKNOWN;
     }
 
-    if (texture.sampler != VK_NULL_HANDLE)
-        vkDestroySampler(context.device, texture.sampler, NULL);
+    // Samplers don't depend on the extent, keeping them keeps immutable samplers in set layouts valid
     if (texture.image_view != VK_NULL_HANDLE)
         vkDestroyImageView(context.device, texture.image_view, NULL);
     if (texture.image != VK_NULL_HANDLE)
@@ -918,8 +1417,12 @@ VkResult mdResizeAttachmentTexture( MdRenderContext &context,
     result = vkCreateImageView(context.device, &tex_builder.image_view_info, NULL, &texture.image_view);
     VK_CHECK(result, "failed to create texture image view");
 
-    result = vkCreateSampler(context.device, &tex_builder.sampler_info, NULL, &texture.sampler);
-    VK_CHECK(result, "failed to create texture image sampler");
+    if (texture.sampler == VK_NULL_HANDLE)
+    {
+        result = vkCreateSampler(context.device, &tex_builder.sampler_info, NULL, &texture.sampler);
+        VK_CHECK(result, "failed to create texture image sampler");
+        texture.sampler_info = tex_builder.sampler_info;
+    }
 
     return result;
 }
@@ -970,6 +1473,7 @@ void mdDestroyTexture(MdGPUAllocator &allocator, MdGPUTexture &texture)
         texture.image_view = VK_NULL_HANDLE;
     }
     
+    mdUntrackAllocation(allocator, texture.allocation);
     vmaDestroyImage(allocator.allocator, texture.image, texture.allocation);
 }
 
@@ -982,11 +1486,14 @@ void mdDestroyAttachmentTexture(MdGPUAllocator &allocator, MdGPUTexture &texture
     if (texture.image != VK_NULL_HANDLE)
         vkDestroyImage(allocator.device, texture.image, NULL);
 
+    mdUntrackAllocation(allocator, texture.allocation);
     vmaFreeMemory(allocator.allocator, texture.allocation);
 }
 
 void mdDestroyGPUAllocator(MdGPUAllocator &allocator)
 {
+    mdReleaseUploads(allocator, true);
+    mdUntrackAllocation(allocator, allocator.staging_buffer.allocation);
     vmaDestroyBuffer(
         allocator.allocator, 
         allocator.staging_buffer.buffer, 
@@ -1145,7 +1652,7 @@ VkResult mdLoadShaderSPIRV( MdRenderContext &context,
                             MdShaderSource &source)
 {
     VkPipelineShaderStageCreateInfo stage_info = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-    stage_info.pSpecializationInfo = NULL; // TO-DO: worry about this later
+    stage_info.pSpecializationInfo = NULL; // Filled in at pipeline creation
     stage_info.pName = "main";
     stage_info.flags = 0;
     stage_info.stage = stage;
@@ -1158,6 +1665,50 @@ VkResult mdLoadShaderSPIRV( MdRenderContext &context,
     VK_CHECK(result, "failed to create shader module");
 
     source.modules.push_back(stage_info);
+    source.code_hashes.push_back(mdHashBytes(p_code, code_size));
+
+    // Only this stage's declarations are added, so bindings set up by hand between loads stay as they are
+    MdShaderReflection stage_reflection;
+    result = mdReflectSPIRV(code_size, p_code, stage, stage_reflection);
+    VK_CHECK(result, "failed to reflect shader module");
+    mdMergeShaderReflection(source.reflection, stage_reflection);
+    if (stage == VK_SHADER_STAGE_VERTEX_BIT)
+        source.reflection.vertex_inputs = stage_reflection.vertex_inputs;
+
+    for (usize i=0; i<stage_reflection.bindings.size(); i++)
+    {
+        const MdReflectedBinding &binding = stage_reflection.bindings[i];
+        if (binding.set != MD_MATERIAL_SET_INDEX)
+            continue;
+
+        if (binding.count == 0)
+        {
+            LOG_ERROR("runtime array at set %d binding %d must be declared through the bindless set", binding.set, binding.binding);
+            continue;
+        }
+
+        // Already declared by an earlier stage or by hand, that declaration only gains this stage
+        bool found = false;
+        for (usize j=0; j<source.bindings.size(); j++)
+        {
+            if (source.bindings[j].binding != binding.binding)
+                continue;
+
+            source.bindings[j].stageFlags |= binding.stages;
+            found = true;
+            break;
+        }
+
+        if (!found)
+            mdShaderAddBinding(source, binding.binding, binding.type, binding.count, binding.stages);
+    }
+
+    for (usize i=0; i<stage_reflection.push_constants.size(); i++)
+    {
+        const VkPushConstantRange &range = stage_reflection.push_constants[i];
+        mdShaderAddPushConstants(source, range.stageFlags, range.offset, range.size);
+    }
+
     return result;
 }
 
@@ -1168,15 +1719,108 @@ void mdShaderAddBinding(    MdShaderSource &source,
                             VkShaderStageFlags stage_flags, 
                             const VkSampler* p_immutable_samplers)
 {
-    source.bindings.push_back({
+    VkDescriptorSetLayoutBinding binding = {
         .binding = binding_index,
         .descriptorType = type,
         .descriptorCount = count,
         .stageFlags = stage_flags,
         .pImmutableSamplers = p_immutable_samplers
+    };
+
+    for (usize i=0; i<source.bindings.size(); i++)
+    {
+        if (source.bindings[i].binding != binding_index)
+            continue;
+
+        source.bindings[i] = binding;
+        return;
+    }
+
+    source.bindings.push_back(binding);
+}
+
+void mdShaderAddPushConstants(  MdShaderSource &source, 
+                                VkShaderStageFlags stage_flags, 
+                                u32 offset, 
+                                u32 size)
+{
+    // Offsets and sizes have to be multiples of 4, only 128 bytes are guaranteed to be available
+    if ((offset % 4) != 0 || (size % 4) != 0 || size == 0)
+    {
+        LOG_ERROR("push constant range [%d, %d) must be a non-empty multiple of 4 bytes", offset, offset + size);
+        return;
+    }
+    
+    for (usize i=0; i<source.push_constants.size(); i++)
+    {
+        VkPushConstantRange &range = source.push_constants[i];
+        if (range.offset != offset || range.size != size)
+            continue;
+
+        range.stageFlags |= stage_flags;
+        return;
+    }
+
+    source.push_constants.push_back({
+        .stageFlags = stage_flags,
+        .offset = offset,
+        .size = size
     });
 }
 
+void mdShaderSetSpecConstant(   MdShaderSource &source, 
+                                u32 constant_id, 
+                                const void *p_data, 
+                                u32 size)
+{
+    for (usize i=0; i<source.spec_entries.size(); i++)
+    {
+        VkSpecializationMapEntry *p_entry = &source.spec_entries[i];
+        if (p_entry->constantID != constant_id)
+            continue;
+
+        if (p_entry->size != size)
+        {
+            LOG_ERROR("specialization constant %d was set with a different size (%d, was %d)\n", constant_id, size, (u32)p_entry->size);
+            return;
+        }
+        memcpy(source.spec_data.data() + p_entry->offset, p_data, size);
+        return;
+    }
+
+    VkSpecializationMapEntry entry = {};
+    entry.constantID = constant_id;
+    entry.offset = source.spec_data.size();
+    entry.size = size;
+    source.spec_entries.push_back(entry);
+
+    source.spec_data.resize(entry.offset + size);
+    memcpy(source.spec_data.data() + entry.offset, p_data, size);
+}
+
+VkResult mdShaderGetSpecializationInfo(const MdShaderSource &source, VkSpecializationInfo &info)
+{
+    for (usize i=0; i<source.spec_entries.size(); i++)
+    {
+        const VkSpecializationMapEntry *p_entry = &source.spec_entries[i];
+        for (usize j=0; j<source.reflection.spec_constants.size(); j++)
+        {
+            const MdReflectedSpecConstant *p_spec = &source.reflection.spec_constants[j];
+            if (p_spec->id == p_entry->constantID && p_spec->size != p_entry->size)
+            {
+                LOG_ERROR("specialization constant %d is %d bytes, but was set with %d\n", p_spec->id, p_spec->size, (u32)p_entry->size);
+                return VK_ERROR_UNKNOWN;
+            }
+        }
+    }
+
+    info.mapEntryCount = source.spec_entries.size();
+    info.pMapEntries = source.spec_entries.data();
+    info.dataSize = source.spec_data.size();
+    info.pData = source.spec_data.data();
+    return VK_SUCCESS;
+}
+
 void mdDestroyShaderSource(MdRenderContext &context, MdShaderSource &source)
 {
     if (source.modules.size() > 0)
@@ -1440,6 +2084,59 @@ void mdBuildGeometryInputState(MdPipelineGeometryInputState &stage)
     stage.vertex_info.pVertexBindingDescriptions = stage.bindings.data();
 }
 
+MdVertexLayout mdDefaultVertexLayout()
+{
+    MdVertexLayout layout;
+    layout.stride = 8*sizeof(f32);
+    layout.offsets = {0, 3*sizeof(f32), 6*sizeof(f32)};
+    return layout;
+}
+
+void mdGeometryInputFromReflection( MdPipelineGeometryInputState &stage, 
+                                    const MdShaderSource &source, 
+                                    const MdVertexLayout *p_layout)
+{
+    const std::vector<MdReflectedVertexInput> &inputs = source.reflection.vertex_inputs;
+    if (inputs.size() == 0)
+        return;
+
+    u32 binding = stage.bindings.size();
+    u32 offset = 0;
+    for (usize i=0; i<inputs.size(); i++)
+    {
+        VkVertexInputAttributeDescription attribute = {};
+        attribute.binding = binding;
+        attribute.location = inputs[i].location;
+        attribute.format = inputs[i].format;
+
+        if (p_layout == NULL)
+        {
+            // Packing can't know what sits in a skipped location
+            if (inputs[i].location != i)
+                LOG_ERROR("vertex input locations skip %d, their offsets need a vertex layout\n", (u32)i);
+
+            attribute.offset = offset;
+            offset += inputs[i].size;
+        }
+        else
+        {
+            if (inputs[i].location >= p_layout->offsets.size())
+            {
+                LOG_ERROR("vertex layout has no offset for location %d\n", inputs[i].location);
+                continue;
+            }
+
+            attribute.offset = p_layout->offsets[inputs[i].location];
+            if (attribute.offset + inputs[i].size > p_layout->stride)
+                LOG_ERROR("vertex input at location %d reads past the vertex stride (%d)\n", inputs[i].location, p_layout->stride);
+        }
+
+        stage.attributes.push_back(attribute);
+    }
+
+    mdGeometryInputAddVertexBinding(stage, VK_VERTEX_INPUT_RATE_VERTEX, (p_layout != NULL) ? p_layout->stride : offset);
+}
+
 void mdBuildDefaultGeometryInputState(MdPipelineGeometryInputState &stage)
 {
     mdInitGeometryInputState(stage);
@@ -0,0 +1,473 @@
+#include <renderer_vk/renderer_vk_reflect.h>
+
+#include <algorithm>
+
+#pragma region [ SPIR-V Reflection ]
+#define MD_SPIRV_MAGIC 0x07230203
+#define MD_SPIRV_HEADER_WORDS 5
+
+// Only the opcodes, decorations and storage classes the reflector cares about
+enum MdSpvOp
+{
+    MD_SPV_OP_DECORATE                      = 71,
+    MD_SPV_OP_MEMBER_DECORATE               = 72,
+    MD_SPV_OP_TYPE_BOOL                     = 20,
+    MD_SPV_OP_TYPE_INT                      = 21,
+    MD_SPV_OP_TYPE_FLOAT                    = 22,
+    MD_SPV_OP_TYPE_VECTOR                   = 23,
+    MD_SPV_OP_TYPE_MATRIX                   = 24,
+    MD_SPV_OP_TYPE_IMAGE                    = 25,
+    MD_SPV_OP_TYPE_SAMPLER                  = 26,
+    MD_SPV_OP_TYPE_SAMPLED_IMAGE            = 27,
+    MD_SPV_OP_TYPE_ARRAY                    = 28,
+    MD_SPV_OP_TYPE_RUNTIME_ARRAY            = 29,
+    MD_SPV_OP_TYPE_STRUCT                   = 30,
+    MD_SPV_OP_TYPE_POINTER                  = 32,
+    MD_SPV_OP_CONSTANT                      = 43,
+    MD_SPV_OP_SPEC_CONSTANT_TRUE            = 48,
+    MD_SPV_OP_SPEC_CONSTANT_FALSE           = 49,
+    MD_SPV_OP_SPEC_CONSTANT                 = 50,
+    MD_SPV_OP_VARIABLE                      = 59,
+    MD_SPV_OP_TYPE_ACCELERATION_STRUCTURE   = 5341
+};
+
+enum MdSpvDecoration
+{
+    MD_SPV_DECORATION_SPEC_ID               = 1,
+    MD_SPV_DECORATION_BLOCK                 = 2,
+    MD_SPV_DECORATION_BUFFER_BLOCK          = 3,
+    MD_SPV_DECORATION_ARRAY_STRIDE          = 6,
+    MD_SPV_DECORATION_MATRIX_STRIDE         = 7,
+    MD_SPV_DECORATION_BUILTIN               = 11,
+    MD_SPV_DECORATION_LOCATION              = 30,
+    MD_SPV_DECORATION_BINDING               = 33,
+    MD_SPV_DECORATION_DESCRIPTOR_SET        = 34,
+    MD_SPV_DECORATION_OFFSET                = 35
+};
+
+enum MdSpvStorageClass
+{
+    MD_SPV_STORAGE_UNIFORM_CONSTANT         = 0,
+    MD_SPV_STORAGE_INPUT                    = 1,
+    MD_SPV_STORAGE_UNIFORM                  = 2,
+    MD_SPV_STORAGE_PUSH_CONSTANT            = 9,
+    MD_SPV_STORAGE_STORAGE_BUFFER           = 12
+};
+
+enum MdSpvDim
+{
+    MD_SPV_DIM_BUFFER                       = 5,
+    MD_SPV_DIM_SUBPASS_DATA                 = 6
+};
+
+struct MdSpvMember
+{
+    u32 offset = 0;
+    u32 matrix_stride = 0;
+};
+
+struct MdSpvId
+{
+    u32 def = 0;    // Word index of the instruction defining this id, 0 if undefined
+    u32 set = UINT32_MAX;
+    u32 binding = UINT32_MAX;
+    u32 location = UINT32_MAX;
+    u32 spec_id = UINT32_MAX;
+    u32 array_stride = 0;
+    bool builtin = false;
+    bool block = false;
+    bool buffer_block = false;
+    std::vector<MdSpvMember> members;
+};
+
+struct MdSpvModule
+{
+    const u32 *p_code;
+    u32 word_count;
+    std::vector<MdSpvId> ids;
+
+    u32 Op(u32 id) const            { return (id < ids.size() && ids[id].def != 0) ? (p_code[ids[id].def] & 0xffff) : 0; }
+    u32 Word(u32 id, u32 w) const   { return p_code[ids[id].def + w]; }
+    u32 WordCount(u32 id) const     { return p_code[ids[id].def] >> 16; }
+};
+
+u32 mdSpvTypeSize(const MdSpvModule &module, u32 type, u32 matrix_stride = 0);
+
+u32 mdSpvStructSize(const MdSpvModule &module, u32 type, u32 *p_first_offset = NULL)
+{
+    u32 member_count = module.WordCount(type) - 2;
+    u32 end = 0, first = UINT32_MAX;
+    for (u32 m=0; m<member_count; m++)
+    {
+        MdSpvMember member = (m < module.ids[type].members.size()) ? module.ids[type].members[m] : MdSpvMember();
+        u32 size = mdSpvTypeSize(module, module.Word(type, 2 + m), member.matrix_stride);
+        end = MAX_VAL(end, member.offset + size);
+        first = MIN_VAL(first, member.offset);
+    }
+
+    if (p_first_offset != NULL)
+        *p_first_offset = (first == UINT32_MAX) ? 0 : first;
+    return end;
+}
+
+u32 mdSpvTypeSize(const MdSpvModule &module, u32 type, u32 matrix_stride)
+{
+    switch (module.Op(type))
+    {
+        case MD_SPV_OP_TYPE_BOOL:
+            return 4;
+        case MD_SPV_OP_TYPE_INT:
+        case MD_SPV_OP_TYPE_FLOAT:
+            return module.Word(type, 2) / 8;
+        case MD_SPV_OP_TYPE_VECTOR:
+            return module.Word(type, 3) * mdSpvTypeSize(module, module.Word(type, 2));
+        case MD_SPV_OP_TYPE_MATRIX:
+        {
+            u32 column_size = (matrix_stride != 0) ? matrix_stride : mdSpvTypeSize(module, module.Word(type, 2));
+            return module.Word(type, 3) * column_size;
+        }
+        case MD_SPV_OP_TYPE_ARRAY:
+        {
+            u32 length_id = module.Word(type, 3);
+            u32 length = (module.Op(length_id) == MD_SPV_OP_CONSTANT || module.Op(length_id) == MD_SPV_OP_SPEC_CONSTANT)
+                ? module.Word(length_id, 3)
+                : 0;
+            u32 stride = module.ids[type].array_stride;
+            if (stride == 0)
+                stride = mdSpvTypeSize(module, module.Word(type, 2), matrix_stride);
+            return length * stride;
+        }
+        case MD_SPV_OP_TYPE_STRUCT:
+            return mdSpvStructSize(module, type);
+        default:
+            // Runtime arrays and opaque types don't take up space in a block
+            return 0;
+    }
+}
+
+bool mdSpvGetDescriptorType(const MdSpvModule &module, u32 type, u32 storage, VkDescriptorType *p_type, u32 *p_count)
+{
+    // Arrays of descriptors become the binding's descriptor count
+    *p_count = 1;
+    while (module.Op(type) == MD_SPV_OP_TYPE_ARRAY || module.Op(type) == MD_SPV_OP_TYPE_RUNTIME_ARRAY)
+    {
+        if (module.Op(type) == MD_SPV_OP_TYPE_RUNTIME_ARRAY)
+            *p_count = 0;
+        else
+        {
+            u32 length_id = module.Word(type, 3);
+            *p_count *= module.Word(length_id, 3);
+        }
+        type = module.Word(type, 2);
+    }
+
+    switch (module.Op(type))
+    {
+        case MD_SPV_OP_TYPE_SAMPLER:
+            *p_type = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        case MD_SPV_OP_TYPE_SAMPLED_IMAGE:
+        {
+            u32 image = module.Word(type, 2);
+            *p_type = (module.Word(image, 3) == MD_SPV_DIM_BUFFER)
+                ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER
+                : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        }
+        case MD_SPV_OP_TYPE_IMAGE:
+        {
+            u32 dim = module.Word(type, 3);
+            bool storage_image = module.Word(type, 7) == 2;
+            if (dim == MD_SPV_DIM_BUFFER)
+                *p_type = (storage_image) ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            else if (dim == MD_SPV_DIM_SUBPASS_DATA)
+                *p_type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            else
+                *p_type = (storage_image) ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            return true;
+        }
+        case MD_SPV_OP_TYPE_STRUCT:
+            if (storage == MD_SPV_STORAGE_STORAGE_BUFFER || module.ids[type].buffer_block)
+                *p_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            else
+                *p_type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            return true;
+        case MD_SPV_OP_TYPE_ACCELERATION_STRUCTURE:
+            *p_type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+            return true;
+        default:
+            return false;
+    }
+}
+
+VkFormat mdSpvGetVertexFormat(const MdSpvModule &module, u32 type, u32 *p_size)
+{
+    u32 components = 1;
+    if (module.Op(type) == MD_SPV_OP_TYPE_VECTOR)
+    {
+        components = module.Word(type, 3);
+        type = module.Word(type, 2);
+    }
+    if (components < 1 || components > 4)
+        return VK_FORMAT_UNDEFINED;
+
+    const VkFormat f32_formats[4] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    const VkFormat f64_formats[4] = {VK_FORMAT_R64_SFLOAT, VK_FORMAT_R64G64_SFLOAT, VK_FORMAT_R64G64B64_SFLOAT, VK_FORMAT_R64G64B64A64_SFLOAT};
+    const VkFormat i32_formats[4] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    const VkFormat u32_formats[4] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    u32 width = module.Word(type, 2);
+    *p_size = components * width / 8;
+    if (module.Op(type) == MD_SPV_OP_TYPE_FLOAT)
+    {
+        if (width == 32) return f32_formats[components-1];
+        if (width == 64) return f64_formats[components-1];
+    }
+    else if (module.Op(type) == MD_SPV_OP_TYPE_INT && width == 32)
+        return (module.Word(type, 3) != 0) ? i32_formats[components-1] : u32_formats[components-1];
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+void mdReflectAddBinding(MdShaderReflection &reflection, const MdReflectedBinding &binding)
+{
+    for (usize i=0; i<reflection.bindings.size(); i++)
+    {
+        MdReflectedBinding *p_binding = &reflection.bindings[i];
+        if (p_binding->set != binding.set || p_binding->binding != binding.binding)
+            continue;
+
+        if (p_binding->type != binding.type || p_binding->count != binding.count)
+            LOG_ERROR("set %d binding %d is declared differently between stages", binding.set, binding.binding);
+        p_binding->stages |= binding.stages;
+        return;
+    }
+    reflection.bindings.push_back(binding);
+}
+
+void mdReflectAddPushConstants(MdShaderReflection &reflection, const VkPushConstantRange &range)
+{
+    for (usize i=0; i<reflection.push_constants.size(); i++)
+    {
+        VkPushConstantRange *p_range = &reflection.push_constants[i];
+        if (p_range->offset != range.offset || p_range->size != range.size)
+            continue;
+
+        p_range->stageFlags |= range.stageFlags;
+        return;
+    }
+    reflection.push_constants.push_back(range);
+}
+
+void mdReflectAddSpecConstant(MdShaderReflection &reflection, const MdReflectedSpecConstant &spec)
+{
+    for (usize i=0; i<reflection.spec_constants.size(); i++)
+    {
+        MdReflectedSpecConstant *p_spec = &reflection.spec_constants[i];
+        if (p_spec->id != spec.id)
+            continue;
+
+        if (p_spec->size != spec.size)
+            LOG_ERROR("specialization constant %d is declared with different sizes (%d and %d)", spec.id, p_spec->size, spec.size);
+        p_spec->stages |= spec.stages;
+        return;
+    }
+    reflection.spec_constants.push_back(spec);
+}
+
+void mdMergeShaderReflection(MdShaderReflection &reflection, const MdShaderReflection &other)
+{
+    for (usize i=0; i<other.bindings.size(); i++)
+        mdReflectAddBinding(reflection, other.bindings[i]);
+    for (usize i=0; i<other.push_constants.size(); i++)
+        mdReflectAddPushConstants(reflection, other.push_constants[i]);
+    for (usize i=0; i<other.spec_constants.size(); i++)
+        mdReflectAddSpecConstant(reflection, other.spec_constants[i]);
+}
+
+VkResult mdReflectSPIRV(    u32 code_size,
+                            const u32 *p_code,
+                            VkShaderStageFlagBits stage,
+                            MdShaderReflection &reflection)
+{
+    MdSpvModule module = {};
+    module.p_code = p_code;
+    module.word_count = code_size / 4;
+    if (p_code == NULL || (code_size % 4) != 0 || module.word_count < MD_SPIRV_HEADER_WORDS || p_code[0] != MD_SPIRV_MAGIC)
+    {
+        LOG_ERROR("invalid SPIR-V module");
+        return VK_ERROR_UNKNOWN;
+    }
+
+    u32 bound = p_code[3];
+    module.ids.resize(bound);
+
+    // First pass, find where every id is defined and collect decorations
+    std::vector<u32> variables;
+    std::vector<u32> spec_constants;
+    for (u32 i=MD_SPIRV_HEADER_WORDS; i<module.word_count;)
+    {
+        u32 word_count = p_code[i] >> 16;
+        u32 op = p_code[i] & 0xffff;
+        if (word_count == 0 || i + word_count > module.word_count)
+        {
+            LOG_ERROR("malformed SPIR-V instruction at word %d", i);
+            return VK_ERROR_UNKNOWN;
+        }
+
+        u32 result = UINT32_MAX;
+        switch (op)
+        {
+            case MD_SPV_OP_DECORATE:
+            {
+                if (word_count < 3 || p_code[i+1] >= bound) break;
+                MdSpvId *p_id = &module.ids[p_code[i+1]];
+                u32 literal = (word_count > 3) ? p_code[i+3] : 0;
+                switch (p_code[i+2])
+                {
+                    case MD_SPV_DECORATION_SPEC_ID:         p_id->spec_id = literal; break;
+                    case MD_SPV_DECORATION_BLOCK:           p_id->block = true; break;
+                    case MD_SPV_DECORATION_BUFFER_BLOCK:    p_id->buffer_block = true; break;
+                    case MD_SPV_DECORATION_ARRAY_STRIDE:    p_id->array_stride = literal; break;
+                    case MD_SPV_DECORATION_BUILTIN:         p_id->builtin = true; break;
+                    case MD_SPV_DECORATION_LOCATION:        p_id->location = literal; break;
+                    case MD_SPV_DECORATION_BINDING:         p_id->binding = literal; break;
+                    case MD_SPV_DECORATION_DESCRIPTOR_SET:  p_id->set = literal; break;
+                }
+                break;
+            }
+            case MD_SPV_OP_MEMBER_DECORATE:
+            {
+                if (word_count < 5 || p_code[i+1] >= bound) break;
+                MdSpvId *p_id = &module.ids[p_code[i+1]];
+                u32 member = p_code[i+2];
+                if (member >= p_id->members.size())
+                    p_id->members.resize(member + 1);
+
+                if (p_code[i+3] == MD_SPV_DECORATION_OFFSET)
+                    p_id->members[member].offset = p_code[i+4];
+                else if (p_code[i+3] == MD_SPV_DECORATION_MATRIX_STRIDE)
+                    p_id->members[member].matrix_stride = p_code[i+4];
+                break;
+            }
+            case MD_SPV_OP_SPEC_CONSTANT_TRUE:
+            case MD_SPV_OP_SPEC_CONSTANT_FALSE:
+            case MD_SPV_OP_SPEC_CONSTANT:
+                if (p_code[i+2] < bound)
+                    spec_constants.push_back(p_code[i+2]);
+                result = p_code[i+2];
+                break;
+            case MD_SPV_OP_CONSTANT:
+                result = p_code[i+2];
+                break;
+            case MD_SPV_OP_VARIABLE:
+                result = p_code[i+2];
+                if (result < bound)
+                    variables.push_back(result);
+                break;
+            default:
+                // Type declarations put their result id first
+                if ((op >= MD_SPV_OP_TYPE_BOOL && op <= MD_SPV_OP_TYPE_POINTER) || op == MD_SPV_OP_TYPE_ACCELERATION_STRUCTURE)
+                    result = p_code[i+1];
+                break;
+        }
+
+        if (result < bound)
+            module.ids[result].def = i;
+        i += word_count;
+    }
+
+    // Vertex inputs only come from one stage, so they are replaced rather than merged
+    if (stage == VK_SHADER_STAGE_VERTEX_BIT)
+        reflection.vertex_inputs.clear();
+
+    // Second pass, classify every global variable by its storage class
+    for (usize v=0; v<variables.size(); v++)
+    {
+        u32 var = variables[v];
+        u32 storage = module.Word(var, 3);
+        u32 pointer = module.Word(var, 1);
+        if (module.Op(pointer) != MD_SPV_OP_TYPE_POINTER)
+            continue;
+        u32 type = module.Word(pointer, 3);
+
+        switch (storage)
+        {
+            case MD_SPV_STORAGE_UNIFORM_CONSTANT:
+            case MD_SPV_STORAGE_UNIFORM:
+            case MD_SPV_STORAGE_STORAGE_BUFFER:
+            {
+                if (module.ids[var].set == UINT32_MAX || module.ids[var].binding == UINT32_MAX)
+                    break;
+
+                MdReflectedBinding binding = {};
+                binding.set = module.ids[var].set;
+                binding.binding = module.ids[var].binding;
+                binding.stages = stage;
+                if (!mdSpvGetDescriptorType(module, type, storage, &binding.type, &binding.count))
+                {
+                    LOG_ERROR("unsupported descriptor type at set %d binding %d", binding.set, binding.binding);
+                    break;
+                }
+                mdReflectAddBinding(reflection, binding);
+                break;
+            }
+            case MD_SPV_STORAGE_PUSH_CONSTANT:
+            {
+                if (module.Op(type) != MD_SPV_OP_TYPE_STRUCT)
+                    break;
+
+                u32 first = 0;
+                u32 end = mdSpvStructSize(module, type, &first);
+                if (end <= first)
+                    break;
+
+                VkPushConstantRange range = {};
+                range.stageFlags = stage;
+                range.offset = first;
+                range.size = end - first;
+                mdReflectAddPushConstants(reflection, range);
+                break;
+            }
+            case MD_SPV_STORAGE_INPUT:
+            {
+                if (stage != VK_SHADER_STAGE_VERTEX_BIT || module.ids[var].builtin || module.ids[var].location == UINT32_MAX)
+                    break;
+
+                MdReflectedVertexInput input = {};
+                input.location = module.ids[var].location;
+                input.format = mdSpvGetVertexFormat(module, type, &input.size);
+                if (input.format == VK_FORMAT_UNDEFINED)
+                {
+                    LOG_ERROR("unsupported vertex input type at location %d", input.location);
+                    break;
+                }
+                reflection.vertex_inputs.push_back(input);
+                break;
+            }
+        }
+    }
+
+    // Only constants decorated with a SpecId can be set from the pipeline
+    for (usize c=0; c<spec_constants.size(); c++)
+    {
+        u32 constant = spec_constants[c];
+        if (module.ids[constant].spec_id == UINT32_MAX)
+            continue;
+
+        MdReflectedSpecConstant spec = {};
+        spec.id = module.ids[constant].spec_id;
+        spec.size = (module.Op(constant) == MD_SPV_OP_SPEC_CONSTANT) ? mdSpvTypeSize(module, module.Word(constant, 1)) : 4;
+        spec.stages = stage;
+        mdReflectAddSpecConstant(reflection, spec);
+    }
+
+    std::sort(reflection.vertex_inputs.begin(), reflection.vertex_inputs.end(),
+        [](const MdReflectedVertexInput &a, const MdReflectedVertexInput &b) { return a.location < b.location; }
+    );
+    std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+        [](const MdReflectedBinding &a, const MdReflectedBinding &b) { return (a.set != b.set) ? a.set < b.set : a.binding < b.binding; }
+    );
+    return VK_SUCCESS;
+}
+#pragma endregion
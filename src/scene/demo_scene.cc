@@ -0,0 +1,655 @@
+#define MD_USE_VULKAN
+#include <scene/demo_scene.h>
+
+#pragma region [ Demo Scene ]
+static VkExtent2D shadow_extent = {8192, 8192};
+
+// constant_id of USE_SHADOWS in test.fsh
+#define MD_DEMO_SPEC_USE_SHADOWS 0
+static MdRenderState *p_renderer_state;
+
+VkResult mdCreateShadowPass(MdRenderer &renderer)
+{
+    VkResult result;
+    
+    MdRenderPassAttachmentInfo shadow_info = {};
+    shadow_info.type = MD_ATTACHMENT_TYPE_DEPTH;
+    shadow_info.format = VK_FORMAT_D32_SFLOAT;
+    shadow_info.border_color = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    shadow_info.address[0] = 
+    shadow_info.address[1] = 
+    shadow_info.address[2] = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    shadow_info.size_mode = MD_ATTACHMENT_SIZE_ABSOLUTE;
+    shadow_info.width = shadow_extent.width;
+    shadow_info.height = shadow_extent.height;
+
+    mdAddRenderPass("shadow");
+    result = mdAddRenderPassOutput("shadow", "shadow_map", shadow_info);
+    if (result != VK_SUCCESS)
+        LOG_ERROR("failed to create shadow pass");
+
+    return result;
+}
+
+VkResult mdCreateGeometryPass(MdRenderer &renderer)
+{
+    // Render pass A
+    VkResult result;
+    
+    MdRenderPassAttachmentInfo geometry_info = {};
+    geometry_info.is_swapchain = true;
+    geometry_info.type = MD_ATTACHMENT_TYPE_COLOR;
+    geometry_info.format = VK_FORMAT_B8G8R8A8_SRGB;
+    geometry_info.border_color = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    geometry_info.address[0] = 
+    geometry_info.address[1] = 
+    geometry_info.address[2] = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    
+    // depth buffer
+    MdRenderPassAttachmentInfo depth_info = {};
+    depth_info.is_swapchain = false;
+    depth_info.type = MD_ATTACHMENT_TYPE_DEPTH;
+    depth_info.format = VK_FORMAT_D32_SFLOAT;
+    depth_info.border_color = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    depth_info.address[0] = 
+    depth_info.address[1] = 
+    depth_info.address[2] = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    
+    mdAddRenderPass("geometry");
+    result = mdAddRenderPassOutput("geometry", "color_tex1", geometry_info);
+    VK_CHECK(result, "failed to create geometry pass");
+    result = mdAddRenderPassOutput("geometry", "depth_tex1", depth_info);
+    VK_CHECK(result, "failed to create geometry pass");
+    
+    mdAddRenderPassInput("geometry", "shadow_map");
+    
+    MdGPUTexture *color_texture;
+    mdGetAttachmentTexture("color_tex1", &color_texture);
+    if (color_texture == NULL)
+    {
+        LOG_ERROR("failed to retrieve color texture");
+        return VK_ERROR_UNKNOWN;
+    }
+
+    return result;
+}
+
+// Tonemaps the geometry pass's color at the pixel it's shading, so it merges into that pass
+VkResult mdCreatePostPass(MdRenderer &renderer)
+{
+    VkResult result;
+
+    MdRenderPassAttachmentInfo post_info = {};
+    post_info.is_swapchain = true;
+    post_info.type = MD_ATTACHMENT_TYPE_COLOR;
+    post_info.format = VK_FORMAT_B8G8R8A8_SRGB;
+    post_info.border_color = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    post_info.address[0] = 
+    post_info.address[1] = 
+    post_info.address[2] = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+    mdAddRenderPass("post");
+    result = mdAddRenderPassLocalInput("post", "color_tex1");
+    VK_CHECK(result, "failed to create post pass");
+    result = mdAddRenderPassOutput("post", "post_color", post_info);
+    VK_CHECK(result, "failed to create post pass");
+
+    return result;
+}
+
+VkResult mdCreateFinalPass(MdRenderer &renderer, const std::string &input)
+{
+    // Render pass B
+    VkResult result;
+
+    MdRenderPassAttachmentInfo final_info = {};
+    final_info.type = MD_ATTACHMENT_TYPE_COLOR;
+    final_info.border_color = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    final_info.address[0] = 
+    final_info.address[1] = 
+    final_info.address[2] = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    
+    mdAddRenderPass("final", true);
+    result = mdAddRenderPassInput("final", input, final_info);
+    VK_CHECK(result, "failed to create final pass");
+
+    return result;
+}
+
+VkResult mdCreateShadowPassPipeline(MdRenderer &renderer)
+{
+    VkResult result;
+    MdGPUTexture *shadow_texture;
+    mdGetAttachmentTexture("shadow_map", &shadow_texture);
+    if (shadow_texture == NULL)
+    {
+        LOG_ERROR("failed to retrieve shadow texture");
+        return VK_ERROR_UNKNOWN;
+    }
+
+    MdPipelineGeometryInputState geometry_state = {}; 
+    MdPipelineRasterizationState raster_state = {};
+    MdPipelineColorBlendState color_blend_state = {};
+    
+    // Shaders
+    MdShaderSource source;
+    result = mdLoadShaderSPIRVFromFile(*renderer.context, "../shaders/spv/test_shadow_vert.spv", VK_SHADER_STAGE_VERTEX_BIT, source);
+    VK_CHECK(result, "failed to load shadow pass vertex shader");
+    result = mdLoadShaderSPIRVFromFile(*renderer.context, "../shaders/spv/test_shadow_frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT, source);
+    VK_CHECK(result, "failed to load shadow pass fragment shader");
+
+    mdInitGeometryInputState(geometry_state);
+    // The shadow shader only reads positions, but shares the mesh's vertex layout
+    MdVertexLayout vertex_layout = mdDefaultVertexLayout();
+    mdGeometryInputFromReflection(geometry_state, source, &vertex_layout);
+    mdBuildGeometryInputState(geometry_state);
+
+    mdBuildDefaultRasterizationState(raster_state);
+    mdBuildDefaultColorBlendState(color_blend_state);
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    bindings.push_back({
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .pImmutableSamplers = NULL
+    });
+
+    result = mdCreateGraphicsPipeline(
+        renderer, 
+        source, 
+        &geometry_state, 
+        &raster_state, 
+        &color_blend_state, 
+        "shadow", 
+        p_renderer_state->shadow_pipeline
+    );
+    mdDestroyShaderSource(*renderer.context, source);
+    VK_CHECK(result, "failed to create shadow pipeline\n");
+    
+    return result;
+}
+
+VkResult mdCreateFinalPassPipeline(MdRenderer &renderer, MdGPUTexture *color_attachment, MdGPUTexture *shadow_texture, MdMaterial &material)
+{
+    VkResult result;
+    MdPipelineGeometryInputState geometry_state = {}; 
+    MdPipelineRasterizationState raster_state = {};
+    MdPipelineColorBlendState color_blend_state = {};
+        
+    // Shaders
+    MdShaderSource source;
+    result = mdLoadShaderSPIRVFromFile(*renderer.context, "../shaders/spv/test_vert_2.spv", VK_SHADER_STAGE_VERTEX_BIT, source);
+    VK_CHECK(result, "failed to load final vertex shader");
+
+    result = mdLoadShaderSPIRVFromFile(*renderer.context, "../shaders/spv/test_frag_2.spv", VK_SHADER_STAGE_FRAGMENT_BIT, source);
+    VK_CHECK(result, "failed to load final fragment shader");
+
+    mdShaderAddBinding(source, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &color_attachment->sampler);
+    mdShaderAddBinding(source, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &shadow_texture->sampler);
+
+    mdInitGeometryInputState(geometry_state);
+    mdBuildGeometryInputState(geometry_state);
+    mdBuildDefaultRasterizationState(raster_state);
+    mdBuildDefaultColorBlendState(color_blend_state);
+    
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    bindings.push_back({
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .pImmutableSamplers = NULL
+    });
+
+    result = mdCreateGraphicsPipeline(
+        renderer, 
+        source, 
+        &geometry_state, 
+        &raster_state, 
+        &color_blend_state,
+        "final",
+        p_renderer_state->final_pipeline
+    );
+    VK_CHECK(result, "failed to create final pass pipeline");
+    
+    result = mdCreateMaterial(renderer, p_renderer_state->final_pipeline, material);
+    VK_CHECK(result, "failed to create material for final pass");
+
+    mdDestroyShaderSource(*renderer.context, source);
+    return result;
+}
+
+VkResult mdCreatePostPassProgram(MdRenderer &renderer, MdDemoScene &scene)
+{
+    std::vector<MdShaderFile> files = {
+        {"../shaders/test2.vsh", "../shaders/spv/test_vert_2.spv", VK_SHADER_STAGE_VERTEX_BIT},
+        {"../shaders/post.fsh", "../shaders/spv/post_frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT}
+    };
+
+    // The input attachment binding comes from reflecting post.fsh
+    VkResult result = mdCreateShaderProgram(renderer, files, [&renderer](MdShaderSource &source, MdPipeline **pp_pipeline){
+        MdPipelineGeometryInputState geometry_state = {}; 
+        MdPipelineRasterizationState raster_state = {};
+        MdPipelineColorBlendState color_blend_state = {};
+
+        mdInitGeometryInputState(geometry_state);
+        mdBuildGeometryInputState(geometry_state);
+        mdBuildDefaultRasterizationState(raster_state);
+        mdBuildDefaultColorBlendState(color_blend_state);
+
+        return mdGetPipelineVariant(
+            renderer,
+            source,
+            &geometry_state,
+            &raster_state,
+            &color_blend_state,
+            "post",
+            pp_pipeline
+        );
+    }, &scene.post_program);
+    VK_CHECK(result, "failed to create post pass pipeline");
+
+    if (!mdRenderGraphIsPassMerged("post"))
+        LOG_WARNING("post pass wasn't merged into the geometry pass");
+
+    result = mdCreateMaterial(renderer, *mdGetShaderProgramPipeline(scene.post_program), scene.post_mat);
+    VK_CHECK(result, "failed to create material for post pass");
+
+    return result;
+}
+
+MdResult mdCreateDemoScene(MdRenderer &renderer, MdDemoScene &scene, bool hot_reload, bool post_subpass, bool shadows)
+{
+    mdGetRenderState(&p_renderer_state);
+    MdDemoScene *p_scene = &scene;
+    VkResult vk_result;
+
+    // Viewport
+    {
+        // Regular viewport
+        scene.viewport = {};
+        scene.viewport.minDepth = 0.0f;
+        scene.viewport.maxDepth = 1.0f;
+        scene.viewport.x = 0;
+        scene.viewport.y = 0;
+        scene.viewport.width = renderer.context->swapchain.extent.width;
+        scene.viewport.height = renderer.context->swapchain.extent.height;
+
+        scene.scissor.offset = {0,0};
+        scene.scissor.extent = renderer.context->swapchain.extent;
+
+        // Shadow viewport
+        scene.shadow_viewport = {};
+        scene.shadow_viewport.minDepth = 0.0f;
+        scene.shadow_viewport.maxDepth = 1.0f;
+        scene.shadow_viewport.x = 0;
+        scene.shadow_viewport.y = 0;
+        scene.shadow_viewport.width = shadow_extent.width;
+        scene.shadow_viewport.height = shadow_extent.height;
+
+        scene.shadow_scissor.offset = {0,0};
+        scene.shadow_scissor.extent = shadow_extent;
+    }
+
+    scene.post_subpass = post_subpass;
+    scene.shadows = shadows;
+    scene.pass_count = (post_subpass) ? 4 : 3;
+    mdCreateShadowPass(renderer);
+    mdCreateGeometryPass(renderer);
+    if (post_subpass)
+        mdCreatePostPass(renderer);
+    mdCreateFinalPass(renderer, (post_subpass) ? "post_color" : "color_tex1");
+
+    // Prefer dynamic rendering, falls back to render passes if it isn't supported. Merging 
+    // subpasses is only done with render passes
+    mdRenderGraphSetBackend((post_subpass) 
+        ? MD_RENDER_GRAPH_BACKEND_RENDER_PASS 
+        : MD_RENDER_GRAPH_BACKEND_DYNAMIC_RENDERING
+    );
+    mdBuildRenderGraph();
+
+    mdGetAttachmentTexture("color_tex1", &scene.p_color_attachment);
+    mdGetAttachmentTexture("shadow_map", &scene.p_shadow_texture);
+    mdGetAttachmentTexture((post_subpass) ? "post_color" : "color_tex1", &scene.p_final_input);
+    
+    // Load texture
+    scene.teapot = {};
+    MdResult result = mdLoadOBJModelFromPath(
+        renderer, 
+        "../models/teapot/teapot_smooth.obj", 
+        scene.teapot, 
+        "../images/test.png"
+    );
+    if (result != MD_SUCCESS)
+        return result;
+    
+    // UBO
+    scene.uniform_buffer = {};
+    scene.ubo = {};
+    {
+        scene.model = Matrix4x4(
+            1, 0, 0, 0,
+            0, 1, 0, -2,
+            0, 0, 1, -15,
+            0, 0, 0, 1
+        );
+        scene.view = Matrix4x4::LookAt(
+            Vector4(0,0,-1,0), 
+            Vector4(0,0,1,0), 
+            Vector4(0,1,0,0)
+        );
+        scene.view_ls = Matrix4x4::LookAt(
+            Vector4(3,0,-1,0), 
+            Vector4(0,0,1,0), 
+            Vector4(0,1,0,0)
+        );
+
+        scene.ubo.u_resolution[0] = scene.viewport.width;
+        scene.ubo.u_resolution[1] = scene.viewport.height;
+        scene.ubo.u_time = 0.0f;
+        scene.ubo.u_view_projection = Matrix4x4::Perspective(45., scene.viewport.width/scene.viewport.height, 0.1f, 1000.0f) * scene.view;
+        scene.ubo.u_light_view_projection = Matrix4x4::Orthographic(-10, 10, -10, 10, 0.1, 1000) * scene.view_ls;
+        scene.ubo.u_model = scene.model;
+
+        mdAllocateGPUUniformBuffer(sizeof(scene.ubo), p_renderer_state->allocator, scene.uniform_buffer);
+        mdUploadToUniformBuffer(*renderer.context, p_renderer_state->allocator, 0, sizeof(scene.ubo), &scene.ubo, scene.uniform_buffer);
+    }
+    
+    // Geometry pass pipelines    
+    scene.geometry_mat = {};
+    scene.final_mat = {};
+    {   
+        // Rebuilt from the same state whenever test.vsh or test.fsh is saved
+        std::vector<MdShaderFile> files = {
+            {"../shaders/test.vsh", "../shaders/spv/test_vert.spv", VK_SHADER_STAGE_VERTEX_BIT},
+            {"../shaders/test.fsh", "../shaders/spv/test_frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT}
+        };
+        
+        vk_result = mdCreateShaderProgram(renderer, files, [&renderer, p_scene](MdShaderSource &source, MdPipeline **pp_pipeline){
+            MdPipelineGeometryInputState geometry_state = {}; 
+            MdPipelineRasterizationState raster_state = {};
+            MdPipelineColorBlendState color_blend_state = {};
+
+            mdShaderAddBinding(source, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &p_scene->teapot.texture.sampler);
+            mdShaderAddBinding(source, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &p_scene->p_color_attachment->sampler);
+            mdShaderAddBinding(source, 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &p_scene->p_shadow_texture->sampler);
+            mdShaderSetSpecConstant(source, MD_DEMO_SPEC_USE_SHADOWS, p_scene->shadows);
+
+            MdVertexLayout vertex_layout = mdDefaultVertexLayout();
+            mdInitGeometryInputState(geometry_state);
+            mdGeometryInputFromReflection(geometry_state, source, &vertex_layout);
+            mdBuildGeometryInputState(geometry_state);
+
+            mdBuildDefaultRasterizationState(raster_state);
+            mdBuildDefaultColorBlendState(color_blend_state);
+
+            return mdGetPipelineVariant(
+                renderer,
+                source,
+                &geometry_state,
+                &raster_state,
+                &color_blend_state,
+                "geometry",
+                pp_pipeline
+            );
+        }, &scene.geometry_program);
+        if (vk_result != VK_SUCCESS)
+        {
+            LOG_ERROR("failed to create graphics pipeline");
+            return MD_ERROR_UNKNOWN;
+        }
+
+        vk_result = mdCreateMaterial(renderer, *mdGetShaderProgramPipeline(scene.geometry_program), scene.geometry_mat);
+        if (vk_result != VK_SUCCESS)
+        {
+            LOG_ERROR("failed to create graphics material");
+            return MD_ERROR_UNKNOWN;
+        }
+    }
+
+    if (hot_reload && mdEnableShaderHotReload(renderer, "../shaders") != MD_SUCCESS)
+        LOG_ERROR("shader hot reload is disabled");
+
+    // Shadow and final pass pipelines
+    mdCreateShadowPassPipeline(renderer);
+    mdCreateFinalPassPipeline(renderer, scene.p_final_input, scene.p_shadow_texture, scene.final_mat);
+    if (post_subpass && mdCreatePostPassProgram(renderer, scene) != VK_SUCCESS)
+        return MD_ERROR_UNKNOWN;
+
+    // Write descriptors
+    mdBeginDescriptorWrites(scene.writer, scene.geometry_mat.set, mdGetShaderProgramPipeline(scene.geometry_program)->set_layouts[MD_MATERIAL_SET_INDEX]);
+    mdDescriptorWriterImage(scene.writer, 0, scene.teapot.texture);
+    mdDescriptorWriterImage(scene.writer, 1, *scene.p_shadow_texture);
+    mdFlushDescriptorWrites(renderer, scene.writer);
+    
+    mdBeginDescriptorWrites(scene.writer, scene.final_mat.set, p_renderer_state->final_pipeline.set_layouts[MD_MATERIAL_SET_INDEX]);
+    mdDescriptorWriterImage(scene.writer, 0, *scene.p_final_input);
+    mdFlushDescriptorWrites(renderer, scene.writer);
+
+    if (post_subpass)
+    {
+        mdBeginDescriptorWrites(scene.writer, scene.post_mat.set, mdGetShaderProgramPipeline(scene.post_program)->set_layouts[MD_MATERIAL_SET_INDEX]);
+        mdDescriptorWriterInputAttachment(scene.writer, 0, *scene.p_color_attachment);
+        mdFlushDescriptorWrites(renderer, scene.writer);
+    }
+
+    // Set render functions
+    mdAddRenderPassFunction("shadow", [p_scene](VkCommandBuffer cmd, VkFramebuffer fb){
+        VkDeviceSize offsets[1] = {0};
+        vkCmdSetViewport(cmd, 0, 1, &p_scene->shadow_viewport);
+        vkCmdSetScissor(cmd, 0, 1, &p_scene->shadow_scissor);
+        VkDescriptorSet sets[] = {
+            p_renderer_state->global_set,
+            p_renderer_state->camera_sets[0]
+        };
+        usize sets_count = sizeof(sets) / sizeof(VkDescriptorSet);
+
+        vkCmdBindVertexBuffers(
+            cmd, 
+            0, 
+            1, 
+            &p_scene->teapot.vertex_buffer.buffer, 
+            offsets
+        );
+        vkCmdBindDescriptorSets(
+            cmd, 
+            VK_PIPELINE_BIND_POINT_GRAPHICS, 
+            p_renderer_state->shadow_pipeline.layout, 
+            0, 
+            sets_count, 
+            sets, 
+            0, 
+            NULL
+        );
+        vkCmdBindPipeline(
+            cmd, 
+            VK_PIPELINE_BIND_POINT_GRAPHICS, 
+            p_renderer_state->shadow_pipeline.pipeline
+        );
+        vkCmdDraw(cmd, p_scene->teapot.geometry_size, 1, 0, 0);
+    });
+
+    // Viewport and scissor change with the swapchain, so they're read from the scene
+    mdAddRenderPassFunction("geometry", [p_scene](VkCommandBuffer cmd, VkFramebuffer fb){
+        VkDeviceSize offsets[1] = {0};
+        MdPipeline *p_geometry_pipeline = mdGetShaderProgramPipeline(p_scene->geometry_program);
+        vkCmdSetViewport(cmd, 0, 1, &p_scene->viewport);
+        vkCmdSetScissor(cmd, 0, 1, &p_scene->scissor);
+        VkDescriptorSet sets[] = {
+            p_renderer_state->global_set,
+            p_renderer_state->camera_sets[0],
+            p_scene->geometry_mat.set
+        };
+        usize sets_count = sizeof(sets) / sizeof(VkDescriptorSet);
+        
+        vkCmdBindVertexBuffers(
+            cmd, 
+            0, 
+            1, 
+            &p_scene->teapot.vertex_buffer.buffer, offsets
+        );
+        vkCmdBindDescriptorSets(
+            cmd, 
+            VK_PIPELINE_BIND_POINT_GRAPHICS, 
+            p_geometry_pipeline->layout, 
+            0, 
+            sets_count, 
+            sets, 
+            0, 
+            NULL
+        );
+        vkCmdBindPipeline(
+            cmd, 
+            VK_PIPELINE_BIND_POINT_GRAPHICS, 
+            p_geometry_pipeline->pipeline
+        );
+        vkCmdDraw(cmd, p_scene->teapot.geometry_size, 1, 0, 0);
+    });
+
+    mdAddRenderPassFunction("final", [p_scene](VkCommandBuffer cmd, VkFramebuffer fb){
+        vkCmdSetViewport(cmd, 0, 1, &p_scene->viewport);
+        vkCmdSetScissor(cmd, 0, 1, &p_scene->scissor);
+        VkDescriptorSet sets[] = {
+            p_renderer_state->global_set,
+            p_renderer_state->camera_sets[0],
+            p_scene->final_mat.set
+        };
+        usize sets_count = sizeof(sets) / sizeof(VkDescriptorSet);
+
+        vkCmdBindDescriptorSets(
+            cmd, 
+            VK_PIPELINE_BIND_POINT_GRAPHICS, 
+            p_renderer_state->final_pipeline.layout, 
+            0, 
+            sets_count, 
+            sets, 
+            0, 
+            NULL
+        );
+        vkCmdBindPipeline(
+            cmd, 
+            VK_PIPELINE_BIND_POINT_GRAPHICS, 
+            p_renderer_state->final_pipeline.pipeline
+        );
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+    });
+
+    if (post_subpass)
+    {
+        mdAddRenderPassFunction("post", [p_scene](VkCommandBuffer cmd, VkFramebuffer fb){
+            MdPipeline *p_post_pipeline = mdGetShaderProgramPipeline(p_scene->post_program);
+            vkCmdSetViewport(cmd, 0, 1, &p_scene->viewport);
+            vkCmdSetScissor(cmd, 0, 1, &p_scene->scissor);
+            VkDescriptorSet sets[] = {
+                p_renderer_state->global_set,
+                p_renderer_state->camera_sets[0],
+                p_scene->post_mat.set
+            };
+            usize sets_count = sizeof(sets) / sizeof(VkDescriptorSet);
+
+            vkCmdBindDescriptorSets(
+                cmd, 
+                VK_PIPELINE_BIND_POINT_GRAPHICS, 
+                p_post_pipeline->layout, 
+                0, 
+                sets_count, 
+                sets, 
+                0, 
+                NULL
+            );
+            vkCmdBindPipeline(
+                cmd, 
+                VK_PIPELINE_BIND_POINT_GRAPHICS, 
+                p_post_pipeline->pipeline
+            );
+            vkCmdDraw(cmd, 3, 1, 0, 0);
+        });
+
+        // Begun by the geometry pass along with its own attachments
+        std::vector<VkClearValue> post_clear = {{.color = {{0., 0., 0., 1.}}}};
+        mdRenderGraphSetClearValues("post", post_clear);
+    }
+
+    scene.clear_values.clear();
+    scene.clear_values.push_back({.8, .8, .8, 1.});
+    scene.clear_values.push_back({.depthStencil = {1.0f, 0}});
+
+    return MD_SUCCESS;
+}
+
+void mdDemoSceneResize(MdRenderer &renderer, MdDemoScene &scene, VkExtent2D extent)
+{
+    scene.viewport.width = extent.width;
+    scene.viewport.height = extent.height;
+    scene.scissor.extent = extent;
+
+    // The color attachment was recreated, so its view changed
+    mdBeginDescriptorWrites(scene.writer, scene.final_mat.set, p_renderer_state->final_pipeline.set_layouts[MD_MATERIAL_SET_INDEX]);
+    mdDescriptorWriterImage(scene.writer, 0, *scene.p_final_input);
+    mdFlushDescriptorWrites(renderer, scene.writer);
+
+    if (scene.post_subpass)
+    {
+        mdBeginDescriptorWrites(scene.writer, scene.post_mat.set, mdGetShaderProgramPipeline(scene.post_program)->set_layouts[MD_MATERIAL_SET_INDEX]);
+        mdDescriptorWriterInputAttachment(scene.writer, 0, *scene.p_color_attachment);
+        mdFlushDescriptorWrites(renderer, scene.writer);
+    }
+}
+
+void mdDemoSceneUpdate(MdRenderer &renderer, MdDemoScene &scene, u32 frame_index, f32 time, const Matrix4x4 *p_view)
+{
+    // The global set is transient so the previous frame's set is never rewritten
+    mdBeginDescriptorFrame(frame_index);
+    mdAllocateTransientSet(p_renderer_state->global_layout, &p_renderer_state->global_set);
+
+    scene.ubo.u_time = time;
+    if (p_view != NULL)
+    {
+        scene.ubo.u_resolution[0] = scene.viewport.width;
+        scene.ubo.u_resolution[1] = scene.viewport.height;
+        scene.ubo.u_view_projection = Matrix4x4::Perspective(45., scene.viewport.width/scene.viewport.height, 0.1f, 1000.0f) * (*p_view);
+    }
+
+    mdUploadToUniformBuffer(*renderer.context, p_renderer_state->allocator, 0, sizeof(scene.ubo), &scene.ubo, scene.uniform_buffer);
+    mdDescriptorSetWriteUBO(
+        renderer, 
+        p_renderer_state->global_set, 
+        0, 
+        0, 
+        sizeof(scene.ubo), 
+        scene.uniform_buffer
+    );
+}
+
+void mdDemoSceneRecord(MdDemoScene &scene, u32 image_index)
+{
+    // The post pass is recorded by the geometry pass when they're merged, its own call does nothing
+    mdExecuteRenderPass(scene.clear_values, 0, image_index);
+    for (u32 i=1; i<scene.pass_count; i++)
+        mdExecuteRenderPass(scene.clear_values, i);
+}
+
+void mdDestroyDemoScene(MdRenderer &renderer, MdDemoScene &scene)
+{
+    // Destroy materials and pipelines
+    mdDisableShaderHotReload(renderer);
+    mdFlushRetired();
+    mdDestroyShaderProgram(renderer, scene.geometry_program);
+    if (scene.post_subpass)
+        mdDestroyShaderProgram(renderer, scene.post_program);
+    mdDestroyPipeline(renderer, p_renderer_state->final_pipeline);
+    mdDestroyPipeline(renderer, p_renderer_state->shadow_pipeline);
+    mdDestroyDescriptorAllocator();
+
+    // Destroy render graph
+    mdRenderGraphDestroy();
+
+    // Destroy Model
+    mdDestroyModel(renderer, scene.teapot);
+
+    // Free GPU memory
+    mdFreeGPUBuffer(p_renderer_state->allocator, scene.uniform_buffer);
+}
+#pragma endregion
@@ -0,0 +1,417 @@
+#define ARCH_AMD64_SSE
+#include <simd_math/simd_math.h>
+
+#include <immintrin.h>
+#include <cpuid.h>
+#include <math.h>
+
+#include <atomic>
+
+// The wider paths are compiled per function, the rest of the build stays at -msse3 and the
+// dispatch below only calls them on CPUs that have the instructions
+#define MD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MD_TARGET_AVX512 __attribute__((target("avx512f")))
+
+typedef void (*MdTransformPointsFn)(const Matrix4x4 &m, const MdVector4SoA &in, const MdVector4SoA &out, usize count);
+typedef void (*MdMultiplyMatricesFn)(const Matrix4x4 *p_a, const Matrix4x4 *p_b, Matrix4x4 *p_out, usize count);
+typedef void (*MdNormalizeVectorsFn)(const MdVector4SoA &in, const MdVector4SoA &out, usize count);
+
+struct MdSimdKernels
+{
+    MdSimdLevel level;
+    MdTransformPointsFn transform_points;
+    MdMultiplyMatricesFn multiply_matrices;
+    MdNormalizeVectorsFn normalize_vectors;
+};
+
+#pragma region [ Scalar Tails ]
+// Finish whatever doesn't fill a whole vector on the SSE and AVX2 paths
+static void mdTransformPointsScalar(const Matrix4x4 &m, const MdVector4SoA &in, const MdVector4SoA &out, usize first, usize count)
+{
+    const f32 *p_m = m.ij;
+    for (usize i=first; i<count; i++)
+    {
+        f32 x = in.x[i], y = in.y[i], z = in.z[i];
+        f32 w = (in.w != NULL) ? in.w[i] : 1.0f;
+
+        f32 r[4];
+        for (u32 j=0; j<4; j++)
+            r[j] = p_m[j]*x + p_m[4 + j]*y + p_m[8 + j]*z + p_m[12 + j]*w;
+
+        out.x[i] = r[0];
+        out.y[i] = r[1];
+        out.z[i] = r[2];
+        if (out.w != NULL)
+            out.w[i] = r[3];
+    }
+}
+
+static void mdNormalizeVectorsScalar(const MdVector4SoA &in, const MdVector4SoA &out, usize first, usize count)
+{
+    for (usize i=first; i<count; i++)
+    {
+        f32 x = in.x[i], y = in.y[i], z = in.z[i];
+        f32 length_squared = x*x + y*y + z*z;
+        f32 inv_length = (length_squared > 0.0f) ? 1.0f / sqrtf(length_squared) : 0.0f;
+
+        out.x[i] = x * inv_length;
+        out.y[i] = y * inv_length;
+        out.z[i] = z * inv_length;
+    }
+}
+#pragma endregion
+
+#pragma region [ SSE ]
+static void mdTransformPointsSSE(const Matrix4x4 &m, const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    VECTOR_TYPE mm[16];
+    for (u32 j=0; j<16; j++)
+        mm[j] = _mm_set1_ps(m.ij[j]);
+
+    usize i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        VECTOR_TYPE x = _mm_loadu_ps(in.x + i);
+        VECTOR_TYPE y = _mm_loadu_ps(in.y + i);
+        VECTOR_TYPE z = _mm_loadu_ps(in.z + i);
+        VECTOR_TYPE w = (in.w != NULL) ? _mm_loadu_ps(in.w + i) : _mm_set1_ps(1.0f);
+
+        VECTOR_TYPE r[4];
+        for (u32 j=0; j<4; j++)
+        {
+            r[j] = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(mm[j], x), _mm_mul_ps(mm[4 + j], y)),
+                _mm_add_ps(_mm_mul_ps(mm[8 + j], z), _mm_mul_ps(mm[12 + j], w))
+            );
+        }
+
+        _mm_storeu_ps(out.x + i, r[0]);
+        _mm_storeu_ps(out.y + i, r[1]);
+        _mm_storeu_ps(out.z + i, r[2]);
+        if (out.w != NULL)
+            _mm_storeu_ps(out.w + i, r[3]);
+    }
+    mdTransformPointsScalar(m, in, out, i, count);
+}
+
+static void mdMultiplyMatricesSSE(const Matrix4x4 *p_a, const Matrix4x4 *p_b, Matrix4x4 *p_out, usize count)
+{
+    for (usize i=0; i<count; i++)
+    {
+        VECTOR_TYPE a[4] = {p_a[i].c0, p_a[i].c1, p_a[i].c2, p_a[i].c3};
+        VECTOR_TYPE b[4] = {p_b[i].c0, p_b[i].c1, p_b[i].c2, p_b[i].c3};
+
+        VECTOR_TYPE r[4];
+        for (u32 c=0; c<4; c++)
+        {
+            r[c] = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(a[0], _mm_shuffle_ps(b[c],b[c],_MM_SHUFFLE(0,0,0,0))),
+                    _mm_mul_ps(a[1], _mm_shuffle_ps(b[c],b[c],_MM_SHUFFLE(1,1,1,1)))
+                ),
+                _mm_add_ps(
+                    _mm_mul_ps(a[2], _mm_shuffle_ps(b[c],b[c],_MM_SHUFFLE(2,2,2,2))),
+                    _mm_mul_ps(a[3], _mm_shuffle_ps(b[c],b[c],_MM_SHUFFLE(3,3,3,3)))
+                )
+            );
+        }
+
+        p_out[i].c0 = r[0];
+        p_out[i].c1 = r[1];
+        p_out[i].c2 = r[2];
+        p_out[i].c3 = r[3];
+    }
+}
+
+static void mdNormalizeVectorsSSE(const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    VECTOR_TYPE zero = _mm_setzero_ps();
+    VECTOR_TYPE one = _mm_set1_ps(1.0f);
+
+    usize i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        VECTOR_TYPE x = _mm_loadu_ps(in.x + i);
+        VECTOR_TYPE y = _mm_loadu_ps(in.y + i);
+        VECTOR_TYPE z = _mm_loadu_ps(in.z + i);
+
+        // Full precision sqrt and divide, rsqrt alone is only good to about 12 bits
+        VECTOR_TYPE length_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        VECTOR_TYPE inv_length = _mm_and_ps(
+            _mm_div_ps(one, _mm_sqrt_ps(length_squared)),
+            _mm_cmpgt_ps(length_squared, zero)
+        );
+
+        _mm_storeu_ps(out.x + i, _mm_mul_ps(x, inv_length));
+        _mm_storeu_ps(out.y + i, _mm_mul_ps(y, inv_length));
+        _mm_storeu_ps(out.z + i, _mm_mul_ps(z, inv_length));
+    }
+    mdNormalizeVectorsScalar(in, out, i, count);
+}
+#pragma endregion
+
+#pragma region [ AVX2 ]
+MD_TARGET_AVX2
+static void mdTransformPointsAVX2(const Matrix4x4 &m, const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    __m256 mm[16];
+    for (u32 j=0; j<16; j++)
+        mm[j] = _mm256_set1_ps(m.ij[j]);
+
+    usize i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(in.x + i);
+        __m256 y = _mm256_loadu_ps(in.y + i);
+        __m256 z = _mm256_loadu_ps(in.z + i);
+        __m256 w = (in.w != NULL) ? _mm256_loadu_ps(in.w + i) : _mm256_set1_ps(1.0f);
+
+        __m256 r[4];
+        for (u32 j=0; j<4; j++)
+            r[j] = _mm256_fmadd_ps(mm[j], x, _mm256_fmadd_ps(mm[4 + j], y, _mm256_fmadd_ps(mm[8 + j], z, _mm256_mul_ps(mm[12 + j], w))));
+
+        _mm256_storeu_ps(out.x + i, r[0]);
+        _mm256_storeu_ps(out.y + i, r[1]);
+        _mm256_storeu_ps(out.z + i, r[2]);
+        if (out.w != NULL)
+            _mm256_storeu_ps(out.w + i, r[3]);
+    }
+    mdTransformPointsScalar(m, in, out, i, count);
+}
+
+// Two result columns per 256 bit vector, each half broadcasts its own column of b
+MD_TARGET_AVX2
+static void mdMultiplyMatricesAVX2(const Matrix4x4 *p_a, const Matrix4x4 *p_b, Matrix4x4 *p_out, usize count)
+{
+    for (usize i=0; i<count; i++)
+    {
+        __m256 a0 = _mm256_broadcast_ps(&p_a[i].c0);
+        __m256 a1 = _mm256_broadcast_ps(&p_a[i].c1);
+        __m256 a2 = _mm256_broadcast_ps(&p_a[i].c2);
+        __m256 a3 = _mm256_broadcast_ps(&p_a[i].c3);
+        __m256 b01 = _mm256_loadu_ps(p_b[i].ij);
+        __m256 b23 = _mm256_loadu_ps(p_b[i].ij + 8);
+
+        __m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+        r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), r01);
+        r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xAA), r01);
+        r01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xFF), r01);
+
+        __m256 r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+        r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), r23);
+        r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xAA), r23);
+        r23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xFF), r23);
+
+        _mm256_storeu_ps(p_out[i].ij, r01);
+        _mm256_storeu_ps(p_out[i].ij + 8, r23);
+    }
+}
+
+MD_TARGET_AVX2
+static void mdNormalizeVectorsAVX2(const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    usize i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(in.x + i);
+        __m256 y = _mm256_loadu_ps(in.y + i);
+        __m256 z = _mm256_loadu_ps(in.z + i);
+
+        __m256 length_squared = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z)));
+        __m256 inv_length = _mm256_and_ps(
+            _mm256_div_ps(one, _mm256_sqrt_ps(length_squared)),
+            _mm256_cmp_ps(length_squared, zero, _CMP_GT_OQ)
+        );
+
+        _mm256_storeu_ps(out.x + i, _mm256_mul_ps(x, inv_length));
+        _mm256_storeu_ps(out.y + i, _mm256_mul_ps(y, inv_length));
+        _mm256_storeu_ps(out.z + i, _mm256_mul_ps(z, inv_length));
+    }
+    mdNormalizeVectorsScalar(in, out, i, count);
+}
+#pragma endregion
+
+#pragma region [ AVX-512 ]
+// Tails use masked loads and stores, so there is no scalar loop after these. GCC's unmasked sqrt, 
+// broadcast and permute merge into _mm512_undefined_ps, which -Wmaybe-uninitialized flags, so 
+// their zero masking forms are used with every lane set. They compile to the same instructions
+#define MD_AVX512_ALL_LANES ((__mmask16)0xFFFF)
+MD_TARGET_AVX512
+static void mdTransformPointsAVX512(const Matrix4x4 &m, const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    __m512 mm[16];
+    for (u32 j=0; j<16; j++)
+        mm[j] = _mm512_set1_ps(m.ij[j]);
+
+    for (usize i=0; i<count; i += 16)
+    {
+        usize remaining = count - i;
+        __mmask16 mask = (remaining >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+
+        __m512 x = _mm512_maskz_loadu_ps(mask, in.x + i);
+        __m512 y = _mm512_maskz_loadu_ps(mask, in.y + i);
+        __m512 z = _mm512_maskz_loadu_ps(mask, in.z + i);
+        __m512 w = (in.w != NULL) ? _mm512_maskz_loadu_ps(mask, in.w + i) : _mm512_set1_ps(1.0f);
+
+        __m512 r[4];
+        for (u32 j=0; j<4; j++)
+            r[j] = _mm512_fmadd_ps(mm[j], x, _mm512_fmadd_ps(mm[4 + j], y, _mm512_fmadd_ps(mm[8 + j], z, _mm512_mul_ps(mm[12 + j], w))));
+
+        _mm512_mask_storeu_ps(out.x + i, mask, r[0]);
+        _mm512_mask_storeu_ps(out.y + i, mask, r[1]);
+        _mm512_mask_storeu_ps(out.z + i, mask, r[2]);
+        if (out.w != NULL)
+            _mm512_mask_storeu_ps(out.w + i, mask, r[3]);
+    }
+}
+
+// A whole matrix per 512 bit vector, each 128 bit lane broadcasts its own column of b
+MD_TARGET_AVX512
+static void mdMultiplyMatricesAVX512(const Matrix4x4 *p_a, const Matrix4x4 *p_b, Matrix4x4 *p_out, usize count)
+{
+    for (usize i=0; i<count; i++)
+    {
+        __m512 a0 = _mm512_maskz_broadcast_f32x4(MD_AVX512_ALL_LANES, p_a[i].c0);
+        __m512 a1 = _mm512_maskz_broadcast_f32x4(MD_AVX512_ALL_LANES, p_a[i].c1);
+        __m512 a2 = _mm512_maskz_broadcast_f32x4(MD_AVX512_ALL_LANES, p_a[i].c2);
+        __m512 a3 = _mm512_maskz_broadcast_f32x4(MD_AVX512_ALL_LANES, p_a[i].c3);
+        __m512 b = _mm512_loadu_ps(p_b[i].ij);
+
+        __m512 r = _mm512_mul_ps(a0, _mm512_maskz_permute_ps(MD_AVX512_ALL_LANES, b, 0x00));
+        r = _mm512_fmadd_ps(a1, _mm512_maskz_permute_ps(MD_AVX512_ALL_LANES, b, 0x55), r);
+        r = _mm512_fmadd_ps(a2, _mm512_maskz_permute_ps(MD_AVX512_ALL_LANES, b, 0xAA), r);
+        r = _mm512_fmadd_ps(a3, _mm512_maskz_permute_ps(MD_AVX512_ALL_LANES, b, 0xFF), r);
+
+        _mm512_storeu_ps(p_out[i].ij, r);
+    }
+}
+
+MD_TARGET_AVX512
+static void mdNormalizeVectorsAVX512(const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    __m512 one = _mm512_set1_ps(1.0f);
+
+    for (usize i=0; i<count; i += 16)
+    {
+        usize remaining = count - i;
+        __mmask16 mask = (remaining >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+
+        __m512 x = _mm512_maskz_loadu_ps(mask, in.x + i);
+        __m512 y = _mm512_maskz_loadu_ps(mask, in.y + i);
+        __m512 z = _mm512_maskz_loadu_ps(mask, in.z + i);
+
+        __m512 length_squared = _mm512_fmadd_ps(x, x, _mm512_fmadd_ps(y, y, _mm512_mul_ps(z, z)));
+        __mmask16 nonzero = _mm512_cmp_ps_mask(length_squared, _mm512_setzero_ps(), _CMP_GT_OQ);
+        __m512 inv_length = _mm512_maskz_div_ps(nonzero, one, _mm512_maskz_sqrt_ps(nonzero, length_squared));
+
+        _mm512_mask_storeu_ps(out.x + i, mask, _mm512_mul_ps(x, inv_length));
+        _mm512_mask_storeu_ps(out.y + i, mask, _mm512_mul_ps(y, inv_length));
+        _mm512_mask_storeu_ps(out.z + i, mask, _mm512_mul_ps(z, inv_length));
+    }
+}
+#pragma endregion
+
+#pragma region [ Dispatch ]
+static u64 mdReadXCR0()
+{
+    u32 eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((u64)edx << 32) | eax;
+}
+
+// The CPU reporting AVX isn't enough, the OS also has to save the wider registers (XCR0)
+static MdSimdLevel mdDetectSimdLevel()
+{
+    u32 eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return MD_SIMD_SSE;
+
+    bool fma = (ecx & bit_FMA) != 0;
+    if ((ecx & bit_OSXSAVE) == 0 || (ecx & bit_AVX) == 0)
+        return MD_SIMD_SSE;
+
+    u64 xcr0 = mdReadXCR0();
+    if ((xcr0 & 0x6) != 0x6)
+        return MD_SIMD_SSE;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return MD_SIMD_SSE;
+
+    // Opmask and both halves of the zmm registers on top of the xmm and ymm state
+    if ((ebx & bit_AVX512F) != 0 && (xcr0 & 0xE6) == 0xE6)
+        return MD_SIMD_AVX512;
+    if ((ebx & bit_AVX2) != 0 && fma)
+        return MD_SIMD_AVX2;
+
+    return MD_SIMD_SSE;
+}
+
+// Indexed by level
+static const MdSimdKernels simd_kernels[] = {
+    {MD_SIMD_SSE, mdTransformPointsSSE, mdMultiplyMatricesSSE, mdNormalizeVectorsSSE},
+    {MD_SIMD_AVX2, mdTransformPointsAVX2, mdMultiplyMatricesAVX2, mdNormalizeVectorsAVX2},
+    {MD_SIMD_AVX512, mdTransformPointsAVX512, mdMultiplyMatricesAVX512, mdNormalizeVectorsAVX512}
+};
+
+// Switching levels swaps a single pointer to a constant table, so other threads calling the 
+// kernels at the same time see either the old set or the new one, never a mix
+struct MdSimdDispatch
+{
+    MdSimdLevel supported;
+    std::atomic<const MdSimdKernels*> p_kernels;
+
+    MdSimdDispatch(MdSimdLevel level) : supported(level), p_kernels(&simd_kernels[level]) {}
+};
+
+static MdSimdDispatch &mdGetSimdDispatch()
+{
+    static MdSimdDispatch dispatch(mdDetectSimdLevel());
+    return dispatch;
+}
+
+static const MdSimdKernels *mdGetSimdKernels()
+{
+    return mdGetSimdDispatch().p_kernels.load(std::memory_order_acquire);
+}
+
+MdSimdLevel mdGetSimdLevel()
+{
+    return mdGetSimdKernels()->level;
+}
+
+MdSimdLevel mdSetSimdLevel(MdSimdLevel level)
+{
+    MdSimdDispatch &dispatch = mdGetSimdDispatch();
+    level = MIN_VAL(level, dispatch.supported);
+    dispatch.p_kernels.store(&simd_kernels[level], std::memory_order_release);
+    return level;
+}
+
+const char *mdGetSimdLevelName(MdSimdLevel level)
+{
+    switch (level)
+    {
+        case MD_SIMD_AVX512: return "avx512";
+        case MD_SIMD_AVX2: return "avx2";
+        default: return "sse";
+    }
+}
+
+void mdTransformPoints(const Matrix4x4 &m, const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    mdGetSimdKernels()->transform_points(m, in, out, count);
+}
+
+void mdMultiplyMatrices(const Matrix4x4 *p_a, const Matrix4x4 *p_b, Matrix4x4 *p_out, usize count)
+{
+    mdGetSimdKernels()->multiply_matrices(p_a, p_b, p_out, count);
+}
+
+void mdNormalizeVectors(const MdVector4SoA &in, const MdVector4SoA &out, usize count)
+{
+    mdGetSimdKernels()->normalize_vectors(in, out, count);
+}
+#pragma endregion
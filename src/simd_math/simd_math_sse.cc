@@ -47,11 +47,9 @@ VECTOR_TYPE Vector4::Normalize()
     shuf = _mm_movehl_ps(sums, sums);
     sums = _mm_add_ps(shuf, sums);
     
-    sums = _mm_rsqrt_ss(sums);
-    return _mm_mul_ps(
-        _mm_shuffle_ps(sums,sums,_MM_SHUFFLE(0,0,0,0)),
-        v
-    );
+    // rsqrt alone is only good to 12 bits
+    sums = _mm_sqrt_ps(_mm_shuffle_ps(sums,sums,_MM_SHUFFLE(0,0,0,0)));
+    return _mm_div_ps(this->xyzw_m128, sums);
 }
 
 f32 Vector4::GetXYZW(Vector4_Component c)
@@ -87,11 +85,8 @@ VECTOR_TYPE Vector4::Normalize(const VECTOR_TYPE &vin)
     shuf = _mm_movehl_ps(sums, sums);
     sums = _mm_add_ps(shuf, sums);
     
-    sums = _mm_rsqrt_ss(sums);
-    return _mm_mul_ps(
-        _mm_shuffle_ps(sums,sums,_MM_SHUFFLE(0,0,0,0)),
-        v
-    );
+    sums = _mm_sqrt_ps(_mm_shuffle_ps(sums,sums,_MM_SHUFFLE(0,0,0,0)));
+    return _mm_div_ps(vin, sums);
 }
 
 VECTOR_TYPE Vector4::Lerp(const VECTOR_TYPE &a, const VECTOR_TYPE &b, const f32 t)